@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "hashmap.h"
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+#include "object.h"
+
+// Allocation profiler (--alloc-profile).
+//
+// While it is installed as this thread's allocation_hook (object.h), the
+// tree walker tells it which expression is being evaluated and which
+// function it is in; an object allocated is charged to the innermost
+// expression still being evaluated, so the Integer of a + b goes to the
+// Binary, not to a or b. One allocation in `rate` on average is recorded,
+// weighted by the rate. The gaps between recorded allocations are random,
+// so a loop allocating in a fixed pattern is neither over- nor
+// under-counted. Bytes are the size of the objects themselves, not of the
+// buffers of lists, dicts and strings.
+//
+// Only the tree walker tracks sites: the JIT, the closure engine and
+// specialization are off while profiling allocations, and parallel_map
+// runs serially. Frames are not objects (their slots live in the caller's
+// ArgBuffer), but the Cells of captured variables are, under "other".
+
+// Renders an expression roughly as it was written, for the report.
+class ExprText : Visitor<void> {
+public:
+    std::string text(Expr* expr) {
+        out.clear();
+        expr->accept(this);
+        return out;
+    }
+
+private:
+    std::string out;
+
+    static const char* op(TokenType type) {
+        switch (type) {
+        case PLUS: return "+";
+        case MINUS: return "-";
+        case DIVIDE: return "/";
+        case FLOOR_DIVIDE: return "//";
+        case MULTIPLY: return "*";
+        case EQUAL_TO: return "==";
+        case NOT_EQUAL_TO: return "!=";
+        case GREATER_THAN: return ">";
+        case LESS_THAN: return "<";
+        case GREATER_THAN_EQUAL_TO: return ">=";
+        case LESS_THAN_EQUAL_TO: return "<=";
+        case AND: return "and";
+        case OR: return "or";
+        case NOT: return "not ";
+        default: return "?";
+        }
+    }
+
+    void list(const std::vector<Expr*>& exprs) {
+        for (size_t i = 0; i < exprs.size(); i++) {
+            if (i != 0) {
+                out += ", ";
+            }
+            exprs[i]->accept(this);
+        }
+    }
+
+    // only expressions are rendered
+    void visitVarStatement(Var* stmt) override {}
+    void visitBlockStmt(Block* stmt) override {}
+    void visitExpressionStmt(Expression* stmt) override {}
+    void visitForStmt(For* stmt) override {}
+    void visitFunctionStmt(Function* stmt) override {}
+    void visitGlobalStmt(Global* stmt) override {}
+    void visitIfStmt(If* stmt) override {}
+    void visitImportStmt(Import* stmt) override {}
+    void visitNonlocalStmt(Nonlocal* stmt) override {}
+    void visitPrintStatement(Print* stmt) override {}
+    void visitReturnStmt(Return* stmt) override {}
+    void visitYieldStmt(Yield* stmt) override {}
+
+    void visitAssignExpr(Assign* expr) override {
+        out += expr->name.value + " = ";
+        expr->value->accept(this);
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        expr->left->accept(this);
+        out += std::string(" ") + op(expr->op.type) + " ";
+        expr->right->accept(this);
+    };
+
+    void visitCallExpr(Call* expr) override {
+        if (expr->object != nullptr) {
+            expr->object->accept(this);
+            out += ".";
+        }
+        out += expr->callee.value + "(";
+        list(expr->args);
+        out += ")";
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        expr->thenBranch->accept(this);
+        out += " if ";
+        expr->condition->accept(this);
+        out += " else ";
+        expr->elseBranch->accept(this);
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        out += "{";
+        for (size_t i = 0; i < expr->keys.size(); i++) {
+            if (i != 0) {
+                out += ", ";
+            }
+            expr->keys[i]->accept(this);
+            out += ": ";
+            expr->values[i]->accept(this);
+        }
+        out += "}";
+    };
+
+    void visitGetExpr(Get* expr) override {
+        expr->object->accept(this);
+        out += "." + expr->name.value;
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        out += "(";
+        expr->expression->accept(this);
+        out += ")";
+    };
+
+    void visitInlineExpr(Inline* expr) override {
+        expr->call->accept(this);
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        out += "[";
+        list(expr->items);
+        out += "]";
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        switch (expr->token.type) {
+        case TRUE: out += "True"; break;
+        case FALSE: out += "False"; break;
+        case NONE: out += "None"; break;
+        case STRING: out += "'" + expr->token.value + "'"; break;
+        default: out += expr->token.value;
+        }
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        expr->left->accept(this);
+        out += std::string(" ") + op(expr->op.type) + " ";
+        expr->right->accept(this);
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        expr->object->accept(this);
+        out += "[";
+        expr->index->accept(this);
+        out += "] = ";
+        expr->value->accept(this);
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        expr->object->accept(this);
+        out += "[";
+        expr->index->accept(this);
+        out += "]";
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        out += op(expr->op.type);
+        expr->right->accept(this);
+    };
+
+    void visitVariableExpr(Variable* expr) override {
+        out += expr->name.value;
+    };
+};
+
+class AllocationProfiler : public AllocationHook {
+public:
+    static const size_t TOP = 20;
+    // longest expression text shown
+    static const size_t WIDTH = 48;
+
+    // the expression being evaluated and the function it is in; null at
+    // top level
+    Expr* site = nullptr;
+    Function* function = nullptr;
+
+    // records one allocation in rate, on average
+    explicit AllocationProfiler(uint64_t rate) : rate(std::max<uint64_t>(rate, 1)) {
+        countdown = gap();
+    }
+
+    void start() {
+        allocation_hook = this;
+    }
+
+    void stop() {
+        allocation_hook = nullptr;
+    }
+
+    void sampled(size_t size, uint16_t type) override {
+        countdown = gap();
+        Site& s = sites[site];
+        if (s.objects == 0) {
+            s.function = function;
+        }
+        s.objects += rate;
+        s.bytes += rate * size;
+        s.types |= type;
+        samples++;
+    }
+
+    // Writes the sites that allocated the most bytes to out.
+    void report(std::ostream& out) {
+        std::vector<std::pair<Expr*, Site>> rows;
+        uint64_t objects = 0;
+        uint64_t bytes = 0;
+        for (auto& e : sites) {
+            rows.push_back({ e.key, e.value });
+            objects += e.value.objects;
+            bytes += e.value.bytes;
+        }
+        std::sort(rows.begin(), rows.end(), [](const std::pair<Expr*, Site>& a, const std::pair<Expr*, Site>& b) {
+            return a.second.bytes != b.second.bytes ? a.second.bytes > b.second.bytes : a.second.objects > b.second.objects;
+        });
+
+        out << "allocations: " << objects << " objects, " << bytes << " bytes at " << rows.size() << " sites";
+        if (rate > 1) {
+            out << " (estimated from " << samples << " samples, 1 in " << rate << ")";
+        }
+        out << "\n";
+        char line[160];
+        std::snprintf(line, sizeof(line), "%10s %12s %7s  %-14s %-16s %5s  %s\n", "objects", "bytes", "bytes%", "types",
+                      "function", "line", "expression");
+        out << line;
+        ExprText text;
+        double total = std::max<double>(bytes, 1);
+        for (size_t i = 0; i < rows.size() && i < TOP; i++) {
+            Site& s = rows[i].second;
+            std::string expr = rows[i].first != nullptr ? text.text(rows[i].first) : "(no expression)";
+            if (expr.size() > WIDTH) {
+                expr = expr.substr(0, WIDTH - 3) + "...";
+            }
+            std::snprintf(line, sizeof(line), "%10llu %12llu %6.1f%%  %-14s %-16s %5s  ", (unsigned long long)s.objects,
+                          (unsigned long long)s.bytes, 100 * s.bytes / total, typeNames(s.types).c_str(),
+                          s.function != nullptr ? s.function->name.value.c_str() : "<module>",
+                          rows[i].first != nullptr ? std::to_string(rows[i].first->line).c_str() : "-");
+            out << line << expr << "\n";
+        }
+    }
+
+private:
+    struct Site {
+        uint64_t objects = 0;
+        uint64_t bytes = 0;
+        // TypeBits of the objects
+        uint16_t types = 0;
+        Function* function = nullptr;
+    };
+
+    uint64_t rate;
+    uint64_t samples = 0;
+    uint64_t random = 0x9e3779b97f4a7c15;
+    HashMap<Expr*, Site> sites;
+
+    // allocations until the next one recorded: 1 to 2 * rate - 1
+    int64_t gap() {
+        if (rate == 1) {
+            return 1;
+        }
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        return (int64_t)(1 + random % (2 * rate - 1));
+    }
+
+    static std::string typeNames(uint16_t types) {
+        std::string s;
+        for (int i = 0; i < TYPE_KINDS; i++) {
+            if (types & (1 << i)) {
+                s += s.empty() ? "" : "|";
+                s += TYPE_NAMES[i];
+            }
+        }
+        return s;
+    }
+};
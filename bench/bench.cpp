@@ -0,0 +1,453 @@
+// Benchmark suite for the scanner, the parser and the interpreter, with no
+// dependencies beyond the interpreter's headers.
+//
+// g++ -std=c++17 -O2 -pthread bench/bench.cpp -o bench_suite
+// ./bench_suite [--reps N] [--engine=walk|closure] [--no-jit] [--no-specialize] [--json] [name...]
+// ./bench_suite --compare base.json new.json
+//
+// Each benchmark runs twice to warm up and then --reps times (15 by
+// default). Only the measured step is timed: the interpreter benchmarks
+// scan, parse and resolve their script beforehand, on a fresh Interpreter
+// each run. For each one the suite reports the median and 95th percentile
+// time, the throughput at the median, and the heap allocations of one run
+// (counted by replacing the global operator new). --json prints the same
+// as JSON, one benchmark per line; --compare reads two such files, e.g.
+// from two builds, and prints the change in median time.
+//
+// The cost of the tracing hooks (hooks.h) when none are set is that of a
+// default build against one with -DMYPYTHON_HOOKS=0:
+//
+// g++ -std=c++17 -O2 -pthread -DMYPYTHON_HOOKS=0 bench/bench.cpp -o bench_nohooks
+// ./bench_nohooks --json > base.json && ./bench_suite --json > new.json
+// ./bench_suite --compare base.json new.json
+//
+// fib_hooked runs fib with hooks that do nothing, which turns off the JIT
+// and specialization; against fib under --no-jit --no-specialize it shows
+// the cost of making the callbacks.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../scanner.h"
+#include "../parser.h"
+#include "../resolver.h"
+#include "../interpreter.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static size_t alloc_count = 0;
+static size_t alloc_bytes = 0;
+
+void* operator new(size_t size) {
+	alloc_count++;
+	alloc_bytes += size;
+	if (void* p = std::malloc(size != 0 ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+// Every delete matches the allocation above, so all of them free. They are
+// not inlined: GCC would see free() called on what `new` returned at each
+// delete expression and warn (-Wmismatched-new-delete).
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+[[gnu::noinline]] void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void* p, size_t) noexcept {
+	std::free(p);
+}
+
+struct Options {
+	int reps = 15;
+	Engine engine = ENGINE_WALK;
+	bool jit = true;
+	bool specialize = true;
+	bool json = false;
+	std::vector<std::string> only;
+};
+
+// setup runs untimed before every run; items is the work one run does, in
+// unit, for the throughput
+struct Bench {
+	std::string name;
+	std::string unit;
+	double items;
+	std::function<void()> setup;
+	std::function<void()> run;
+};
+
+struct Result {
+	std::string name;
+	std::string unit;
+	double median_ms;
+	double p95_ms;
+	double throughput;
+	size_t allocs;
+	size_t bytes;
+};
+
+// --- scripts ---
+
+static const char* FIB =
+	"def fib(n):\n"
+	"    if n < 2:\n"
+	"        return n\n"
+	"    return fib(n - 1) + fib(n - 2)\n"
+	"\n"
+	"print(fib(20))\n";
+
+// bench/mutual.py, smaller
+static const char* MUTUAL =
+	"def is_even(n):\n"
+	"    if n == 0:\n"
+	"        return True\n"
+	"    else:\n"
+	"        return is_odd(n - 1)\n"
+	"\n"
+	"def is_odd(n):\n"
+	"    if n == 0:\n"
+	"        return False\n"
+	"    else:\n"
+	"        return is_even(n - 1)\n"
+	"\n"
+	"count = 0\n"
+	"for i in range(300):\n"
+	"    if is_even(i + 100):\n"
+	"        count = count + 1\n"
+	"print(count)\n";
+
+static const char* PRINTS =
+	"names = {\"a\": [1, 2, 3], \"b\": \"text\"}\n"
+	"for i in range(20000):\n"
+	"    print(\"line\", i, names[\"a\"], names[\"b\"], i * 3 == 6)\n";
+
+static const int PRINT_LINES = 20000;
+static const int FIB_CALLS = 21891;
+// is_even(i + 100) makes i + 101 calls
+static const int MUTUAL_CALLS = 300 * 101 + 299 * 300 / 2;
+
+// a left-nested sum of depth terms, evaluated loops times
+static std::string deepExpression(int depth, int loops) {
+	std::string expr = "x";
+	for (int i = 1; i < depth; i++) {
+		expr = "(" + expr + " + " + std::to_string(i) + " * x)";
+	}
+	return "def f(x):\n"
+		"    return " + expr + "\n"
+		"\n"
+		"total = 0\n"
+		"for i in range(" + std::to_string(loops) + "):\n"
+		"    total = total + f(1)\n"
+		"print(total)\n";
+}
+
+// defs of a few statements each, every one called once
+static std::string largeScript(int functions) {
+	std::string code;
+	for (int i = 0; i < functions; i++) {
+		std::string n = std::to_string(i);
+		code += "def f" + n + "(a, b):\n"
+			"    xs = [a, b, " + n + "]\n"
+			"    total = 0\n"
+			"    for x in xs:\n"
+			"        if x > " + n + ":\n"
+			"            total = total + x * 2\n"
+			"        else:\n"
+			"            total = total - x\n"
+			"    return {\"f" + n + "\": total}\n"
+			"\n";
+	}
+	for (int i = 0; i < functions; i++) {
+		std::string n = std::to_string(i);
+		code += "r = f" + n + "(" + n + ", 7)\n";
+	}
+	code += "print(r)\n";
+	return code;
+}
+
+// --- harness ---
+
+static std::vector<Statement*> compile(const std::string& code) {
+	Scanner scan(code);
+	Parser parser(scan.getTokens());
+	std::vector<Statement*> stmts = parser.parse();
+	Resolver resolver;
+	resolver.resolve(stmts);
+	return stmts;
+}
+
+static std::string output;
+
+static void configure(Interpreter& in, const Options& options) {
+	in.engine = options.engine;
+	in.jit.enabled = in.jit.enabled && options.jit;
+	in.specializer.enabled = options.specialize;
+}
+
+// callbacks that do nothing
+class NoHooks : public Hooks {};
+
+// the interpreter running code; the tree is rebuilt for every run, since
+// running keeps state on it
+static Bench interpreterBench(const std::string& name, const std::string& code, const std::string& unit,
+                              double items, const Options& options, Hooks* hooks = nullptr) {
+	auto stmts = std::make_shared<std::vector<Statement*>>();
+	auto in = std::make_shared<std::unique_ptr<Interpreter>>();
+	Bench b;
+	b.name = name;
+	b.unit = unit;
+	b.items = items;
+	b.setup = [=, &options]() {
+		*stmts = compile(code);
+		output.clear();
+		in->reset(new Interpreter(&output));
+		configure(**in, options);
+		(*in)->setHooks(hooks);
+	};
+	b.run = [=]() {
+		(*in)->run(*stmts);
+		(*in)->out.flush();
+	};
+	return b;
+}
+
+static std::vector<Bench> benchmarks(const Options& options) {
+	std::vector<Bench> all;
+
+	// scanner and parser input: a large generated script
+	static std::string source = largeScript(2000);
+	static size_t tokens = Scanner(source).getTokens().size();
+
+	Bench scan;
+	scan.name = "scan";
+	scan.unit = "MB/s";
+	scan.items = source.size() / 1e6;
+	scan.setup = []() {};
+	scan.run = []() {
+		Scanner s(source);
+		if (s.getTokens().size() != tokens) {
+			std::abort();
+		}
+	};
+	all.push_back(scan);
+
+	auto scanned = std::make_shared<std::vector<Token>>();
+	Bench parse;
+	parse.name = "parse";
+	parse.unit = "tokens/s";
+	parse.items = (double)tokens;
+	parse.setup = [=]() {
+		*scanned = Scanner(source).getTokens();
+	};
+	parse.run = [=]() {
+		Parser parser(*scanned);
+		parser.parse();
+	};
+	all.push_back(parse);
+
+	all.push_back(interpreterBench("fib", FIB, "calls/s", FIB_CALLS, options));
+	static NoHooks no_hooks;
+	all.push_back(interpreterBench("fib_hooked", FIB, "calls/s", FIB_CALLS, options, &no_hooks));
+	all.push_back(interpreterBench("mutual", MUTUAL, "calls/s", MUTUAL_CALLS, options));
+	all.push_back(interpreterBench("print", PRINTS, "lines/s", PRINT_LINES, options));
+	all.push_back(interpreterBench("deep_expr", deepExpression(200, 2000), "terms/s", 200.0 * 2000, options));
+
+	// end to end, from source to output
+	static std::string large = largeScript(1000);
+	Bench script;
+	script.name = "large_script";
+	script.unit = "MB/s";
+	script.items = large.size() / 1e6;
+	script.setup = []() {
+		output.clear();
+	};
+	script.run = [&options]() {
+		std::vector<Statement*> stmts = compile(large);
+		Interpreter in(&output);
+		configure(in, options);
+		in.run(stmts);
+		in.out.flush();
+	};
+	all.push_back(script);
+	return all;
+}
+
+static Result measure(Bench& b, int reps) {
+	std::vector<double> times;
+	size_t allocs = 0;
+	size_t bytes = 0;
+	for (int i = -2; i < reps; i++) {
+		b.setup();
+		size_t count_before = alloc_count;
+		size_t bytes_before = alloc_bytes;
+		Clock::time_point start = Clock::now();
+		b.run();
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		if (i >= 0) {
+			times.push_back(ms);
+			allocs = alloc_count - count_before;
+			bytes = alloc_bytes - bytes_before;
+		}
+	}
+	std::sort(times.begin(), times.end());
+	Result r;
+	r.name = b.name;
+	r.unit = b.unit;
+	r.median_ms = times[times.size() / 2];
+	// nearest rank
+	r.p95_ms = times[std::min(times.size() - 1, (size_t)(times.size() * 0.95))];
+	r.throughput = b.items / (r.median_ms / 1000);
+	r.allocs = allocs;
+	r.bytes = bytes;
+	return r;
+}
+
+static void printTable(const std::vector<Result>& results) {
+	std::printf("%-14s %11s %11s %16s %12s %12s\n", "benchmark", "median ms", "p95 ms", "throughput", "allocs", "alloc KB");
+	for (const Result& r : results) {
+		std::printf("%-14s %11.3f %11.3f %12.4g %-9s %9zu %12.1f\n", r.name.c_str(), r.median_ms, r.p95_ms,
+		            r.throughput, r.unit.c_str(), r.allocs, r.bytes / 1024.0);
+	}
+}
+
+static void printJson(const std::vector<Result>& results, const Options& options) {
+	std::printf("{\n  \"engine\": \"%s\", \"jit\": %s, \"specialize\": %s, \"reps\": %d,\n  \"benchmarks\": [\n",
+	            options.engine == ENGINE_CLOSURE ? "closure" : "walk", options.jit ? "true" : "false",
+	            options.specialize ? "true" : "false", options.reps);
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result& r = results[i];
+		std::printf("    {\"name\": \"%s\", \"median_ms\": %.6f, \"p95_ms\": %.6f, \"throughput\": %.6g, "
+		            "\"unit\": \"%s\", \"allocs\": %zu, \"alloc_bytes\": %zu}%s\n",
+		            r.name.c_str(), r.median_ms, r.p95_ms, r.throughput, r.unit.c_str(), r.allocs, r.bytes,
+		            i + 1 < results.size() ? "," : "");
+	}
+	std::printf("  ]\n}\n");
+}
+
+// The benchmarks of a file printJson wrote: only the one-per-line shape it
+// uses is understood.
+static std::vector<Result> readJson(const std::string& path) {
+	std::ifstream file(path);
+	if (!file) {
+		throw std::runtime_error("cannot open '" + path + "'");
+	}
+	std::vector<Result> results;
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t at = line.find("{\"name\": \"");
+		if (at == std::string::npos) {
+			continue;
+		}
+		char name[64];
+		Result r;
+		if (std::sscanf(line.c_str() + at, "{\"name\": \"%63[^\"]\", \"median_ms\": %lf, \"p95_ms\": %lf, "
+		                "\"throughput\": %lf", name, &r.median_ms, &r.p95_ms, &r.throughput) != 4) {
+			throw std::runtime_error("cannot read '" + path + "': " + line);
+		}
+		size_t allocs = line.find("\"allocs\": ");
+		r.name = name;
+		r.allocs = allocs != std::string::npos ? std::strtoul(line.c_str() + allocs + 10, nullptr, 10) : 0;
+		results.push_back(r);
+	}
+	return results;
+}
+
+static void compare(const std::string& base_path, const std::string& new_path) {
+	std::vector<Result> base = readJson(base_path);
+	std::vector<Result> current = readJson(new_path);
+	std::printf("%-14s %12s %12s %9s %12s %12s\n", "benchmark", "base ms", "new ms", "change", "base allocs", "new allocs");
+	for (const Result& n : current) {
+		for (const Result& b : base) {
+			if (b.name == n.name) {
+				std::printf("%-14s %12.3f %12.3f %+8.1f%% %12zu %12zu\n", n.name.c_str(), b.median_ms, n.median_ms,
+				            (n.median_ms / b.median_ms - 1) * 100, b.allocs, n.allocs);
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--compare" && i + 2 < argc) {
+			try {
+				compare(argv[i + 1], argv[i + 2]);
+			}
+			catch (std::exception& e) {
+				std::fprintf(stderr, "%s\n", e.what());
+				return 1;
+			}
+			return 0;
+		}
+		else if (arg == "--reps" && i + 1 < argc) {
+			options.reps = std::max(std::atoi(argv[++i]), 1);
+		}
+		else if (arg == "--engine=walk") {
+			options.engine = ENGINE_WALK;
+		}
+		else if (arg == "--engine=closure") {
+			options.engine = ENGINE_CLOSURE;
+		}
+		else if (arg == "--no-jit") {
+			options.jit = false;
+		}
+		else if (arg == "--no-specialize") {
+			options.specialize = false;
+		}
+		else if (arg == "--json") {
+			options.json = true;
+		}
+		else if (arg[0] != '-') {
+			options.only.push_back(arg);
+		}
+		else {
+			std::fprintf(stderr, "usage: bench_suite [--reps N] [--engine=walk|closure] [--no-jit] [--no-specialize] "
+			             "[--json] [name...]\n       bench_suite --compare base.json new.json\n");
+			return 1;
+		}
+	}
+
+	std::vector<Result> results;
+	for (Bench& b : benchmarks(options)) {
+		if (!options.only.empty() && std::find(options.only.begin(), options.only.end(), b.name) == options.only.end()) {
+			continue;
+		}
+		try {
+			results.push_back(measure(b, options.reps));
+		}
+		catch (std::exception& e) {
+			std::fprintf(stderr, "%s: %s\n", b.name.c_str(), e.what());
+			return 1;
+		}
+	}
+
+	if (options.json) {
+		printJson(results, options);
+	}
+	else {
+		printTable(results);
+	}
+	return 0;
+}
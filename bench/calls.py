@@ -0,0 +1,12 @@
+# Call-heavy workload: every addition goes through a user function call.
+# time ./mypython bench/calls.py
+
+def add(a, b):
+    return a + b
+
+def fib(n):
+    if n < 2:
+        return n
+    return add(fib(n - 1), fib(n - 2))
+
+print(fib(25))
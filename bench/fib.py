@@ -0,0 +1,9 @@
+# Recursive fib: the JIT's best case.
+# time ./mypython --jit bench/fib.py; time ./mypython --no-jit bench/fib.py
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+print(fib(30))
@@ -0,0 +1,26 @@
+# Resuming a generator against calling a function, once per value. The
+# per-value cost of the two loops should be close.
+# time ./mypython --no-jit bench/generators.py
+# time ./mypython --no-jit --engine=closure bench/generators.py
+
+def numbers(n):
+    for i in range(n):
+        yield i
+
+def identity(i):
+    return i
+
+def by_generator(n):
+    total = 0
+    for v in numbers(n):
+        total = total + v
+    return total
+
+def by_call(n):
+    total = 0
+    for i in range(n):
+        total = total + identity(i)
+    return total
+
+print(by_generator(1000000))
+print(by_call(1000000))
@@ -0,0 +1,19 @@
+# Global reads and calls resolved through the module namespace: what the
+# inline caches on Call and global-reading nodes skip.
+# time ./mypython --no-jit bench/globals.py
+
+scale = 3
+offset = 1
+
+def step(x):
+    return x * scale + offset
+
+def run(n):
+    total = 0
+    for i in range(n):
+        total = step(i) - step(total) + total * scale
+    return total
+
+for j in range(200):
+    result = run(1000)
+print(result)
@@ -0,0 +1,106 @@
+// Insertion and lookup benchmark for HashMap against std::map and
+// std::unordered_map, with the key shapes the interpreter uses: identifier
+// strings (Environment) and small integers (Dict).
+//
+// g++ -std=c++11 -O2 bench/hashmap_bench.cpp -o hashmap_bench
+// ./hashmap_bench [keys] [lookups]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../hashmap.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double millis(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+template <class K>
+std::vector<K> makeKeys(size_t n);
+
+template <>
+std::vector<std::string> makeKeys<std::string>(size_t n) {
+	std::vector<std::string> keys;
+	for (size_t i = 0; i < n; i++) {
+		keys.push_back("var_" + std::to_string(i * 2654435761u % 1000003));
+	}
+	return keys;
+}
+
+template <>
+std::vector<int> makeKeys<int>(size_t n) {
+	std::vector<int> keys;
+	for (size_t i = 0; i < n; i++) {
+		keys.push_back((int)(i * 7));
+	}
+	return keys;
+}
+
+// std::map and std::unordered_map share this shape
+template <class Map, class K>
+void benchStd(const char* name, const std::vector<K>& keys, size_t lookups) {
+	Clock::time_point start = Clock::now();
+	Map m;
+	for (size_t i = 0; i < keys.size(); i++) {
+		m[keys[i]] = (int)i;
+	}
+	double insert = millis(start);
+
+	start = Clock::now();
+	long sum = 0;
+	for (size_t i = 0; i < lookups; i++) {
+		auto it = m.find(keys[i % keys.size()]);
+		if (it != m.end()) {
+			sum += it->second;
+		}
+	}
+	double lookup = millis(start);
+	std::printf("  %-20s insert %9.2f ms   lookup %9.2f ms   (%ld)\n", name, insert, lookup, sum);
+}
+
+template <class K>
+void benchHashMap(const std::vector<K>& keys, size_t lookups) {
+	Clock::time_point start = Clock::now();
+	HashMap<K, int> m;
+	for (size_t i = 0; i < keys.size(); i++) {
+		m.set(keys[i], (int)i);
+	}
+	double insert = millis(start);
+
+	start = Clock::now();
+	long sum = 0;
+	for (size_t i = 0; i < lookups; i++) {
+		int* v = m.find(keys[i % keys.size()]);
+		if (v != nullptr) {
+			sum += *v;
+		}
+	}
+	double lookup = millis(start);
+	std::printf("  %-20s insert %9.2f ms   lookup %9.2f ms   (%ld)\n", "HashMap", insert, lookup, sum);
+}
+
+template <class K>
+void benchAll(const char* title, size_t n, size_t lookups) {
+	std::vector<K> keys = makeKeys<K>(n);
+	std::printf("%s: %zu keys, %zu lookups\n", title, n, lookups);
+	benchStd<std::map<K, int>>("std::map", keys, lookups);
+	benchStd<std::unordered_map<K, int>>("std::unordered_map", keys, lookups);
+	benchHashMap(keys, lookups);
+}
+
+int main(int argc, char* argv[]) {
+	size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+	size_t lookups = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000000;
+
+	benchAll<std::string>("string keys", n, lookups);
+	benchAll<int>("int keys", n, lookups);
+	// typical global namespace size
+	benchAll<std::string>("string keys (small)", 32, lookups);
+	return 0;
+}
@@ -0,0 +1,20 @@
+# Mutual recursion, as in the README's extra-credit test.
+# time ./mypython --jit bench/mutual.py; time ./mypython --no-jit bench/mutual.py
+
+def is_even(n):
+    if n == 0:
+        return True
+    else:
+        return is_odd(n - 1)
+
+def is_odd(n):
+    if n == 0:
+        return False
+    else:
+        return is_even(n - 1)
+
+count = 0
+for i in range(3000):
+    if is_even(i + 1000):
+        count = count + 1
+print(count, is_odd(7), is_even(7))
@@ -0,0 +1,12 @@
+# A pure function mapped over a list with parallel_map: compare -j 1 (serial)
+# with one thread per core.
+# time ./mypython --no-jit -j 1 bench/parallel.py
+# time ./mypython --no-jit bench/parallel.py
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+results = parallel_map(fib, [22, 22, 22, 22, 22, 22, 22, 22, 21, 21, 21, 21, 20, 20, 20, 20])
+print(sum(results))
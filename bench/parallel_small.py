@@ -0,0 +1,13 @@
+# The cost of handing a map to the workers: many maps of two items that take
+# almost no time. parallel_map runs maps this small serially (MIN_PARALLEL_NS
+# in parallel.h); with MIN_PARALLEL_NS set to 0 they go to the workers, and
+# the difference from -j 1 is that cost, about 8 us a map.
+# time ./mypython -j 1 bench/parallel_small.py
+# time ./mypython -j 2 bench/parallel_small.py
+
+def inc(x):
+    return x + 1
+
+for i in range(20000):
+    results = parallel_map(inc, [1, 2])
+print(results)
@@ -0,0 +1,16 @@
+# Type-stable integer loop inside a function that is called many times:
+# the case per-signature specialization targets.
+# time ./mypython --no-jit bench/typed.py; time ./mypython --no-jit --no-specialize bench/typed.py
+
+def work(n, k):
+    s = 0
+    for i in range(n):
+        s = s + i * k - 1
+        if s > 1000000:
+            s = s - 1000000
+    return s
+
+total = 0
+for j in range(2000):
+    total = work(500, j)
+print(total)
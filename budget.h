@@ -0,0 +1,204 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <pthread.h>
+
+#include "object.h"
+
+// Execution budgets (--max-steps, --max-ms, --max-memory, --max-depth).
+//
+// A step is a function call, one iteration of a for loop, including a
+// generator resuming, or one item of work done by a builtin: an item range
+// makes or sum, min and max look at. Each step only decrements fuel. When
+// the fuel runs out, every CHECK_INTERVAL steps or sooner if the step limit
+// is closer, tick() adds the batch to the count and checks the step count
+// and the wall clock. The memory limit is checked on every allocation of
+// an Object: the budget running on the thread sets object_limit (object.h)
+// and Object::allocate fails before going over it. Without limits the fuel
+// never runs out.
+//
+// Every call, and every resume of a generator, checks how deeply calls are
+// nested: against max_depth if it is set, and always against the room left
+// on the thread's stack. start() works out from the thread's stack size
+// the lowest address calls may reach (stack_limit), which leaves
+// STACK_RESERVE for what runs between two checks and for the error; JIT
+// code checks it too. Running out of stack is thus an error like the other
+// limits instead of a crash.
+//
+// A limit that is hit throws BudgetExceeded, which unwinds like any other
+// error; exceeded records which limit it was for the exit code.
+
+enum BudgetLimit {
+    LIMIT_NONE, LIMIT_STEPS, LIMIT_TIME, LIMIT_MEMORY, LIMIT_DEPTH,
+};
+
+// The lowest stack address a call may start at on this thread; 0 before a
+// budget has started on it.
+inline thread_local uintptr_t stack_limit = 0;
+
+class BudgetExceeded : public std::runtime_error {
+public:
+    explicit BudgetExceeded(const std::string& message) : std::runtime_error(message) {}
+};
+
+class Budget {
+public:
+    static const int64_t CHECK_INTERVAL = 4096;
+    static const size_t STACK_RESERVE = 256 * 1024;
+
+    // 0 is no limit
+    uint64_t max_steps = 0;
+    uint64_t max_ms = 0;
+    uint64_t max_memory = 0;
+    // calls nested in each other; the stack is always a limit
+    uint64_t max_depth = 0;
+
+    BudgetLimit exceeded = LIMIT_NONE;
+
+    Budget() {}
+    Budget(const Budget&) = delete;
+    Budget& operator=(const Budget&) = delete;
+
+    ~Budget() {
+        if (active == this) {
+            active = nullptr;
+            object_limit = SIZE_MAX;
+            object_over_limit = nullptr;
+            stack_limit = 0;
+        }
+    }
+
+    bool limited() const {
+        return max_steps != 0 || max_ms != 0 || max_memory != 0 || max_depth != 0;
+    }
+
+    // Starts counting against the limits from now, on this thread.
+    void start() {
+        steps = 0;
+        exceeded = LIMIT_NONE;
+        started = std::chrono::steady_clock::now();
+        active = this;
+        object_limit = max_memory != 0 ? object_bytes + max_memory : SIZE_MAX;
+        object_over_limit = overMemory;
+        stack_limit = stackFloor();
+        refuel();
+    }
+
+    // Checks that a call may be made with depth calls already running.
+    void enter(int depth) {
+        char here;
+        if (max_depth != 0 && (uint64_t)depth >= max_depth) {
+            fail(LIMIT_DEPTH, "call depth limit of " + std::to_string(max_depth) + " exceeded");
+        }
+        if ((uintptr_t)&here < stack_limit) {
+            outOfStack();
+        }
+    }
+
+    // The stack has no room for another call.
+    [[noreturn]] void outOfStack() {
+        fail(LIMIT_DEPTH, "call depth limit exceeded: out of stack");
+    }
+
+    // A step of work inside a builtin, charged to the budget running on
+    // this thread, if any.
+    static void work() {
+        if (active != nullptr) {
+            active->step();
+        }
+    }
+
+    void step() {
+        if (--fuel < 0) {
+            tick();
+        }
+    }
+
+    // 3, 4, 5 and 6 for the step, time, memory and depth limits, otherwise
+    // 1
+    int exitCode() const {
+        switch (exceeded) {
+        case LIMIT_STEPS: return 3;
+        case LIMIT_TIME: return 4;
+        case LIMIT_MEMORY: return 5;
+        case LIMIT_DEPTH: return 6;
+        default: return 1;
+        }
+    }
+
+private:
+    // steps left in the current batch
+    int64_t fuel = INT64_MAX;
+    // size of the current batch
+    int64_t granted = 0;
+    uint64_t steps = 0;
+    std::chrono::steady_clock::time_point started;
+    // the message of the limit exceeded
+    std::string failure;
+
+    // the budget started last on this thread
+    static inline thread_local Budget* active = nullptr;
+
+    static void overMemory() {
+        active->fail(LIMIT_MEMORY, "memory limit of " + std::to_string(active->max_memory) + " bytes exceeded");
+    }
+
+    // where calls must stop on this thread's stack; 0 if it is not known
+    static uintptr_t stackFloor() {
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+            return 0;
+        }
+        void* low = nullptr;
+        size_t size = 0;
+        pthread_attr_getstack(&attr, &low, &size);
+        pthread_attr_destroy(&attr);
+        return size > 2 * STACK_RESERVE ? (uintptr_t)low + STACK_RESERVE : 0;
+    }
+
+    void tick() {
+        if (exceeded != LIMIT_NONE) {
+            fail(exceeded, failure);
+        }
+        // the batch, and the step that overran it
+        steps += granted - fuel;
+        if (max_steps != 0 && steps > max_steps) {
+            fail(LIMIT_STEPS, "step limit of " + std::to_string(max_steps) + " exceeded");
+        }
+        if (max_ms != 0) {
+            auto elapsed = std::chrono::steady_clock::now() - started;
+            if ((uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() >= max_ms) {
+                fail(LIMIT_TIME, "time limit of " + std::to_string(max_ms) + " ms exceeded");
+            }
+        }
+        refuel();
+    }
+
+    void refuel() {
+        if (!limited()) {
+            granted = 0;
+            fuel = INT64_MAX;
+            return;
+        }
+        granted = CHECK_INTERVAL;
+        if (max_steps != 0 && max_steps - steps < (uint64_t)granted) {
+            granted = (int64_t)(max_steps - steps);
+        }
+        fuel = granted;
+    }
+
+    [[noreturn]] void fail(BudgetLimit limit, const std::string& message) {
+        exceeded = limit;
+        failure = message;
+        // stays spent, so nothing still unwinding runs on, but the error
+        // may still need objects
+        fuel = -1;
+        granted = 0;
+        object_limit = SIZE_MAX;
+        throw BudgetExceeded(message);
+    }
+};
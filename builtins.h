@@ -0,0 +1,290 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+#include "hashmap.h"
+#include "object.h"
+#include "number.h"
+#include "budget.h"
+
+// Argument storage for a call. Up to INLINE arguments live in the caller's
+// C++ stack frame, so ordinary calls evaluate their arguments without
+// touching the heap; longer argument lists fall back to a heap array. Calls
+// to user functions size it for the callee's whole frame, which then runs
+// in place.
+class ArgBuffer {
+public:
+    explicit ArgBuffer(size_t count) {
+        this->count = count;
+        data = count <= INLINE ? inline_args : new Object*[count];
+    }
+
+    ArgBuffer(const ArgBuffer&) = delete;
+    ArgBuffer& operator=(const ArgBuffer&) = delete;
+
+    ~ArgBuffer() {
+        if (data != inline_args) {
+            delete[] data;
+        }
+    }
+
+    Object*& operator[](size_t i) {
+        return data[i];
+    }
+
+    Object** get() {
+        return data;
+    }
+
+    size_t size() {
+        return count;
+    }
+
+private:
+    static const size_t INLINE = 16;
+    Object* inline_args[INLINE];
+    Object** data;
+    size_t count;
+};
+
+typedef Object* (*NativeFn1)(Object*);
+typedef Object* (*NativeFn2)(Object*, Object*);
+typedef Object* (*NativeFnN)(Object**, size_t);
+
+class Interpreter;
+typedef Object* (*InterpreterFn)(Interpreter&, Object**, size_t);
+
+// builtins that run user code, defined with the interpreter (parallel.h)
+inline Object* parallelMap(Interpreter& in, Object** args, size_t argc);
+
+// A function implemented in C++. callN accepts any argument count within
+// [min_args, max_args]; call1 and call2, when set, are fixed-arity entry
+// points the interpreter uses directly so one- and two-argument calls skip
+// the argument buffer altogether. callI, when set, replaces callN for
+// builtins that need the calling interpreter.
+struct Builtin {
+    std::string name;
+    size_t min_args;
+    size_t max_args;
+    NativeFnN callN;
+    NativeFn1 call1;
+    NativeFn2 call2;
+    InterpreterFn callI;
+};
+
+class Builtins {
+public:
+    static Builtin* find(const std::string& name) {
+        // built on first use, read-only afterwards
+        static Builtins registry;
+        return registry.table.find(name);
+    }
+
+private:
+    HashMap<std::string, Builtin> table;
+
+    Builtins() {
+        add("len", 1, 1, nullptr, len, nullptr);
+        add("abs", 1, 1, nullptr, abs, nullptr);
+        add("int", 1, 1, nullptr, toInt, nullptr);
+        add("float", 1, 1, nullptr, toFloat, nullptr);
+        add("str", 1, 1, nullptr, toStr, nullptr);
+        add("min", 1, SIZE_MAX, min, nullptr, nullptr);
+        add("max", 1, SIZE_MAX, max, nullptr, nullptr);
+        add("sum", 1, 1, nullptr, sum, nullptr);
+        add("range", 1, 3, range, nullptr, nullptr);
+        add("parallel_map", 2, 2, nullptr, nullptr, nullptr, parallelMap);
+    }
+
+    void add(std::string name, size_t min_args, size_t max_args, NativeFnN callN, NativeFn1 call1, NativeFn2 call2,
+             InterpreterFn callI = nullptr) {
+        table.set(name, Builtin{ name, min_args, max_args, callN, call1, call2, callI });
+    }
+
+    static int intValue(Object* obj, const char* func) {
+        if (Integer* i = dynamic_cast<Integer*>(obj)) {
+            return i->value;
+        }
+        if (Boolean* b = dynamic_cast<Boolean*>(obj)) {
+            return b->value;
+        }
+        throw std::runtime_error(std::string(func) + "() argument must be an integer");
+    }
+
+    // an int, float or bool, as a Number
+    static Number numberValue(Object* obj, const char* func) {
+        Number n;
+        if (unbox(obj, n)) {
+            return n;
+        }
+        return Number::ofInt(intValue(obj, func));
+    }
+
+    static std::vector<Object*> iterate(Object* obj, const char* func) {
+        if (List* list = dynamic_cast<List*>(obj)) {
+            return list->items;
+        }
+        if (Dict* dict = dynamic_cast<Dict*>(obj)) {
+            std::vector<Object*> keys;
+            for (auto& e : dict->items) {
+                keys.push_back(e.key);
+            }
+            return keys;
+        }
+        if (Generator* generator = dynamic_cast<Generator*>(obj)) {
+            std::vector<Object*> values;
+            while (Object* value = generator->next()) {
+                values.push_back(value);
+            }
+            return values;
+        }
+        throw std::runtime_error(std::string(func) + "() argument is not iterable");
+    }
+
+    static bool lessThan(Object* lhs, Object* rhs) {
+        String* lhs_str = dynamic_cast<String*>(lhs);
+        String* rhs_str = dynamic_cast<String*>(rhs);
+        if (lhs_str != nullptr && rhs_str != nullptr) {
+            return lhs_str->value < rhs_str->value;
+        }
+        return compare(LESS_THAN, numberValue(lhs, "comparison"), numberValue(rhs, "comparison"));
+    }
+
+    static Object* len(Object* obj) {
+        if (String* s = dynamic_cast<String*>(obj)) {
+            return new Integer((int)s->value.size());
+        }
+        if (List* list = dynamic_cast<List*>(obj)) {
+            return new Integer((int)list->items.size());
+        }
+        if (Dict* dict = dynamic_cast<Dict*>(obj)) {
+            return new Integer((int)dict->items.size());
+        }
+        throw std::runtime_error("object has no len()");
+    }
+
+    static Object* abs(Object* obj) {
+        if (Float* f = dynamic_cast<Float*>(obj)) {
+            return new Float(std::fabs(f->value));
+        }
+        int value = intValue(obj, "abs");
+        return new Integer(value < 0 ? -value : value);
+    }
+
+    static Object* toInt(Object* obj) {
+        if (String* s = dynamic_cast<String*>(obj)) {
+            try {
+                size_t used = 0;
+                int value = std::stoi(s->value, &used);
+                if (used == s->value.size()) {
+                    return new Integer(value);
+                }
+            }
+            catch (std::exception&) {}
+            throw std::runtime_error("invalid literal for int(): " + s->repr());
+        }
+        if (Float* f = dynamic_cast<Float*>(obj)) {
+            // rounds towards zero
+            double value = std::trunc(f->value);
+            if (std::isnan(value)) {
+                throw std::runtime_error("ValueError: cannot convert float NaN to integer");
+            }
+            if (value < INT_MIN || value > INT_MAX) {
+                throw std::runtime_error("OverflowError: float too large for int");
+            }
+            return new Integer((int)value);
+        }
+        return new Integer(intValue(obj, "int"));
+    }
+
+    static Object* toFloat(Object* obj) {
+        if (String* s = dynamic_cast<String*>(obj)) {
+            // strtod also takes inf and nan, as Python does
+            const char* text = s->value.c_str();
+            char* end = nullptr;
+            double value = std::strtod(text, &end);
+            if (s->value.empty() || end != text + s->value.size()) {
+                throw std::runtime_error("could not convert string to float: " + s->repr());
+            }
+            return new Float(value);
+        }
+        return new Float(numberValue(obj, "float").real());
+    }
+
+    static Object* toStr(Object* obj) {
+        return new String(obj->toString());
+    }
+
+    static Object* extreme(Object** args, size_t argc, bool want_max, const char* func) {
+        std::vector<Object*> items;
+        if (argc == 1) {
+            items = iterate(args[0], func);
+        }
+        else {
+            items.assign(args, args + argc);
+        }
+        if (items.empty()) {
+            throw std::runtime_error(std::string(func) + "() arg is an empty sequence");
+        }
+        Object* best = items[0];
+        for (size_t i = 1; i < items.size(); i++) {
+            Budget::work();
+            if (want_max ? lessThan(best, items[i]) : lessThan(items[i], best)) {
+                best = items[i];
+            }
+        }
+        return best;
+    }
+
+    static Object* min(Object** args, size_t argc) {
+        return extreme(args, argc, false, "min");
+    }
+
+    static Object* max(Object** args, size_t argc) {
+        return extreme(args, argc, true, "max");
+    }
+
+    static Object* sum(Object* obj) {
+        Number total = Number::ofInt(0);
+        for (Object* item : iterate(obj, "sum")) {
+            Budget::work();
+            total = arithmetic(PLUS, total, numberValue(item, "sum"));
+        }
+        return box(total);
+    }
+
+    static Object* range(Object** args, size_t argc) {
+        int start = 0;
+        int stop = 0;
+        int step = 1;
+        if (argc == 1) {
+            stop = intValue(args[0], "range");
+        }
+        else {
+            start = intValue(args[0], "range");
+            stop = intValue(args[1], "range");
+        }
+        if (argc == 3) {
+            step = intValue(args[2], "range");
+        }
+        if (step == 0) {
+            throw std::runtime_error("range() arg 3 must not be zero");
+        }
+
+        // counted in 64 bits: stepping an int past stop could overflow
+        int64_t span = step > 0 ? (int64_t)stop - start : (int64_t)start - stop;
+        int64_t stride = step > 0 ? step : -(int64_t)step;
+        int64_t count = span > 0 ? (span + stride - 1) / stride : 0;
+        List* list = new List();
+        for (int64_t k = 0; k < count; k++) {
+            Budget::work();
+            list->items.push_back(new Integer((int)(start + k * step)));
+        }
+        return list;
+    }
+};
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <vector>
+
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+
+// Deep copy of an AST, for code that keeps state on the nodes while it
+// runs: the specializer annotates a copy of a function body without
+// affecting the generic one, every interpreter runs its own copy of a
+// cached module (module.h), and parallel_map workers run their own copies
+// of the functions they call (parallel.h).
+//
+// Nested defs are only copied when functions is set; otherwise they are
+// shared and failed is set. A copied def keeps the Resolver's frame layout
+// but starts with no profiling, JIT or compiled state of its own.
+class AstCloner : Visitor<void> {
+public:
+    bool failed = false;
+
+    explicit AstCloner(bool functions = false) {
+        this->functions = functions;
+    }
+
+    std::vector<Statement*> clone(const std::vector<Statement*>& stmts) {
+        std::vector<Statement*> copies;
+        copies.reserve(stmts.size());
+        for (Statement* s : stmts) {
+            copies.push_back(clone(s));
+        }
+        return copies;
+    }
+
+    Statement* clone(Statement* stmt) {
+        if (stmt == nullptr) {
+            return nullptr;
+        }
+        stmt->accept(this);
+        return stmt_copy;
+    }
+
+    Expr* clone(Expr* expr) {
+        if (expr == nullptr) {
+            return nullptr;
+        }
+        expr->accept(this);
+        return expr_copy;
+    }
+
+private:
+    bool functions;
+    Statement* stmt_copy = nullptr;
+    Expr* expr_copy = nullptr;
+
+    std::vector<Expr*> clone(const std::vector<Expr*>& exprs) {
+        std::vector<Expr*> copies;
+        for (Expr* e : exprs) {
+            copies.push_back(clone(e));
+        }
+        return copies;
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        Var* copy = new Var(*stmt);
+        copy->initial = clone(stmt->initial);
+        stmt_copy = copy;
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        Block* copy = new Block(*stmt);
+        copy->statements = clone(stmt->statements);
+        stmt_copy = copy;
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        Expression* copy = new Expression(*stmt);
+        copy->expr = clone(stmt->expr);
+        stmt_copy = copy;
+    };
+
+    void visitForStmt(For* stmt) override {
+        For* copy = new For(*stmt);
+        copy->iterable = clone(stmt->iterable);
+        copy->body = clone(stmt->body);
+        stmt_copy = copy;
+    };
+
+    void visitFunctionStmt(Function* stmt) override {
+        if (!functions) {
+            failed = true;
+            stmt_copy = stmt;
+            return;
+        }
+        // the frame layout, but none of the original's run-time state
+        Function* copy = new Function(stmt->name, stmt->params, clone(stmt->body));
+        copy->num_slots = stmt->num_slots;
+        copy->free_base = stmt->free_base;
+        copy->cells = stmt->cells;
+        copy->captures = stmt->captures;
+        copy->binding = stmt->binding;
+        copy->generator = stmt->generator;
+        copy->yields = stmt->yields;
+        copy->line = stmt->line;
+        stmt_copy = copy;
+    };
+
+    void visitGlobalStmt(Global* stmt) override {
+        stmt_copy = stmt;
+    };
+
+    void visitIfStmt(If* stmt) override {
+        If* copy = new If(*stmt);
+        copy->condition = clone(stmt->condition);
+        copy->thenBranch = clone(stmt->thenBranch);
+        copy->elseBranch = clone(stmt->elseBranch);
+        stmt_copy = copy;
+    };
+
+    void visitImportStmt(Import* stmt) override {
+        stmt_copy = stmt;
+    };
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {
+        stmt_copy = stmt;
+    };
+
+    void visitPrintStatement(Print* stmt) override {
+        Print* copy = new Print(*stmt);
+        copy->exprs = clone(stmt->exprs);
+        stmt_copy = copy;
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        Return* copy = new Return(*stmt);
+        copy->value = clone(stmt->value);
+        stmt_copy = copy;
+    };
+
+    void visitYieldStmt(Yield* stmt) override {
+        Yield* copy = new Yield(*stmt);
+        copy->value = clone(stmt->value);
+        stmt_copy = copy;
+    };
+
+    void visitAssignExpr(Assign* expr) override {
+        expr_copy = expr;
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        Binary* copy = new Binary(*expr);
+        copy->left = clone(expr->left);
+        copy->right = clone(expr->right);
+        expr_copy = copy;
+    };
+
+    void visitCallExpr(Call* expr) override {
+        Call* copy = new Call(*expr);
+        copy->object = clone(expr->object);
+        copy->args = clone(expr->args);
+        expr_copy = copy;
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        Conditional* copy = new Conditional(*expr);
+        copy->condition = clone(expr->condition);
+        copy->thenBranch = clone(expr->thenBranch);
+        copy->elseBranch = clone(expr->elseBranch);
+        expr_copy = copy;
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        DictLiteral* copy = new DictLiteral(*expr);
+        copy->keys = clone(expr->keys);
+        copy->values = clone(expr->values);
+        expr_copy = copy;
+    };
+
+    void visitGetExpr(Get* expr) override {
+        Get* copy = new Get(*expr);
+        copy->object = clone(expr->object);
+        expr_copy = copy;
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        Grouping* copy = new Grouping(*expr);
+        copy->expression = clone(expr->expression);
+        expr_copy = copy;
+    };
+
+    void visitInlineExpr(Inline* expr) override {
+        Inline* copy = new Inline(*expr);
+        copy->call = static_cast<Call*>(clone(expr->call));
+        copy->body = clone(expr->body);
+        expr_copy = copy;
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        ListLiteral* copy = new ListLiteral(*expr);
+        copy->items = clone(expr->items);
+        expr_copy = copy;
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        expr_copy = new Literal(*expr);
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        Logical* copy = new Logical(*expr);
+        copy->left = clone(expr->left);
+        copy->right = clone(expr->right);
+        expr_copy = copy;
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        SetItem* copy = new SetItem(*expr);
+        copy->object = clone(expr->object);
+        copy->index = clone(expr->index);
+        copy->value = clone(expr->value);
+        expr_copy = copy;
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        Subscript* copy = new Subscript(*expr);
+        copy->object = clone(expr->object);
+        copy->index = clone(expr->index);
+        expr_copy = copy;
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        Unary* copy = new Unary(*expr);
+        copy->right = clone(expr->right);
+        expr_copy = copy;
+    };
+
+    void visitVariableExpr(Variable* expr) override {
+        expr_copy = expr;
+    };
+};
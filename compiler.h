@@ -0,0 +1,897 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+#include "object.h"
+#include "builtins.h"
+#include "return.h"
+#include "interpreter.h"
+
+// Closure-compilation engine (--engine=closure).
+//
+// Instead of walking the AST, each statement and expression is compiled once
+// into a tree of small structs holding a pointer to the C++ function that
+// evaluates them, with their children and constants bound in. Evaluating a
+// node is one indirect call; the operator, and for binary operators the
+// shape of the operands (local, int constant or anything else), is chosen
+// when the node is compiled, not on every evaluation. Constants are built
+// once. Arithmetic nested in arithmetic or a comparison passes its value up
+// unboxed. Statements return the value of an executed return, or null to carry
+// on, so returns need no exception.
+//
+// Function bodies are compiled on their first call and kept on the
+// Function. Defs, imports and global/nonlocal declarations are handed to
+// the tree walker. Type specialization (specialize.h) only applies to the
+// tree walker; the JIT applies to both engines.
+
+struct ExprCode;
+struct StmtCode;
+
+typedef Object* (*EvalFn)(ExprCode*, Interpreter&);
+typedef Object* (*ExecFn)(StmtCode*, Interpreter&);
+typedef Number (*NumberFn)(ExprCode*, Interpreter&);
+
+struct ExprCode {
+    EvalFn eval;
+    // arithmetic only: the value unboxed, for the operator it is an operand
+    // of (number.h)
+    NumberFn number = nullptr;
+};
+
+// exec returns the value of a return statement it ran, otherwise null
+struct StmtCode {
+    ExecFn exec;
+    // what was compiled, for the hooks (hooks.h)
+    Statement* stmt = nullptr;
+};
+
+inline Object* evaluate(ExprCode* code, Interpreter& in) {
+    return code->eval(code, in);
+}
+
+inline Object* execute(StmtCode* code, Interpreter& in) {
+    return code->exec(code, in);
+}
+
+class ClosureCompiler : Visitor<void> {
+public:
+    StmtCode* compile(Statement* stmt) {
+        stmt->accept(this);
+        stmt_code->stmt = stmt;
+        return stmt_code;
+    }
+
+    ExprCode* compile(Expr* expr) {
+        expr->accept(this);
+        return expr_code;
+    }
+
+    StmtCode* compile(const std::vector<Statement*>& stmts) {
+        BlockCode* code = new BlockCode();
+        code->exec = block;
+        for (Statement* s : stmts) {
+            code->stmts.push_back(compile(s));
+        }
+        return code;
+    }
+
+private:
+    StmtCode* stmt_code = nullptr;
+    ExprCode* expr_code = nullptr;
+
+    // Operand shapes of a binary operator.
+    struct AnyOperand {
+        ExprCode* code;
+
+        // false if the value is not a number; obj is set unless the value
+        // was computed unboxed
+        bool number(Interpreter& in, Number& n, Object*& obj) {
+            if (code->number != nullptr) {
+                n = code->number(code, in);
+                return true;
+            }
+            obj = evaluate(code, in);
+            return unbox(obj, n);
+        }
+    };
+
+    struct LocalOperand {
+        int slot;
+        const std::string* name;
+
+        Object* get(Interpreter& in) {
+            Object* value = in.frame[slot];
+            if (value == nullptr) {
+                unassigned(*name);
+            }
+            return value;
+        }
+
+        bool number(Interpreter& in, Number& n, Object*& obj) {
+            obj = get(in);
+            return unbox(obj, n);
+        }
+    };
+
+    struct IntOperand {
+        Integer* value;
+
+        bool number(Interpreter& in, Number& n, Object*& obj) {
+            obj = value;
+            n = Number::ofInt(value->value);
+            return true;
+        }
+    };
+
+    struct ConstCode : ExprCode {
+        Object* value;
+    };
+
+    struct LocalCode : ExprCode {
+        int slot;
+        const std::string* name;
+    };
+
+    struct LoadCode : ExprCode {
+        const VarRef* ref;
+        const std::string* name;
+    };
+
+    template <class L, class R>
+    struct BinaryCode : ExprCode {
+        L lhs;
+        R rhs;
+    };
+
+    struct UnaryCode : ExprCode {
+        ExprCode* operand;
+    };
+
+    struct LogicalCode : ExprCode {
+        ExprCode* left;
+        ExprCode* right;
+    };
+
+    struct ConditionalCode : ExprCode {
+        ExprCode* condition;
+        ExprCode* then_value;
+        ExprCode* else_value;
+    };
+
+    struct CallCode : ExprCode {
+        Call* expr;
+        ExprCode* object;
+        std::vector<ExprCode*> args;
+    };
+
+    struct InlineCode : ExprCode {
+        Inline* expr;
+        CallCode* call;
+        ExprCode* body;
+    };
+
+    struct ListCode : ExprCode {
+        std::vector<ExprCode*> items;
+    };
+
+    struct DictCode : ExprCode {
+        std::vector<ExprCode*> keys;
+        std::vector<ExprCode*> values;
+    };
+
+    struct GetCode : ExprCode {
+        ExprCode* object;
+        const std::string* name;
+    };
+
+    struct SubscriptCode : ExprCode {
+        ExprCode* object;
+        ExprCode* index;
+    };
+
+    struct SetItemCode : ExprCode {
+        ExprCode* object;
+        ExprCode* index;
+        ExprCode* value;
+    };
+
+    struct WalkExprCode : ExprCode {
+        Expr* expr;
+    };
+
+    struct BlockCode : StmtCode {
+        std::vector<StmtCode*> stmts;
+    };
+
+    struct ExpressionCode : StmtCode {
+        ExprCode* expr;
+    };
+
+    struct StoreCode : StmtCode {
+        const VarRef* ref;
+        const std::string* name;
+        ExprCode* value;
+    };
+
+    struct ForCode : StmtCode {
+        For* stmt;
+        ExprCode* iterable;
+        StmtCode* body;
+    };
+
+    struct IfCode : StmtCode {
+        ExprCode* condition;
+        StmtCode* then_branch;
+        StmtCode* else_branch;
+    };
+
+    struct PrintCode : StmtCode {
+        std::vector<ExprCode*> exprs;
+    };
+
+    struct ReturnCode : StmtCode {
+        ExprCode* value;
+    };
+
+    struct WalkStmtCode : StmtCode {
+        Statement* stmt;
+    };
+
+    [[noreturn]] static void fail() {
+        throw std::runtime_error("Error interpreter");
+    }
+
+    [[noreturn]] static void unassigned(const std::string& name) {
+        throw std::runtime_error("local variable '" + name + "' referenced before assignment");
+    }
+
+    // --- expressions ---
+
+    static Object* constant(ExprCode* code, Interpreter& in) {
+        return static_cast<ConstCode*>(code)->value;
+    }
+
+    static Object* local(ExprCode* code, Interpreter& in) {
+        LocalCode* c = static_cast<LocalCode*>(code);
+        Object* value = in.frame[c->slot];
+        if (value == nullptr) {
+            unassigned(*c->name);
+        }
+        return value;
+    }
+
+    static Object* load(ExprCode* code, Interpreter& in) {
+        LoadCode* c = static_cast<LoadCode*>(code);
+        return in.load(*c->ref, *c->name);
+    }
+
+    // Operands are evaluated left to right, as in the tree walker.
+    template <TokenType OP, class L, class R>
+    static Number arithmetic(ExprCode* code, Interpreter& in) {
+        BinaryCode<L, R>* c = static_cast<BinaryCode<L, R>*>(code);
+        Number lhs;
+        Number rhs;
+        Object* obj;
+        bool lhs_number = c->lhs.number(in, lhs, obj);
+        bool rhs_number = c->rhs.number(in, rhs, obj);
+        if (!lhs_number || !rhs_number) {
+            fail();
+        }
+        return ::arithmetic(OP, lhs, rhs);
+    }
+
+    template <TokenType OP, class L, class R>
+    static Object* boxed(ExprCode* code, Interpreter& in) {
+        return box(arithmetic<OP, L, R>(code, in));
+    }
+
+    template <TokenType OP, class L, class R>
+    static Object* comparison(ExprCode* code, Interpreter& in) {
+        BinaryCode<L, R>* c = static_cast<BinaryCode<L, R>*>(code);
+        Number lhs;
+        Number rhs;
+        Object* lhs_obj = nullptr;
+        Object* rhs_obj = nullptr;
+        bool lhs_number = c->lhs.number(in, lhs, lhs_obj);
+        bool rhs_number = c->rhs.number(in, rhs, rhs_obj);
+        if (lhs_number && rhs_number) {
+            return new Boolean(compare(OP, lhs, rhs));
+        }
+        if ((OP == EQUAL_TO || OP == NOT_EQUAL_TO) && lhs_obj != nullptr && rhs_obj != nullptr
+            && lhs_obj->type() == TYPE_BOOL && rhs_obj->type() == TYPE_BOOL) {
+            bool a = static_cast<Boolean*>(lhs_obj)->value;
+            bool b = static_cast<Boolean*>(rhs_obj)->value;
+            return new Boolean(OP == EQUAL_TO ? a == b : a != b);
+        }
+        fail();
+    }
+
+    template <class L, class R>
+    static EvalFn binaryFor(TokenType op) {
+        switch (op) {
+        case EQUAL_TO: return comparison<EQUAL_TO, L, R>;
+        case NOT_EQUAL_TO: return comparison<NOT_EQUAL_TO, L, R>;
+        case GREATER_THAN: return comparison<GREATER_THAN, L, R>;
+        case LESS_THAN: return comparison<LESS_THAN, L, R>;
+        case GREATER_THAN_EQUAL_TO: return comparison<GREATER_THAN_EQUAL_TO, L, R>;
+        case LESS_THAN_EQUAL_TO: return comparison<LESS_THAN_EQUAL_TO, L, R>;
+        case MINUS: return boxed<MINUS, L, R>;
+        case PLUS: return boxed<PLUS, L, R>;
+        case DIVIDE: return boxed<DIVIDE, L, R>;
+        case FLOOR_DIVIDE: return boxed<FLOOR_DIVIDE, L, R>;
+        case MULTIPLY: return boxed<MULTIPLY, L, R>;
+        default: return nullptr;
+        }
+    }
+
+    template <class L, class R>
+    static NumberFn numberFor(TokenType op) {
+        switch (op) {
+        case MINUS: return arithmetic<MINUS, L, R>;
+        case PLUS: return arithmetic<PLUS, L, R>;
+        case DIVIDE: return arithmetic<DIVIDE, L, R>;
+        case FLOOR_DIVIDE: return arithmetic<FLOOR_DIVIDE, L, R>;
+        case MULTIPLY: return arithmetic<MULTIPLY, L, R>;
+        default: return nullptr;
+        }
+    }
+
+    static Object* negate(ExprCode* code, Interpreter& in) {
+        Object* operand = evaluate(static_cast<UnaryCode*>(code)->operand, in);
+        if (operand->type() == TYPE_FLOAT) {
+            return new Float(-static_cast<Float*>(operand)->value);
+        }
+        if (operand->type() != TYPE_INT) {
+            fail();
+        }
+        return new Integer(-static_cast<Integer*>(operand)->value);
+    }
+
+    static Object* logicalNot(ExprCode* code, Interpreter& in) {
+        Object* operand = evaluate(static_cast<UnaryCode*>(code)->operand, in);
+        return new Boolean(!operand->truthy());
+    }
+
+    // The operand that decides; the right one only if the left one does
+    // not, as in the tree walker.
+    template <TokenType OP>
+    static Object* logical(ExprCode* code, Interpreter& in) {
+        LogicalCode* c = static_cast<LogicalCode*>(code);
+        Object* lhs = evaluate(c->left, in);
+        if (lhs->truthy() == (OP == OR)) {
+            return lhs;
+        }
+        return evaluate(c->right, in);
+    }
+
+    static Object* conditional(ExprCode* code, Interpreter& in) {
+        ConditionalCode* c = static_cast<ConditionalCode*>(code);
+        if (evaluate(c->condition, in)->truthy()) {
+            return evaluate(c->then_value, in);
+        }
+        return evaluate(c->else_value, in);
+    }
+
+    static Object* call(ExprCode* code, Interpreter& in) {
+        CallCode* c = static_cast<CallCode*>(code);
+        Builtin* builtin = nullptr;
+        Object* object = c->object != nullptr ? evaluate(c->object, in) : nullptr;
+        Closure* closure = in.callee(c->expr, object, builtin);
+        size_t argc = c->args.size();
+        if (builtin != nullptr) {
+            return callBuiltin(builtin, c, in);
+        }
+        ArgBuffer slots(closure->function->num_slots);
+        for (size_t i = 0; i < argc; i++) {
+            slots[i] = evaluate(c->args[i], in);
+        }
+        return in.run_function(closure, slots.get());
+    }
+
+    static Object* inlined(ExprCode* code, Interpreter& in) {
+        InlineCode* c = static_cast<InlineCode*>(code);
+        if (!in.runs_inline(c->expr)) {
+            return call(c->call, in);
+        }
+        const std::vector<ExprCode*>& args = c->call->args;
+        ArgBuffer slots(args.size());
+        for (size_t i = 0; i < args.size(); i++) {
+            slots[i] = evaluate(args[i], in);
+        }
+        in.budget.step();
+        Object** caller = in.frame;
+        in.frame = slots.get();
+        Object* result;
+        try {
+            result = evaluate(c->body, in);
+        }
+        catch (...) {
+            in.frame = caller;
+            throw;
+        }
+        in.frame = caller;
+        return result;
+    }
+
+    static Object* callBuiltin(Builtin* b, CallCode* c, Interpreter& in) {
+        size_t argc = c->args.size();
+        if (argc < b->min_args || argc > b->max_args) {
+            throw std::runtime_error(b->name + "() called with wrong number of arguments");
+        }
+        if (argc == 1 && b->call1 != nullptr) {
+            return b->call1(evaluate(c->args[0], in));
+        }
+        if (argc == 2 && b->call2 != nullptr) {
+            Object* lhs = evaluate(c->args[0], in);
+            return b->call2(lhs, evaluate(c->args[1], in));
+        }
+        ArgBuffer args(argc);
+        for (size_t i = 0; i < argc; i++) {
+            args[i] = evaluate(c->args[i], in);
+        }
+        if (b->callI != nullptr) {
+            return b->callI(in, args.get(), argc);
+        }
+        return b->callN(args.get(), argc);
+    }
+
+    static Object* list(ExprCode* code, Interpreter& in) {
+        ListCode* c = static_cast<ListCode*>(code);
+        List* list = new List();
+        list->items.reserve(c->items.size());
+        for (ExprCode* item : c->items) {
+            list->items.push_back(evaluate(item, in));
+        }
+        return list;
+    }
+
+    static Object* dict(ExprCode* code, Interpreter& in) {
+        DictCode* c = static_cast<DictCode*>(code);
+        Dict* dict = new Dict();
+        dict->items.reserve(c->keys.size());
+        for (size_t i = 0; i < c->keys.size(); i++) {
+            Object* key = evaluate(c->keys[i], in);
+            dict->setItem(key, evaluate(c->values[i], in));
+        }
+        return dict;
+    }
+
+    static Object* get(ExprCode* code, Interpreter& in) {
+        GetCode* c = static_cast<GetCode*>(code);
+        return in.attribute(evaluate(c->object, in), *c->name);
+    }
+
+    static Object* subscript(ExprCode* code, Interpreter& in) {
+        SubscriptCode* c = static_cast<SubscriptCode*>(code);
+        Object* object = evaluate(c->object, in);
+        return object->getItem(evaluate(c->index, in));
+    }
+
+    static Object* setItem(ExprCode* code, Interpreter& in) {
+        SetItemCode* c = static_cast<SetItemCode*>(code);
+        Object* object = evaluate(c->object, in);
+        Object* index = evaluate(c->index, in);
+        Object* value = evaluate(c->value, in);
+        object->setItem(index, value);
+        return value;
+    }
+
+    static Object* walkExpr(ExprCode* code, Interpreter& in) {
+        return in.evaluate(static_cast<WalkExprCode*>(code)->expr);
+    }
+
+    // --- statements ---
+
+    static Object* block(StmtCode* code, Interpreter& in) {
+        for (StmtCode* s : static_cast<BlockCode*>(code)->stmts) {
+            in.recorder.statement(s->stmt->line);
+            in.trace(s->stmt);
+            if (Object* returned = execute(s, in)) {
+                return returned;
+            }
+        }
+        return nullptr;
+    }
+
+    static Object* expression(StmtCode* code, Interpreter& in) {
+        evaluate(static_cast<ExpressionCode*>(code)->expr, in);
+        return nullptr;
+    }
+
+    static Object* storeLocal(StmtCode* code, Interpreter& in) {
+        StoreCode* c = static_cast<StoreCode*>(code);
+        in.frame[c->ref->slot] = evaluate(c->value, in);
+        return nullptr;
+    }
+
+    static Object* store(StmtCode* code, Interpreter& in) {
+        StoreCode* c = static_cast<StoreCode*>(code);
+        in.store(*c->ref, *c->name, evaluate(c->value, in));
+        return nullptr;
+    }
+
+    static Object* forLoop(StmtCode* code, Interpreter& in) {
+        ForCode* c = static_cast<ForCode*>(code);
+        For* stmt = c->stmt;
+        Object* iterable = evaluate(c->iterable, in);
+        if (List* list = dynamic_cast<List*>(iterable)) {
+            // re-read the size so appends made by the body are visited too
+            for (size_t i = 0; i < list->items.size(); i++) {
+                in.budget.step();
+                in.store(stmt->ref, stmt->name.value, list->items[i]);
+                if (Object* returned = execute(c->body, in)) {
+                    return returned;
+                }
+            }
+        }
+        else if (Dict* dict = dynamic_cast<Dict*>(iterable)) {
+            std::vector<Object*> keys;
+            keys.reserve(dict->items.size());
+            for (auto& e : dict->items) {
+                keys.push_back(e.key);
+            }
+            for (Object* key : keys) {
+                in.budget.step();
+                in.store(stmt->ref, stmt->name.value, key);
+                if (Object* returned = execute(c->body, in)) {
+                    return returned;
+                }
+            }
+        }
+        else if (Generator* generator = dynamic_cast<Generator*>(iterable)) {
+            while (Object* value = generator->next()) {
+                in.budget.step();
+                in.store(stmt->ref, stmt->name.value, value);
+                if (Object* returned = execute(c->body, in)) {
+                    return returned;
+                }
+            }
+        }
+        else {
+            fail();
+        }
+        return nullptr;
+    }
+
+    static Object* ifElse(StmtCode* code, Interpreter& in) {
+        IfCode* c = static_cast<IfCode*>(code);
+        if (evaluate(c->condition, in)->truthy()) {
+            return execute(c->then_branch, in);
+        }
+        if (c->else_branch != nullptr) {
+            return execute(c->else_branch, in);
+        }
+        return nullptr;
+    }
+
+    static Object* print(StmtCode* code, Interpreter& in) {
+        PrintCode* c = static_cast<PrintCode*>(code);
+        for (size_t i = 0; i < c->exprs.size(); i++) {
+            if (i != 0) {
+                in.out.write(' ');
+            }
+            evaluate(c->exprs[i], in)->write(in.out);
+        }
+        in.out.newline();
+        return nullptr;
+    }
+
+    static Object* returnValue(StmtCode* code, Interpreter& in) {
+        ReturnCode* c = static_cast<ReturnCode*>(code);
+        if (c->value == nullptr) {
+            return new None();
+        }
+        return evaluate(c->value, in);
+    }
+
+    // traced already, by the block it is in
+    static Object* walkStmt(StmtCode* code, Interpreter& in) {
+        static_cast<WalkStmtCode*>(code)->stmt->accept(&in);
+        return nullptr;
+    }
+
+    // --- compilation ---
+
+    template <class T>
+    static T* make(ExecFn exec) {
+        T* code = new T();
+        code->exec = exec;
+        return code;
+    }
+
+    template <class T>
+    static T* make(EvalFn eval) {
+        T* code = new T();
+        code->eval = eval;
+        return code;
+    }
+
+    std::vector<ExprCode*> compile(const std::vector<Expr*>& exprs) {
+        std::vector<ExprCode*> codes;
+        codes.reserve(exprs.size());
+        for (Expr* e : exprs) {
+            codes.push_back(compile(e));
+        }
+        return codes;
+    }
+
+    void walk(Statement* stmt) {
+        WalkStmtCode* code = make<WalkStmtCode>(walkStmt);
+        code->stmt = stmt;
+        stmt_code = code;
+    }
+
+    void walk(Expr* expr) {
+        WalkExprCode* code = make<WalkExprCode>(walkExpr);
+        code->expr = expr;
+        expr_code = code;
+    }
+
+    static Literal* localOperand(Expr* expr) {
+        Literal* l = dynamic_cast<Literal*>(expr);
+        return l != nullptr && l->token.type == IDENTIFIER && l->ref.kind == VAR_LOCAL ? l : nullptr;
+    }
+
+    static Literal* intOperand(Expr* expr) {
+        Literal* l = dynamic_cast<Literal*>(expr);
+        return l != nullptr && l->token.type == NUMBER ? l : nullptr;
+    }
+
+    template <class L, class R>
+    ExprCode* binaryCode(TokenType op, L lhs, R rhs) {
+        EvalFn eval = binaryFor<L, R>(op);
+        if (eval == nullptr) {
+            return nullptr;
+        }
+        BinaryCode<L, R>* code = make<BinaryCode<L, R>>(eval);
+        code->number = numberFor<L, R>(op);
+        code->lhs = lhs;
+        code->rhs = rhs;
+        return code;
+    }
+
+    template <class L>
+    ExprCode* binaryCode(TokenType op, L lhs, Expr* right) {
+        if (Literal* l = intOperand(right)) {
+            return binaryCode(op, lhs, IntOperand{ static_cast<Integer*>(l->number) });
+        }
+        if (Literal* l = localOperand(right)) {
+            return binaryCode(op, lhs, LocalOperand{ l->ref.slot, &l->token.value });
+        }
+        return binaryCode(op, lhs, AnyOperand{ compile(right) });
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        StoreCode* code = make<StoreCode>(stmt->ref.kind == VAR_LOCAL ? storeLocal : store);
+        code->ref = &stmt->ref;
+        code->name = &stmt->name.value;
+        code->value = compile(stmt->initial);
+        stmt_code = code;
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        stmt_code = compile(stmt->statements);
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        ExpressionCode* code = make<ExpressionCode>(expression);
+        code->expr = compile(stmt->expr);
+        stmt_code = code;
+    };
+
+    void visitForStmt(For* stmt) override {
+        ForCode* code = make<ForCode>(forLoop);
+        code->stmt = stmt;
+        code->iterable = compile(stmt->iterable);
+        code->body = compile(stmt->body);
+        stmt_code = code;
+    };
+
+    void visitFunctionStmt(Function* stmt) override {
+        walk(stmt);
+    };
+
+    void visitGlobalStmt(Global* stmt) override {
+        walk(stmt);
+    };
+
+    void visitIfStmt(If* stmt) override {
+        IfCode* code = make<IfCode>(ifElse);
+        code->condition = compile(stmt->condition);
+        code->then_branch = compile(stmt->thenBranch);
+        code->else_branch = stmt->elseBranch != nullptr ? compile(stmt->elseBranch) : nullptr;
+        stmt_code = code;
+    };
+
+    void visitImportStmt(Import* stmt) override {
+        walk(stmt);
+    };
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {
+        walk(stmt);
+    };
+
+    void visitPrintStatement(Print* stmt) override {
+        PrintCode* code = make<PrintCode>(print);
+        code->exprs = compile(stmt->exprs);
+        stmt_code = code;
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        ReturnCode* code = make<ReturnCode>(returnValue);
+        code->value = stmt->value != nullptr ? compile(stmt->value) : nullptr;
+        stmt_code = code;
+    };
+
+    // generator bodies are run by generator.h, never compiled
+    void visitYieldStmt(Yield* stmt) override {
+        walk(stmt);
+    };
+
+    void visitAssignExpr(Assign* expr) override {
+        walk(expr);
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        TokenType op = expr->op.type;
+        ExprCode* code;
+        if (Literal* l = localOperand(expr->left)) {
+            code = binaryCode(op, LocalOperand{ l->ref.slot, &l->token.value }, expr->right);
+        }
+        else {
+            code = binaryCode(op, AnyOperand{ compile(expr->left) }, expr->right);
+        }
+        if (code == nullptr) {
+            walk(expr);
+            return;
+        }
+        expr_code = code;
+    };
+
+    void visitCallExpr(Call* expr) override {
+        CallCode* code = make<CallCode>(call);
+        code->expr = expr;
+        code->object = expr->object != nullptr ? compile(expr->object) : nullptr;
+        code->args = compile(expr->args);
+        expr_code = code;
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        ConditionalCode* code = make<ConditionalCode>(conditional);
+        code->condition = compile(expr->condition);
+        code->then_value = compile(expr->thenBranch);
+        code->else_value = compile(expr->elseBranch);
+        expr_code = code;
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        DictCode* code = make<DictCode>(dict);
+        code->keys = compile(expr->keys);
+        code->values = compile(expr->values);
+        expr_code = code;
+    };
+
+    void visitGetExpr(Get* expr) override {
+        GetCode* code = make<GetCode>(get);
+        code->object = compile(expr->object);
+        code->name = &expr->name.value;
+        expr_code = code;
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        expr_code = compile(expr->expression);
+    };
+
+    void visitInlineExpr(Inline* expr) override {
+        InlineCode* code = make<InlineCode>(inlined);
+        code->expr = expr;
+        code->call = static_cast<CallCode*>(compile(expr->call));
+        code->body = compile(expr->body);
+        expr_code = code;
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        ListCode* code = make<ListCode>(list);
+        code->items = compile(expr->items);
+        expr_code = code;
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        Object* value;
+        switch (expr->token.type) {
+        case TRUE:
+            value = new Boolean(true);
+            break;
+        case FALSE:
+            value = new Boolean(false);
+            break;
+        case NONE:
+            value = new None();
+            break;
+        case NUMBER:
+        case FLOAT:
+            value = expr->number;
+            break;
+        case STRING:
+            value = new String(expr->token.value);
+            break;
+        case IDENTIFIER:
+            if (expr->ref.kind == VAR_LOCAL) {
+                LocalCode* code = make<LocalCode>(local);
+                code->slot = expr->ref.slot;
+                code->name = &expr->token.value;
+                expr_code = code;
+            }
+            else {
+                LoadCode* code = make<LoadCode>(load);
+                code->ref = &expr->ref;
+                code->name = &expr->token.value;
+                expr_code = code;
+            }
+            return;
+        default:
+            walk(expr);
+            return;
+        }
+        ConstCode* code = make<ConstCode>(constant);
+        code->value = value;
+        expr_code = code;
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        LogicalCode* code = make<LogicalCode>(expr->op.type == AND ? logical<AND> : logical<OR>);
+        code->left = compile(expr->left);
+        code->right = compile(expr->right);
+        expr_code = code;
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        SetItemCode* code = make<SetItemCode>(setItem);
+        code->object = compile(expr->object);
+        code->index = compile(expr->index);
+        code->value = compile(expr->value);
+        expr_code = code;
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        SubscriptCode* code = make<SubscriptCode>(subscript);
+        code->object = compile(expr->object);
+        code->index = compile(expr->index);
+        expr_code = code;
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        UnaryCode* code = make<UnaryCode>(expr->op.type == MINUS ? negate : logicalNot);
+        code->operand = compile(expr->right);
+        expr_code = code;
+    };
+
+    void visitVariableExpr(Variable* expr) override {
+        walk(expr);
+    };
+};
+
+inline void Interpreter::execute(const std::vector<Statement*>& stmts) {
+    ClosureCompiler compiler;
+    for (Statement* s : stmts) {
+        recorder.statement(s->line);
+        trace(s);
+        if (Object* returned = ::execute(compiler.compile(s), *this)) {
+            // return outside a function, as the tree walker reports it
+            throw ReturnException(returned);
+        }
+    }
+}
+
+inline Object* Interpreter::execute(Function* f) {
+    if (f->compiled == nullptr) {
+        f->compiled = ClosureCompiler().compile(f->body);
+    }
+    Object* returned = ::execute(f->compiled, *this);
+    return returned != nullptr ? returned : new None();
+}
@@ -1,37 +1,65 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <map>
 #include <algorithm>
 
+#include "hashmap.h"
 #include "object.h"
 
 class Environment {
 public:
-	std::map<std::string, Object*> data;
-	std::map<std::string, Function*> data_function;
+	// A name is bound either to a value in data or to a def in
+	// data_function, never both: binding one kind clears the other, which
+	// is left as a null entry since keys are never removed.
+	HashMap<std::string, Object*> data;
+	HashMap<std::string, Closure*> data_function;
+	// Bumped when a name is added or a def (re)binds one, or a name changes
+	// kind. Inline caches (GlobalCache) hold what a lookup found, including
+	// pointers into data, and stay valid while the version is unchanged;
+	// assigning to an existing global only writes through such a pointer.
+	uint64_t version = 0;
 
-	Environment() {
-		data = {};
+	Environment() {}
+
+	bool exists(const std::string& identifier) {
+		return find(identifier) != nullptr;
 	}
 
-	bool exists(std::string identifier) {
-		return data.find(identifier) != data.end();
+	// Where the value bound to identifier is kept; null if it is not bound
+	// to a value.
+	Object** find(const std::string& identifier) {
+		Object** value = data.find(identifier);
+		return value != nullptr && *value != nullptr ? value : nullptr;
 	}
 
-	Object* get(std::string identifier) {
-		return data[identifier];
+	Object* get(const std::string& identifier) {
+		Object** value = find(identifier);
+		return value != nullptr ? *value : nullptr;
 	}
 
-	void set(std::string identifier, Object* value) {
-		data[identifier] = value;
+	void set(const std::string& identifier, Object* value) {
+		if (Object** slot = find(identifier)) {
+			*slot = value;
+			return;
+		}
+		if (Closure** function = data_function.find(identifier)) {
+			*function = nullptr;
+		}
+		data.set(identifier, value);
+		version++;
 	}
 
-	void set(std::string identifier, Function* value) {
-		data_function[identifier] = value;
+	void set_function(const std::string& identifier, Closure* value) {
+		if (Object** slot = data.find(identifier)) {
+			*slot = nullptr;
+		}
+		data_function.set(identifier, value);
+		version++;
 	}
 
-	Function* get_function(std::string identifier) {
-		return data_function[identifier];
+	Closure* get_function(const std::string& identifier) {
+		Closure** value = data_function.find(identifier);
+		return value != nullptr ? *value : nullptr;
 	}
-};
\ No newline at end of file
+};
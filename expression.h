@@ -1,15 +1,60 @@
 #pragma once
 
+#include <cstdint>
+#include <cstdlib>
 #include <vector>
 #include <string>
 #include "visitor.h"
 #include "token.h"
 #include "object.h"
+#include "number.h"
+
+// Where a name lives, decided once by the Resolver. LOCAL names are stored
+// directly in a frame slot; CELL (a local captured by an inner function) and
+// FREE (captured from an enclosing function) slots hold a Cell shared with
+// the closures. Everything else is looked up in the global environment.
+enum VarKind {
+	VAR_GLOBAL, VAR_LOCAL, VAR_CELL, VAR_FREE,
+};
+
+// a type-specialized copy of a function body (specialize.h)
+struct Specialization;
+
+struct Builtin;
+
+class Binary;
+
+// Monomorphic inline cache of a global lookup: what name resolved to in env
+// when env was at version. value points into env->data; function is a def of
+// that name (only one of the two is set) and builtin the builtin it falls
+// back to.
+struct GlobalCache {
+	Environment* env = nullptr;
+	uint64_t version = 0;
+	Object** value = nullptr;
+	Closure* function = nullptr;
+	Builtin* builtin = nullptr;
+};
 
+struct VarRef {
+	VarKind kind = VAR_GLOBAL;
+	int slot = -1;
+	// for VAR_GLOBAL; filled in by the interpreter
+	mutable GlobalCache cache;
+};
 
 class Expr {
 public:
+	// line of the token that makes the expression: its operator, name or
+	// literal
+	uint32_t line = 0;
+
 	virtual ~Expr() {};
+
+	// this expression, if it is arithmetic under any parentheses; the
+	// engines take the value of such an operand unboxed (number.h)
+	virtual Binary* arithmetic() { return nullptr; }
+
 	virtual void accept(Visitor<void>* v) {};
 	virtual Object* accept(Visitor<Object*>* v) { return nullptr;  };
 };
@@ -38,6 +83,10 @@ public:
 	Expr* left;
 	Token op;
 	Expr* right;
+	// proven by the type checker or, in a specialized body, the specializer:
+	// both operands are of this type, so the interpreter skips the type
+	// checks (0 when unknown)
+	uint16_t typed = 0;
 
 	Binary(Expr* left, Token op, Expr* right) {
 		this->left = left;
@@ -45,6 +94,10 @@ public:
 		this->right = right;
 	}
 
+	Binary* arithmetic() override {
+		return isArithmetic(op.type) ? this : nullptr;
+	}
+
 	void accept(Visitor<void>* v) override {
 		v->visitBinaryExpr(this);
 	}
@@ -59,11 +112,21 @@ public:
 	Token callee;
 	Token paren;
 	std::vector<Expr*> args;
-
-	Call(Token callee, Token paren, std::vector<Expr*> args) {
+	VarRef ref;
+	// the module in module.callee(...), otherwise null
+	Expr* object;
+	// types of the values this call site has returned
+	uint16_t result_types = 0;
+	// in a specialized body: the result is assumed to be of this type and
+	// checked on return; a miss deoptimizes spec
+	uint16_t guard = 0;
+	Specialization* spec = nullptr;
+
+	Call(Token callee, Token paren, std::vector<Expr*> args, Expr* object = nullptr) {
 		this->callee = callee;
 		this->paren = paren;
 		this->args = args;
+		this->object = object;
 	}
 
 	void accept(Visitor<void>* v) override {
@@ -75,6 +138,69 @@ public:
 	}
 };
 
+// thenBranch if condition else elseBranch; only the branch taken is
+// evaluated
+class Conditional : public Expr {
+public:
+	Expr* condition;
+	Expr* thenBranch;
+	Expr* elseBranch;
+	// the condition is proven to be a Boolean, as for If
+	uint16_t typed = 0;
+
+	Conditional(Expr* condition, Expr* thenBranch, Expr* elseBranch) {
+		this->condition = condition;
+		this->thenBranch = thenBranch;
+		this->elseBranch = elseBranch;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitConditionalExpr(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitConditionalExpr(this);
+	}
+};
+
+class DictLiteral : public Expr {
+public:
+	std::vector<Expr*> keys;
+	std::vector<Expr*> values;
+
+	DictLiteral(std::vector<Expr*> keys, std::vector<Expr*> values) {
+		this->keys = keys;
+		this->values = values;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitDictLiteralExpr(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitDictLiteralExpr(this);
+	}
+};
+
+class Get : public Expr {
+public:
+	Expr* object;
+	Token name;
+
+	Get(Expr* object, Token name) {
+		this->object = object;
+		this->name = name;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitGetExpr(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitGetExpr(this);
+	}
+};
+
 class Grouping : public Expr {
 public:
 	Expr* expression;
@@ -83,6 +209,10 @@ public:
 		this->expression = expression;
 	}
 
+	Binary* arithmetic() override {
+		return expression->arithmetic();
+	}
+
 	void accept(Visitor<void>* v) override {
 		v->visitGroupingExpr(this);
 	}
@@ -92,14 +222,68 @@ public:
 	}
 };
 
+// A call of a small function with a copy of the expression the function
+// returns in its place (inline.h). The arguments go into a frame of their
+// own, as for the call, and the copy is evaluated in it; if the name no
+// longer refers to that function, the call is made instead.
+class Inline : public Expr {
+public:
+	Call* call;
+	Function* function;
+	Expr* body;
+
+	Inline(Call* call, Function* function, Expr* body) {
+		this->call = call;
+		this->function = function;
+		this->body = body;
+		this->line = call->line;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitInlineExpr(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitInlineExpr(this);
+	}
+};
+
+class ListLiteral : public Expr {
+public:
+	std::vector<Expr*> items;
+
+	ListLiteral(std::vector<Expr*> items) {
+		this->items = items;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitListLiteralExpr(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitListLiteralExpr(this);
+	}
+};
+
 class Literal : public Expr {
 public:
 	Token token;
 	std::string value;
+	// only meaningful for IDENTIFIER
+	VarRef ref;
+	// the value of a NUMBER or FLOAT, made once: numbers are immutable, so
+	// every evaluation can share it
+	Object* number = nullptr;
 
 	Literal(Token type, std::string value) {
 		this->token = type;
 		this->value = value;
+		if (type.type == NUMBER) {
+			number = new Integer(std::stoi(type.value));
+		}
+		else if (type.type == FLOAT) {
+			number = new Float(std::strtod(type.value.c_str(), nullptr));
+		}
 	}
 
 	void accept(Visitor<void>* v) override {
@@ -116,6 +300,10 @@ public:
 	Expr* left;
 	Token op;
 	Expr* right;
+	// proven by the type checker or, in a specialized body, the specializer:
+	// both operands are of this type, so the interpreter skips the type
+	// checks (0 when unknown)
+	uint16_t typed = 0;
 
 	Logical(Expr* left, Token op, Expr* right) {
 		this->left = left;
@@ -132,10 +320,52 @@ public:
 	}
 };
 
+class SetItem : public Expr {
+public:
+	Expr* object;
+	Expr* index;
+	Expr* value;
+
+	SetItem(Expr* object, Expr* index, Expr* value) {
+		this->object = object;
+		this->index = index;
+		this->value = value;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitSetItemExpr(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitSetItemExpr(this);
+	}
+};
+
+class Subscript : public Expr {
+public:
+	Expr* object;
+	Expr* index;
+
+	Subscript(Expr* object, Expr* index) {
+		this->object = object;
+		this->index = index;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitSubscriptExpr(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitSubscriptExpr(this);
+	}
+};
+
 class Unary : public Expr {
 public:
 	Token op;
 	Expr* right;
+	// the operand is proven to be of this type, as for Binary
+	uint16_t typed = 0;
 
 	Unary(Token op, Expr* right) {
 		this->op = op;
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+
+#include "statement.h"
+#include "object.h"
+#include "return.h"
+#include "interpreter.h"
+
+// Generators.
+//
+// A call of a function whose body yields (the Resolver sets
+// Function::generator) does not run it: it returns a GeneratorFrame holding
+// the function's frame on the heap. Each next() runs the body from where it
+// stopped to the next yield.
+//
+// The body is not run on the C++ stack by the tree walker, which could not
+// be left in the middle. GeneratorFrame executes it as a state machine over
+// the statements the Resolver marked with yields: the blocks and for loops
+// a yield is nested in are kept on an explicit stack, with the position in
+// each, and an if whose branch yields is decided and replaced by the branch.
+// Every other statement, which cannot pause, is handed whole to the tree
+// walker, so a resume costs about as much as a call. Returning, or running
+// off the end of the body, finishes the generator; the returned value is
+// dropped.
+
+class GeneratorFrame : public Generator {
+public:
+    GeneratorFrame(Interpreter* in, Closure* closure, Object** args) {
+        this->in = in;
+        this->closure = closure;
+        Function* f = closure->function;
+        slots.assign(f->num_slots, nullptr);
+        for (size_t i = 0; i < f->params.size(); i++) {
+            slots[i] = args[i];
+        }
+        in->enter(closure, slots.data());
+        stack.push_back(Step{ &f->body, nullptr });
+    }
+
+    std::string toString() {
+        return "<generator object " + closure->function->name.value + ">";
+    }
+
+    Object* next() override {
+        if (stack.empty()) {
+            return nullptr;
+        }
+        if (running) {
+            throw std::runtime_error("generator already executing");
+        }
+        // the body runs on the stack of whoever resumes it
+        in->budget.enter(in->depth);
+        running = true;
+        Object** caller = in->frame;
+        Environment* caller_globals = in->global_env;
+        in->frame = slots.data();
+        in->global_env = closure->globals;
+        if (in->shadow != nullptr) {
+            in->shadow->push(closure->function);
+        }
+        Function* caller_function = nullptr;
+        if (in->allocs != nullptr) {
+            caller_function = in->allocs->function;
+            in->allocs->function = closure->function;
+        }
+        if (++in->depth > in->max_depth) {
+            in->max_depth = in->depth;
+        }
+        in->recorder.call(closure->function);
+        in->trace_call(closure->function, slots.data());
+        Object* value;
+        try {
+            value = resume();
+        }
+        catch (ReturnException&) {
+            value = nullptr;
+        }
+        catch (...) {
+            in->recorder.unwind(closure->function);
+            in->trace_return(closure->function, nullptr);
+            in->frame = caller;
+            in->global_env = caller_globals;
+            in->depth--;
+            if (in->shadow != nullptr) {
+                in->shadow->pop();
+            }
+            if (in->allocs != nullptr) {
+                in->allocs->function = caller_function;
+            }
+            running = false;
+            stack.clear();
+            throw;
+        }
+        in->frame = caller;
+        in->global_env = caller_globals;
+        in->depth--;
+        if (in->shadow != nullptr) {
+            in->shadow->pop();
+        }
+        if (in->allocs != nullptr) {
+            in->allocs->function = caller_function;
+        }
+        in->recorder.ret(closure->function);
+        in->trace_return(closure->function, value);
+        running = false;
+        if (value == nullptr) {
+            stack.clear();
+        }
+        return value;
+    }
+
+private:
+    // A block the body is paused in, or the body of a for loop.
+    struct Step {
+        const std::vector<Statement*>* stmts;
+        For* loop;
+        size_t pc = 0;
+        Object* iterable = nullptr;
+        // a dict's keys, taken when the loop starts
+        std::vector<Object*> keys;
+    };
+
+    Interpreter* in;
+    Closure* closure;
+    std::vector<Object*> slots;
+    std::vector<Step> stack;
+    bool running = false;
+
+    // Runs to the next yield and returns its value, or null at the end.
+    Object* resume() {
+        while (!stack.empty()) {
+            Step& step = stack.back();
+            Statement* s;
+            if (step.loop == nullptr) {
+                if (step.pc == step.stmts->size()) {
+                    stack.pop_back();
+                    continue;
+                }
+                s = (*step.stmts)[step.pc++];
+            }
+            else {
+                Object* item = nextItem(step);
+                if (item == nullptr) {
+                    stack.pop_back();
+                    continue;
+                }
+                in->budget.step();
+                in->store(step.loop->ref, step.loop->name.value, item);
+                s = step.loop->body;
+            }
+            if (Object* value = run(s)) {
+                return value;
+            }
+        }
+        return nullptr;
+    }
+
+    // Starts s: runs it if it cannot yield, otherwise pushes the block or
+    // loop it opens. Returns the value of a yield reached.
+    Object* run(Statement* s) {
+        while (s->yields) {
+            if (s->line != 0) {
+                in->recorder.statement(s->line);
+            }
+            in->trace(s);
+            if (Yield* y = dynamic_cast<Yield*>(s)) {
+                return y->value != nullptr ? in->evaluate(y->value) : new None();
+            }
+            if (Block* b = dynamic_cast<Block*>(s)) {
+                stack.push_back(Step{ &b->statements, nullptr });
+                return nullptr;
+            }
+            if (For* f = dynamic_cast<For*>(s)) {
+                Step step{ nullptr, f };
+                step.iterable = in->evaluate(f->iterable);
+                if (Dict* dict = dynamic_cast<Dict*>(step.iterable)) {
+                    for (auto& e : dict->items) {
+                        step.keys.push_back(e.key);
+                    }
+                }
+                else if (dynamic_cast<List*>(step.iterable) == nullptr
+                         && dynamic_cast<Generator*>(step.iterable) == nullptr) {
+                    in->error();
+                }
+                stack.push_back(step);
+                return nullptr;
+            }
+            If* i = static_cast<If*>(s);
+            s = in->evaluate(i->condition)->truthy() ? i->thenBranch : i->elseBranch;
+            if (s == nullptr) {
+                return nullptr;
+            }
+        }
+        in->evaluate(s);
+        return nullptr;
+    }
+
+    Object* nextItem(Step& step) {
+        if (List* list = dynamic_cast<List*>(step.iterable)) {
+            // re-read the size so appends made by the body are visited too
+            return step.pc < list->items.size() ? list->items[step.pc++] : nullptr;
+        }
+        if (Generator* generator = dynamic_cast<Generator*>(step.iterable)) {
+            return generator->next();
+        }
+        return step.pc < step.keys.size() ? step.keys[step.pc++] : nullptr;
+    }
+};
+
+inline Object* Interpreter::start_generator(Closure* closure, Object** args) {
+    return new GeneratorFrame(this, closure, args);
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Open-addressing hash table modelled on Swiss tables.
+//
+// The table is split into groups of 16 control bytes. A control byte is
+// either EMPTY or the low 7 bits of the key's hash, so a lookup compares a
+// whole group against the wanted tag in one SSE2 instruction and only touches
+// entries whose tag matched. Slots hold indices into a dense entry array:
+// iteration therefore follows insertion order like a CPython dict, and every
+// entry caches its full hash so growing the table never rehashes a key.
+//
+// Keys are never removed; the interpreter has no statement that needs it.
+
+template <class K>
+struct HashMapHash {
+	size_t operator()(const K& key) const {
+		return std::hash<K>()(key);
+	}
+};
+
+template <class K, class V, class Hash = HashMapHash<K>, class Eq = std::equal_to<K>>
+class HashMap {
+public:
+	struct Entry {
+		K key;
+		V value;
+		size_t hash;
+	};
+
+	typedef typename std::vector<Entry>::iterator iterator;
+
+	HashMap() {}
+
+	size_t size() const {
+		return entries.size();
+	}
+
+	bool empty() const {
+		return entries.empty();
+	}
+
+	iterator begin() {
+		return entries.begin();
+	}
+
+	iterator end() {
+		return entries.end();
+	}
+
+	// The pointer stays valid until the next insertion of a new key.
+	V* find(const K& key) {
+		Entry* e = findEntry(key, hashOf(key));
+		return e != nullptr ? &e->value : nullptr;
+	}
+
+	bool contains(const K& key) {
+		return find(key) != nullptr;
+	}
+
+	V& operator[](const K& key) {
+		size_t hash = hashOf(key);
+		Entry* e = findEntry(key, hash);
+		if (e != nullptr) {
+			return e->value;
+		}
+		return insertNew(key, V(), hash).value;
+	}
+
+	void set(const K& key, const V& value) {
+		size_t hash = hashOf(key);
+		Entry* e = findEntry(key, hash);
+		if (e != nullptr) {
+			e->value = value;
+			return;
+		}
+		insertNew(key, value, hash);
+	}
+
+	void reserve(size_t n) {
+		entries.reserve(n);
+		size_t groups = 1;
+		while (groups * GROUP_WIDTH * 7 < n * 8) {
+			groups *= 2;
+		}
+		if (groups * GROUP_WIDTH > ctrl.size()) {
+			rehash(groups);
+		}
+	}
+
+private:
+	enum : size_t { GROUP_WIDTH = 16 };
+	enum : int8_t { EMPTY = -128 };
+
+	std::vector<Entry> entries;
+	std::vector<int8_t> ctrl;
+	std::vector<uint32_t> slots;
+	size_t groupMask = 0;
+	Hash hasher;
+	Eq equal;
+
+	size_t hashOf(const K& key) const {
+		// std::hash is the identity for integers on libstdc++, so spread the
+		// bits before taking the tag from the bottom and the group from the top.
+		uint64_t h = (uint64_t)hasher(key);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return (size_t)h;
+	}
+
+	static int8_t tagOf(size_t hash) {
+		return (int8_t)(hash & 0x7F);
+	}
+
+	size_t groupOf(size_t hash) const {
+		return (hash >> 7) & groupMask;
+	}
+
+	// Bit i of the result is set when ctrl byte i of the group equals tag.
+	static uint32_t matchGroup(const int8_t* group, int8_t tag) {
+#ifdef __SSE2__
+		__m128i bytes = _mm_loadu_si128((const __m128i*)group);
+		return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(tag)));
+#else
+		uint32_t mask = 0;
+		for (size_t i = 0; i < GROUP_WIDTH; i++) {
+			if (group[i] == tag) {
+				mask |= 1u << i;
+			}
+		}
+		return mask;
+#endif
+	}
+
+	Entry* findEntry(const K& key, size_t hash) {
+		if (ctrl.empty()) {
+			return nullptr;
+		}
+		int8_t tag = tagOf(hash);
+		size_t group = groupOf(hash);
+		for (size_t probe = 1; ; probe++) {
+			const int8_t* g = &ctrl[group * GROUP_WIDTH];
+			uint32_t matches = matchGroup(g, tag);
+			while (matches != 0) {
+				Entry& e = entries[slots[group * GROUP_WIDTH + __builtin_ctz(matches)]];
+				if (e.hash == hash && equal(e.key, key)) {
+					return &e;
+				}
+				matches &= matches - 1;
+			}
+			if (matchGroup(g, EMPTY) != 0) {
+				return nullptr;
+			}
+			// triangular probing visits every group of a power-of-two table
+			group = (group + probe) & groupMask;
+		}
+	}
+
+	void place(uint32_t index, size_t hash) {
+		size_t group = groupOf(hash);
+		for (size_t probe = 1; ; probe++) {
+			uint32_t empties = matchGroup(&ctrl[group * GROUP_WIDTH], EMPTY);
+			if (empties != 0) {
+				size_t slot = group * GROUP_WIDTH + __builtin_ctz(empties);
+				ctrl[slot] = tagOf(hash);
+				slots[slot] = index;
+				return;
+			}
+			group = (group + probe) & groupMask;
+		}
+	}
+
+	Entry& insertNew(const K& key, const V& value, size_t hash) {
+		// keep the load factor at or below 7/8
+		if ((entries.size() + 1) * 8 > ctrl.size() * 7) {
+			rehash(ctrl.empty() ? 1 : (groupMask + 1) * 2);
+		}
+		entries.push_back(Entry{ key, value, hash });
+		place((uint32_t)(entries.size() - 1), hash);
+		return entries.back();
+	}
+
+	void rehash(size_t groups) {
+		ctrl.assign(groups * GROUP_WIDTH, (int8_t)EMPTY);
+		slots.assign(groups * GROUP_WIDTH, 0);
+		groupMask = groups - 1;
+		for (size_t i = 0; i < entries.size(); i++) {
+			place((uint32_t)i, entries[i].hash);
+		}
+	}
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdexcept>
+
+#include "statement.h"
+#include "object.h"
+
+// Tracing hooks, for tools that watch a script run without changing the
+// interpreter: coverage, tracers, latency histograms.
+//
+// Subclass Hooks, override the callbacks wanted and pass an instance to
+// Interpreter::setHooks. With no hooks set, a call and a statement each
+// pay one test of a pointer, which is predicted every time. Building with
+// -DMYPYTHON_HOOKS=0 compiles the tests out, and the callbacks are never
+// made; bench/bench.cpp shows how to compare the two builds.
+//
+// Callbacks run on the interpreter's thread, in the middle of the script:
+// they may read what they are given but must not keep Objects past the
+// call or run code in the interpreter.
+
+#ifndef MYPYTHON_HOOKS
+#define MYPYTHON_HOOKS 1
+#endif
+
+class Hooks {
+public:
+    virtual ~Hooks() {}
+
+    // f is about to run, or a generator of f to resume, with its frame in
+    // args (the parameters first)
+    virtual void onCall(Function* f, Object** args) {}
+
+    // f returned result, or its generator yielded it; result is null when
+    // f was left by an error or its generator finished
+    virtual void onReturn(Function* f, Object* result) {}
+
+    // stmt is about to run. The blocks of if and for, which have no line,
+    // are not reported.
+    virtual void onStatement(Statement* stmt) {}
+
+    // error stopped the script
+    virtual void onError(const std::exception& error) {}
+};
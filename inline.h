@@ -0,0 +1,336 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "hashmap.h"
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+#include "clone.h"
+#include "stats.h"
+
+// Inlining of small functions, run once on a script after the Resolver.
+//
+// A top-level def is inlinable when its body is a single `return <expr>`
+// of at most BUDGET nodes, it is not a generator, it has no locals but its
+// parameters, no other top-level def has its name, and it is not recursive:
+// it does not call itself by name, directly or through other top-level defs
+// (counting the calls in their nested defs). Every call to it by
+// name with the right number of arguments, in the script or in any of its
+// functions, is replaced by an Inline node holding the call and a copy of
+// expr. The engines evaluate the arguments in order into a frame of their
+// own, as for the call, and the copy in that frame: the copy keeps the
+// parameter slots and the typed marks of the original, and no Return is
+// thrown, no Environment or Closure looked at and nothing recorded.
+//
+// Calls in a copy are inlined in turn, DEPTH levels deep at most, and a
+// function is never inlined into itself or a copy of itself.
+//
+// Whether the name still refers to the def is checked on each evaluation,
+// through the global's inline cache; if it was rebound, or a module calls
+// into the script, the call is made instead. Inlined calls do not show in
+// the flight recorder or the --stats call count, and with hooks set the
+// call is always made.
+
+class Inliner : Visitor<void> {
+public:
+    // nodes of the returned expression of an inlinable def
+    static const size_t BUDGET = 24;
+    // inlines nested in copies
+    static const size_t DEPTH = 3;
+
+    struct Site {
+        uint32_t line;
+        Function* function;
+        // the def the call is in; null at top level
+        Function* caller;
+        size_t nodes;
+    };
+
+    // every call replaced, copies included, in the order they were
+    std::vector<Site> sites;
+
+    void inlineCalls(std::vector<Statement*>& program) {
+        HashMap<std::string, int> defs;
+        for (Statement* s : program) {
+            if (Function* f = dynamic_cast<Function*>(s)) {
+                defs[f->name.value]++;
+            }
+        }
+        // the names each top-level def calls
+        scanning = true;
+        for (Statement*& s : program) {
+            rewrite(s);
+        }
+        scanning = false;
+        // copies are made from the bodies as they were before any inlining
+        for (Statement* s : program) {
+            Function* f = dynamic_cast<Function*>(s);
+            if (f != nullptr && *defs.find(f->name.value) == 1 && inlinable(f) && !recursive(f->name.value)) {
+                AstCloner cloner;
+                candidates.set(f->name.value, Candidate{ f, cloner.clone(returned(f)), size(f) });
+            }
+        }
+        for (Statement*& s : program) {
+            rewrite(s);
+        }
+    }
+
+    void report(std::ostream& out) const {
+        out << "inlined " << sites.size() << " call" << (sites.size() == 1 ? "" : "s") << "\n";
+        for (const Site& s : sites) {
+            out << "  line " << s.line << ": " << s.function->name.value << " (" << s.nodes << " nodes) into "
+                << (s.caller != nullptr ? s.caller->name.value : "<module>") << "\n";
+        }
+    }
+
+private:
+    struct Candidate {
+        Function* function;
+        // copy of the returned expression
+        Expr* body;
+        size_t nodes;
+    };
+
+    HashMap<std::string, Candidate> candidates;
+    // while set, calls are only recorded in callees, not replaced
+    bool scanning = false;
+    // names called by name in the body of each top-level def
+    HashMap<std::string, std::vector<std::string>> callees;
+    // the top-level def being rewritten, and the innermost def; null at top
+    // level
+    Function* outermost = nullptr;
+    Function* caller = nullptr;
+    // functions whose copies are being rewritten, outermost first
+    std::vector<Function*> copying;
+    // set by a visit that replaces its expression
+    Expr* replacement = nullptr;
+
+    static Expr* returned(Function* f) {
+        return static_cast<Return*>(f->body[0])->value;
+    }
+
+    static size_t size(Function* f) {
+        AstSize size;
+        size.count(f->body);
+        // not counting the return
+        return size.nodes - 1;
+    }
+
+    static bool inlinable(Function* f) {
+        if (f->generator || f->num_slots != (int)f->params.size() || f->body.size() != 1) {
+            return false;
+        }
+        Return* r = dynamic_cast<Return*>(f->body[0]);
+        return r != nullptr && r->value != nullptr && size(f) <= BUDGET;
+    }
+
+    // whether the def named name can reach a call of itself through the
+    // top-level defs it calls
+    bool recursive(const std::string& name) {
+        HashMap<std::string, bool> seen;
+        std::vector<std::string> pending = { name };
+        while (!pending.empty()) {
+            std::vector<std::string>* called = callees.find(pending.back());
+            pending.pop_back();
+            if (called == nullptr) {
+                continue;
+            }
+            for (const std::string& callee : *called) {
+                if (callee == name) {
+                    return true;
+                }
+                if (!seen.contains(callee)) {
+                    seen.set(callee, true);
+                    pending.push_back(callee);
+                }
+            }
+        }
+        return false;
+    }
+
+    Candidate* target(Call* expr) {
+        if (expr->object != nullptr || expr->ref.kind != VAR_GLOBAL || copying.size() >= DEPTH) {
+            return nullptr;
+        }
+        Candidate* c = candidates.find(expr->callee.value);
+        if (c == nullptr || expr->args.size() != c->function->params.size() || c->function == caller) {
+            return nullptr;
+        }
+        for (Function* f : copying) {
+            if (f == c->function) {
+                return nullptr;
+            }
+        }
+        return c;
+    }
+
+    Expr* rewrite(Expr* expr) {
+        if (expr == nullptr) {
+            return nullptr;
+        }
+        replacement = nullptr;
+        expr->accept(this);
+        Expr* result = replacement != nullptr ? replacement : expr;
+        replacement = nullptr;
+        return result;
+    }
+
+    void rewrite(std::vector<Expr*>& exprs) {
+        for (Expr*& e : exprs) {
+            e = rewrite(e);
+        }
+    }
+
+    void rewrite(Statement* stmt) {
+        if (stmt != nullptr) {
+            stmt->accept(this);
+        }
+    }
+
+    // --- statements ---
+
+    void visitVarStatement(Var* stmt) override {
+        stmt->initial = rewrite(stmt->initial);
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        for (Statement* s : stmt->statements) {
+            rewrite(s);
+        }
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        stmt->expr = rewrite(stmt->expr);
+    };
+
+    void visitForStmt(For* stmt) override {
+        stmt->iterable = rewrite(stmt->iterable);
+        rewrite(stmt->body);
+    };
+
+    void visitFunctionStmt(Function* stmt) override {
+        Function* outer = caller;
+        caller = stmt;
+        if (outer == nullptr) {
+            outermost = stmt;
+        }
+        for (Statement* s : stmt->body) {
+            rewrite(s);
+        }
+        caller = outer;
+        if (outer == nullptr) {
+            outermost = nullptr;
+        }
+    };
+
+    void visitGlobalStmt(Global* stmt) override {};
+
+    void visitIfStmt(If* stmt) override {
+        stmt->condition = rewrite(stmt->condition);
+        rewrite(stmt->thenBranch);
+        rewrite(stmt->elseBranch);
+    };
+
+    void visitImportStmt(Import* stmt) override {};
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {};
+
+    void visitPrintStatement(Print* stmt) override {
+        rewrite(stmt->exprs);
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        stmt->value = rewrite(stmt->value);
+    };
+
+    void visitYieldStmt(Yield* stmt) override {
+        stmt->value = rewrite(stmt->value);
+    };
+
+    // --- expressions ---
+
+    void visitAssignExpr(Assign* expr) override {
+        expr->value = rewrite(expr->value);
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        expr->left = rewrite(expr->left);
+        expr->right = rewrite(expr->right);
+    };
+
+    void visitCallExpr(Call* expr) override {
+        expr->object = rewrite(expr->object);
+        rewrite(expr->args);
+        if (scanning) {
+            if (outermost != nullptr && expr->object == nullptr && expr->ref.kind == VAR_GLOBAL) {
+                callees[outermost->name.value].push_back(expr->callee.value);
+            }
+            return;
+        }
+        Candidate* c = target(expr);
+        if (c == nullptr) {
+            return;
+        }
+        AstCloner cloner;
+        Expr* body = cloner.clone(c->body);
+        sites.push_back(Site{ expr->line, c->function, caller, c->nodes });
+        copying.push_back(c->function);
+        body = rewrite(body);
+        copying.pop_back();
+        replacement = new Inline(expr, c->function, body);
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        expr->condition = rewrite(expr->condition);
+        expr->thenBranch = rewrite(expr->thenBranch);
+        expr->elseBranch = rewrite(expr->elseBranch);
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        rewrite(expr->keys);
+        rewrite(expr->values);
+    };
+
+    void visitGetExpr(Get* expr) override {
+        expr->object = rewrite(expr->object);
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        expr->expression = rewrite(expr->expression);
+    };
+
+    // only made here, and never visited twice
+    void visitInlineExpr(Inline* expr) override {};
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        rewrite(expr->items);
+    };
+
+    void visitLiteralExpr(Literal* expr) override {};
+
+    void visitLogicalExpr(Logical* expr) override {
+        expr->left = rewrite(expr->left);
+        expr->right = rewrite(expr->right);
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        expr->object = rewrite(expr->object);
+        expr->index = rewrite(expr->index);
+        expr->value = rewrite(expr->value);
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        expr->object = rewrite(expr->object);
+        expr->index = rewrite(expr->index);
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        expr->right = rewrite(expr->right);
+    };
+
+    void visitVariableExpr(Variable* expr) override {};
+};
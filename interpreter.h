@@ -2,7 +2,7 @@
 
 #include <algorithm>
 #include <string>
-#include <stack>
+#include <thread>
 #include <vector>
 #include <iostream>
 #include "environment.h"
@@ -10,62 +10,200 @@
 #include "statement.h"
 #include "object.h"
 #include "return.h"
+#include "output.h"
+#include "builtins.h"
+#include "module.h"
+#include "jit.h"
+#include "specialize.h"
+#include "clone.h"
+#include "budget.h"
+#include "profiler.h"
+#include "allocations.h"
+#include "lineprofile.h"
+#include "hooks.h"
+#include "recorder.h"
+
+// How statements are executed: by walking the AST with the visitor below,
+// or by running the pre-bound callables of compiler.h.
+enum Engine {
+    ENGINE_WALK, ENGINE_CLOSURE,
+};
 
 class Interpreter: public Visitor<Object*> {
 public:
+    Output out;
+    // where import looks for modules
+    ModulePath module_path;
+    Jit jit;
+    Specializer specializer;
+    Engine engine = ENGINE_WALK;
+    // threads parallel_map may use (parallel.h)
+    unsigned parallel_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    // step, time and memory limits; counted at calls and loop iterations
+    Budget budget;
+    // functions being run, for the profiler; null when not profiling
+    ShadowStack* shadow = nullptr;
+    // told the expression and function being run; null when not profiling
+    // allocations
+    AllocationProfiler* allocs = nullptr;
+    // told every statement started and finished; null when not profiling
+    // lines
+    LineProfiler* lines = nullptr;
+    // the last calls, returns and statements, for error reports
+    FlightRecorder recorder;
+    // calls made and the deepest nesting of calls reached (--stats)
+    uint64_t calls = 0;
+    int max_depth = 0;
+
     Interpreter() {
         global_env = new Environment();
     }
 
-    void run(std::vector<Statement*> stmts) {
-        for (Statement* s : stmts) {
-            s->accept(this);
+    // print output is appended to capture instead of going to stdout
+    explicit Interpreter(std::string* capture) : out(capture) {
+        global_env = new Environment();
+    }
+
+    void run(const std::vector<Statement*>& stmts) {
+#if MYPYTHON_HOOKS
+        try {
+            run_statements(stmts);
         }
+        catch (std::exception& e) {
+            if (hooks != nullptr) {
+                hooks->onError(e);
+            }
+            throw;
+        }
+#else
+        run_statements(stmts);
+#endif
     };
 
+    // Calls the callbacks of hooks while scripts run; null for none. The
+    // JIT and specialization are turned off, as compiled code makes calls
+    // the hooks would not see and specialized bodies are copies of the
+    // statements.
+    void setHooks(Hooks* hooks) {
+        this->hooks = hooks;
+        if (hooks != nullptr) {
+            jit.enabled = false;
+            specializer.enabled = false;
+        }
+    }
+
     Object* evaluate(Statement* stmt) {
+        if (stmt->line != 0) {
+            recorder.statement(stmt->line);
+        }
+        trace(stmt);
+        if (lines == nullptr) {
+            return stmt->accept(this);
+        }
+        // left by its destructor: a return unwinds through every statement
+        // it is in, and catching it in each would cost more than the rest
+        LineProfiler::Timer timer(lines, stmt);
         return stmt->accept(this);
     }
 
     Object* evaluate(Expr* expr) {
-        return expr->accept(this);
+        if (allocs == nullptr) {
+            return expr->accept(this);
+        }
+        Expr* outer = allocs->site;
+        allocs->site = expr;
+        Object* value = expr->accept(this);
+        allocs->site = outer;
+        return value;
     }
 
     Object* visitVarStatement(Var* stmt) {
-        if (stackframe_env.size() != 0) {
-            stackframe_env.top()->set(stmt->name.value, stmt->initial->accept(this));
-        }
-        else {
-            global_env->set(stmt->name.value, stmt->initial->accept(this));
-        }
+        store(stmt->ref, stmt->name.value, evaluate(stmt->initial));
         return nullptr;
     };
     
     Object* visitBlockStmt(Block* stmt) {
         for (auto s : stmt->statements) {
-            s->accept(this);
+            evaluate(s);
         }
         return nullptr;
     };
     
     Object* visitExpressionStmt(Expression* stmt) {
-        stmt->accept(this);
+        evaluate(stmt->expr);
         return nullptr;
     };
     
+    Object* visitForStmt(For* stmt) {
+        Object* iterable = evaluate(stmt->iterable);
+        if (List* list = dynamic_cast<List*>(iterable)) {
+            // re-read the size so appends made by the body are visited too
+            for (size_t i = 0; i < list->items.size(); i++) {
+                budget.step();
+                store(stmt->ref, stmt->name.value, item(stmt, list->items[i]));
+                evaluate(stmt->body);
+            }
+        }
+        else if (Dict* dict = dynamic_cast<Dict*>(iterable)) {
+            std::vector<Object*> keys;
+            keys.reserve(dict->items.size());
+            for (auto& e : dict->items) {
+                keys.push_back(e.key);
+            }
+            for (Object* key : keys) {
+                budget.step();
+                store(stmt->ref, stmt->name.value, item(stmt, key));
+                evaluate(stmt->body);
+            }
+        }
+        else if (Generator* generator = dynamic_cast<Generator*>(iterable)) {
+            while (Object* value = generator->next()) {
+                budget.step();
+                store(stmt->ref, stmt->name.value, item(stmt, value));
+                evaluate(stmt->body);
+            }
+        }
+        else {
+            error();
+        }
+        return nullptr;
+    };
+
     Object* visitFunctionStmt(Function* stmt) {
-        global_env->set(stmt->name.value, stmt);
+        // flat closure: copy the Cells of the captured variables now
+        Closure* closure = new Closure(stmt, global_env);
+        closure->cells.reserve(stmt->captures.size());
+        for (int from : stmt->captures) {
+            closure->cells.push_back(frame[from]);
+        }
+        if (stmt->binding.kind == VAR_GLOBAL) {
+            if (global_env->get_function(stmt->name.value) != nullptr) {
+                jit.invalidate();
+            }
+            global_env->set_function(stmt->name.value, closure);
+        }
+        else {
+            store(stmt->binding, stmt->name.value, closure);
+        }
+        return nullptr;
+    };
+
+    Object* visitGlobalStmt(Global* stmt) {
         return nullptr;
     };
 
     Object* visitIfStmt(If* stmt) {
         Object* conditional_obj = evaluate(stmt->condition);
-        Boolean* conditional = dynamic_cast<Boolean*>(conditional_obj);
-        if (conditional == nullptr) {
-            error();
+        if (stmt->typed) {
+            if (static_cast<Boolean*>(conditional_obj)->value) {
+                evaluate(stmt->thenBranch);
+            }
+            else if (stmt->elseBranch != nullptr) {
+                evaluate(stmt->elseBranch);
+            }
+            return nullptr;
         }
-
-        if (conditional != nullptr && conditional->value) {
+        if (conditional_obj->truthy()) {
             evaluate(stmt->thenBranch);
         }
         else if (stmt->elseBranch != nullptr) {
@@ -74,99 +212,139 @@ public:
 
         return nullptr;
     };
+    Object* visitImportStmt(Import* stmt) {
+        Module* module = import_module(stmt->module.value);
+        if (stmt->names.empty()) {
+            store(stmt->refs[0], stmt->module.value, module);
+        }
+        for (size_t i = 0; i < stmt->names.size(); i++) {
+            store(stmt->refs[i], stmt->names[i].value, attribute(module, stmt->names[i].value));
+        }
+        return nullptr;
+    };
+    Object* visitNonlocalStmt(Nonlocal* stmt) {
+        return nullptr;
+    };
     Object* visitPrintStatement(Print* stmt) {
         for (size_t i = 0; i < stmt->exprs.size(); i++) {
             if (i != 0) {
-                std::cout << " ";
+                out.write(' ');
             }
-            Object* v = evaluate(stmt->exprs[i]);
-            std::cout << v->toString();
+            evaluate(stmt->exprs[i])->write(out);
         }
-        std::cout << "\n";
+        out.newline();
         return nullptr;
     };
     Object* visitReturnStmt(Return* stmt) {
+        if (stmt->value == nullptr) {
+            throw ReturnException();
+        }
         Object* return_obj = evaluate(stmt->value);
         throw ReturnException(return_obj);
     };
+    // generator bodies are run by generator.h
+    Object* visitYieldStmt(Yield* stmt) {
+        error();
+        return nullptr;
+    };
     Object* visitAssignExpr(Assign* expr) {
         return nullptr;
     };
     Object* visitBinaryExpr(Binary* expr) {
-        Object* rhs_obj = evaluate(expr->right);
-        Object* lhs_obj = evaluate(expr->left);
-        Integer* lhs_int = dynamic_cast<Integer*>(lhs_obj);
-        Integer* rhs_int = dynamic_cast<Integer*>(rhs_obj);
+        if (isArithmetic(expr->op.type)) {
+            return box(arithmetic(expr));
+        }
+        Number lhs;
+        Number rhs;
+        Object* lhs_obj = nullptr;
+        Object* rhs_obj = nullptr;
+        bool lhs_number = operand(expr->left, lhs, lhs_obj);
+        bool rhs_number = operand(expr->right, rhs, rhs_obj);
+        // read only now: a guard that fails in an operand deoptimizes the
+        // body and clears it, and the operand may then be of any type
+        if (expr->typed == TYPE_INT) {
+            switch (expr->op.type) {
+            case EQUAL_TO: return new Boolean(lhs.i == rhs.i);
+            case NOT_EQUAL_TO: return new Boolean(lhs.i != rhs.i);
+            case GREATER_THAN: return new Boolean(lhs.i > rhs.i);
+            case LESS_THAN: return new Boolean(lhs.i < rhs.i);
+            case GREATER_THAN_EQUAL_TO: return new Boolean(lhs.i >= rhs.i);
+            case LESS_THAN_EQUAL_TO: return new Boolean(lhs.i <= rhs.i);
+            }
+        }
+        else if (expr->typed == TYPE_BOOL) {
+            bool lhs_value = static_cast<Boolean*>(lhs_obj)->value;
+            bool rhs_value = static_cast<Boolean*>(rhs_obj)->value;
+            return new Boolean(expr->op.type == EQUAL_TO ? lhs_value == rhs_value : lhs_value != rhs_value);
+        }
+        if (lhs_number && rhs_number) {
+            return new Boolean(compare(expr->op.type, lhs, rhs));
+        }
         Boolean* lhs_bool = dynamic_cast<Boolean*>(lhs_obj);
         Boolean* rhs_bool = dynamic_cast<Boolean*>(rhs_obj);
-
-        Boolean* res = nullptr;;
-        switch (expr->op.type) {
-        case EQUAL_TO:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Boolean(lhs_int->value == rhs_int->value);
-            }
-            else if (lhs_bool != nullptr && rhs_bool != nullptr) {
-                return new Boolean(lhs_bool->value == rhs_bool->value);
-            }
-        case NOT_EQUAL_TO:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Boolean(lhs_int->value != rhs_int->value);
-            }
-            else if (lhs_bool != nullptr && rhs_bool != nullptr) {
-                return new Boolean(lhs_bool->value != rhs_bool->value);
-            }
-        case GREATER_THAN:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Boolean(lhs_int->value > rhs_int->value);
-            }
-        case LESS_THAN:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Boolean(lhs_int->value < rhs_int->value);
-            }
-        case GREATER_THAN_EQUAL_TO:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Boolean(lhs_int->value >= rhs_int->value);
-            }
-        case LESS_THAN_EQUAL_TO:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Boolean(lhs_int->value <= rhs_int->value);
-            }
-        case MINUS:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Integer(lhs_int->value - rhs_int->value);
-            }
-        case PLUS:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Integer(lhs_int->value + rhs_int->value);
-            }
-        case DIVIDE:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Integer((int)(lhs_int->value / rhs_int->value));
-            }
-        case MULTIPLY:
-            if (lhs_int != nullptr && rhs_int != nullptr) {
-                return new Integer((int)(lhs_int->value * rhs_int->value));
+        if (lhs_bool != nullptr && rhs_bool != nullptr) {
+            switch (expr->op.type) {
+            case EQUAL_TO: return new Boolean(lhs_bool->value == rhs_bool->value);
+            case NOT_EQUAL_TO: return new Boolean(lhs_bool->value != rhs_bool->value);
             }
         }
         error();
         return nullptr;
     };
     Object* visitCallExpr(Call* expr) {
-        std::string name = expr->callee.value;
-
-        Function* func = global_env->get_function(name);
-
-        std::vector<Object*> args;
-        for (auto a : expr->args) {
-            args.push_back(evaluate(a));
+        return observe(expr, call(expr));
+    };
+    Object* visitConditionalExpr(Conditional* expr) {
+        Object* condition = evaluate(expr->condition);
+        bool value = expr->typed ? static_cast<Boolean*>(condition)->value : condition->truthy();
+        return evaluate(value ? expr->thenBranch : expr->elseBranch);
+    };
+    Object* visitDictLiteralExpr(DictLiteral* expr) {
+        Dict* dict = new Dict();
+        dict->items.reserve(expr->keys.size());
+        for (size_t i = 0; i < expr->keys.size(); i++) {
+            Object* key = evaluate(expr->keys[i]);
+            dict->setItem(key, evaluate(expr->values[i]));
         }
-
-        return run_function(func, args);
+        return dict;
+    };
+    Object* visitGetExpr(Get* expr) {
+        return attribute(evaluate(expr->object), expr->name.value);
     };
     Object* visitGroupingExpr(Grouping* expr) {
         return evaluate(expr->expression);
     };
+    Object* visitInlineExpr(Inline* expr) {
+        if (!runs_inline(expr)) {
+            return visitCallExpr(expr->call);
+        }
+        const std::vector<Expr*>& args = expr->call->args;
+        ArgBuffer slots(args.size());
+        for (size_t i = 0; i < args.size(); i++) {
+            slots[i] = evaluate(args[i]);
+        }
+        budget.step();
+        Object** caller = frame;
+        frame = slots.get();
+        Object* result;
+        try {
+            result = evaluate(expr->body);
+        }
+        catch (...) {
+            frame = caller;
+            throw;
+        }
+        frame = caller;
+        return observe(expr->call, result);
+    };
+    Object* visitListLiteralExpr(ListLiteral* expr) {
+        List* list = new List();
+        list->items.reserve(expr->items.size());
+        for (Expr* e : expr->items) {
+            list->items.push_back(evaluate(e));
+        }
+        return list;
+    };
     Object* visitLiteralExpr(Literal* expr) {
         switch (expr->token.type) {
         case TRUE:
@@ -176,52 +354,58 @@ public:
         case NONE:
             return new None();
         case IDENTIFIER:
-            if (stackframe_env.size() != 0 && stackframe_env.top()->exists(expr->token.value)) {
-                return stackframe_env.top()->get(expr->token.value);
-            }
-            return global_env->get(expr->token.value);
+            return load(expr->ref, expr->token.value);
         case NUMBER:
-            return new Integer(std::stoi(expr->token.value));
+        case FLOAT:
+            return expr->number;
         case STRING:
             return new String(expr->token.value);
         }
         error();
         return nullptr;
     };
+    // the operand that decides, as in Python: the right one is only
+    // evaluated when the left one does not
     Object* visitLogicalExpr(Logical* expr) {
-        Object* rhs_obj = evaluate(expr->right);
-        Object* lhs_obj = evaluate(expr->left);
-        Boolean* lhs_bool = dynamic_cast<Boolean*>(lhs_obj);
-        Boolean* rhs_bool = dynamic_cast<Boolean*>(rhs_obj);
-
-        if (lhs_bool != nullptr && rhs_bool != nullptr) {
-            switch (expr->op.type) {
-            case AND:
-                return new Boolean(lhs_bool->value && rhs_bool->value);
-            case OR:
-                return new Boolean(lhs_bool->value || rhs_bool->value);
-            }
+        Object* lhs = evaluate(expr->left);
+        bool value = expr->typed ? static_cast<Boolean*>(lhs)->value : lhs->truthy();
+        if (value == (expr->op.type == OR)) {
+            return lhs;
         }
-        error();
-        return nullptr;
+        return evaluate(expr->right);
+    };
+    Object* visitSetItemExpr(SetItem* expr) {
+        Object* object = evaluate(expr->object);
+        Object* index = evaluate(expr->index);
+        Object* value = evaluate(expr->value);
+        object->setItem(index, value);
+        return value;
+    };
+    Object* visitSubscriptExpr(Subscript* expr) {
+        Object* object = evaluate(expr->object);
+        return object->getItem(evaluate(expr->index));
     };
     Object* visitUnaryExpr(Unary* expr) {
         Object* rhs_obj = evaluate(expr->right);
+        if (expr->typed == TYPE_INT) {
+            return new Integer(-static_cast<Integer*>(rhs_obj)->value);
+        }
+        else if (expr->typed == TYPE_BOOL) {
+            return new Boolean(!static_cast<Boolean*>(rhs_obj)->value);
+        }
         Integer* rhs_int = dynamic_cast<Integer*>(rhs_obj);
-        Boolean* rhs_bool = dynamic_cast<Boolean*>(rhs_obj);
 
         switch (expr->op.type) {
         case MINUS:
+            if (Float* rhs_float = dynamic_cast<Float*>(rhs_obj)) {
+                return new Float(-rhs_float->value);
+            }
             if (rhs_int == nullptr) { error(); return nullptr; }
             else {
                 return new Integer(-rhs_int->value);
             }
         case NOT:
-            if (rhs_bool == nullptr) { error(); return nullptr; }
-            else if (rhs_bool != nullptr && rhs_bool->value) { return new Boolean(false); }
-            else {
-                return new Boolean(true);
-            }
+            return new Boolean(!rhs_obj->truthy());
         }
 
         error();
@@ -231,45 +415,453 @@ public:
         return nullptr;
     };
 
-    void create_stackframe(std::vector<Token> params, std::vector<Object*> args) {
-        stackframe_env.push(new Environment());
+private:
+    Environment* global_env;
+    // slots of the running function; null at top level
+    Object** frame = nullptr;
+    // calls being run
+    int depth = 0;
+
+    // modules this interpreter has executed, by path
+    HashMap<std::string, Module*> modules;
 
-        size_t i = 0;
-        while (i < params.size()) {
-            stackframe_env.top()->set(params.at(i).value, args.at(i));
-            i++;
+    // Evaluates an operand of an arithmetic or comparison operator into n:
+    // an arithmetic operand without boxing it, anything else through obj.
+    // False if the value is not a number.
+    bool operand(Expr* expr, Number& n, Object*& obj) {
+        if (Binary* b = expr->arithmetic()) {
+            n = arithmetic(b);
+            return true;
         }
+        obj = evaluate(expr);
+        return unbox(obj, n);
     }
 
-    void pop_stackframe() {
-        stackframe_env.pop();
+    // Unboxed, so a typed operation gains nothing by skipping the checks:
+    // unbox() looks at the type either way.
+    Number arithmetic(Binary* expr) {
+        Number lhs;
+        Number rhs;
+        Object* obj;
+        bool lhs_number = operand(expr->left, lhs, obj);
+        bool rhs_number = operand(expr->right, rhs, obj);
+        if (!lhs_number || !rhs_number) {
+            error();
+        }
+        return ::arithmetic(expr->op.type, lhs, rhs);
     }
 
-private:
-    Environment* global_env;
-    std::stack<Environment*> stackframe_env;
-    std::stack<int> tempInteger;
+    Object* run_function(Closure* closure, Object** slots) {
+        Function* f = closure->function;
+        budget.step();
+        calls++;
+        if (f->generator) {
+            return start_generator(closure, slots);
+        }
+        if (jit.enabled && !f->jit_failed) {
+            if (f->jit_code == nullptr && ++f->calls >= Jit::JIT_THRESHOLD) {
+                jit.compile(closure);
+            }
+            if (f->jit_code != nullptr && integer_args(f, slots)) {
+                Object* result = Jit::call(f, slots);
+                if (result == nullptr) {
+                    budget.outOfStack();
+                }
+                return result;
+            }
+        }
+        const std::vector<Statement*>* body = &f->body;
+        if (specializer.enabled && engine == ENGINE_WALK) {
+            if (Specialization* s = specializer.select(f, slots)) {
+                body = &s->body;
+            }
+            else {
+                specializer.profile(f, slots);
+            }
+        }
 
-    Object* run_function(Function* f, std::vector<Object*> args) {
-        if (args.size() != f->params.size()) {
-            throw std::runtime_error("wrong sized arguments");
+        budget.enter(depth);
+        enter(closure, slots);
+
+        Object** caller = frame;
+        Environment* caller_globals = global_env;
+        frame = slots;
+        global_env = closure->globals;
+        if (shadow != nullptr) {
+            shadow->push(f);
+        }
+        Function* caller_function = nullptr;
+        if (allocs != nullptr) {
+            caller_function = allocs->function;
+            allocs->function = f;
         }
+        if (++depth > max_depth) {
+            max_depth = depth;
+        }
+        recorder.call(f);
+        trace_call(f, slots);
+        Object* result;
         try {
-            this->create_stackframe(f->params, args);
-            this->run(f->body);
+            result = engine == ENGINE_CLOSURE ? execute(f) : walk(*body);
         }
-        catch (ReturnException r) {
-            this->pop_stackframe();
-            return r.return_object;
+        catch (...) {
+            recorder.unwind(f);
+            trace_return(f, nullptr);
+            frame = caller;
+            global_env = caller_globals;
+            depth--;
+            if (shadow != nullptr) {
+                shadow->pop();
+            }
+            if (allocs != nullptr) {
+                allocs->function = caller_function;
+            }
+            throw;
+        }
+        frame = caller;
+        global_env = caller_globals;
+        depth--;
+        if (shadow != nullptr) {
+            shadow->pop();
+        }
+        if (allocs != nullptr) {
+            allocs->function = caller_function;
+        }
+        recorder.ret(f);
+        trace_return(f, result);
+        return result;
+    }
+
+    void run_statements(const std::vector<Statement*>& stmts) {
+        if (engine == ENGINE_CLOSURE) {
+            execute(stmts);
+            return;
+        }
+        for (Statement* s : stmts) {
+            evaluate(s);
+        }
+    }
+
+    // hooks.h
+    Hooks* hooks = nullptr;
+
+    void trace(Statement* stmt) {
+#if MYPYTHON_HOOKS
+        if (hooks != nullptr && stmt->line != 0) {
+            hooks->onStatement(stmt);
+        }
+#endif
+    }
+
+    void trace_call(Function* f, Object** args) {
+#if MYPYTHON_HOOKS
+        if (hooks != nullptr) {
+            hooks->onCall(f, args);
+        }
+#endif
+    }
+
+    void trace_return(Function* f, Object* result) {
+#if MYPYTHON_HOOKS
+        if (hooks != nullptr) {
+            hooks->onReturn(f, result);
+        }
+#endif
+    }
+
+    // Fills in a frame whose arguments are set: clears the other locals and
+    // puts the cells in place.
+    void enter(Closure* closure, Object** slots) {
+        Function* f = closure->function;
+        for (int i = (int)f->params.size(); i < f->free_base; i++) {
+            slots[i] = nullptr;
+        }
+        for (int c : f->cells) {
+            slots[c] = new Cell(slots[c]);
+        }
+        for (size_t i = 0; i < closure->cells.size(); i++) {
+            slots[f->free_base + i] = closure->cells[i];
         }
+    }
 
-        this->pop_stackframe();
+    Object* walk(const std::vector<Statement*>& body) {
+        try {
+            for (Statement* s : body) {
+                evaluate(s);
+            }
+        }
+        catch (ReturnException& r) {
+            return r.return_object;
+        }
         return new None();
     }
 
+    // compiler.h
+    friend class ClosureCompiler;
+    void execute(const std::vector<Statement*>& stmts);
+    Object* execute(Function* f);
+
+    // parallel.h
+    friend class ParallelMap;
+
+    // generator.h
+    friend class GeneratorFrame;
+    Object* start_generator(Closure* closure, Object** args);
+
+    // snapshot.h
+    friend class SnapshotWriter;
+    friend class SnapshotReader;
+
+    // Each module runs once per interpreter, the first time it is imported;
+    // it is compiled once per process.
+    Module* import_module(const std::string& name) {
+        std::string path = module_path.find(name);
+        if (Module** loaded = modules.find(path)) {
+            return *loaded;
+        }
+        CompiledModule* code = ModuleCache::instance().load(path);
+        // the cached tree is shared by every interpreter of the process;
+        // this one runs a copy, since running keeps state on the nodes
+        std::vector<Statement*> statements = AstCloner(true).clone(code->statements);
+
+        Module* module = new Module(name, new Environment());
+        // registered before running so circular imports see the partial module
+        modules.set(path, module);
+
+        Object** caller = frame;
+        Environment* caller_globals = global_env;
+        frame = nullptr;
+        global_env = module->env;
+        try {
+            run_statements(statements);
+        }
+        catch (...) {
+            frame = caller;
+            global_env = caller_globals;
+            throw;
+        }
+        frame = caller;
+        global_env = caller_globals;
+        return module;
+    }
+
+    Object* attribute(Object* object, const std::string& name) {
+        Module* module = dynamic_cast<Module*>(object);
+        if (module == nullptr) {
+            throw std::runtime_error("object has no attribute '" + name + "'");
+        }
+        if (Closure* f = module->env->get_function(name)) {
+            return f;
+        }
+        if (Object* value = module->env->get(name)) {
+            return value;
+        }
+        throw std::runtime_error("module '" + module->name + "' has no attribute '" + name + "'");
+    }
+
+    // type feedback for a for loop's items, or the guard in a specialized body
+    Object* item(For* stmt, Object* value) {
+        uint16_t type = value->type();
+        if (stmt->guard != 0) {
+            if (type != stmt->guard) {
+                Specializer::deoptimize(stmt->spec);
+            }
+        }
+        else {
+            stmt->item_types |= type;
+        }
+        return value;
+    }
+
+    bool integer_args(Function* f, Object** args) {
+        for (size_t i = 0; i < f->params.size(); i++) {
+            if (dynamic_cast<Integer*>(args[i]) == nullptr) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Records the type of what a call returned, or checks it against the
+    // guard of a specialized body.
+    Object* observe(Call* expr, Object* result) {
+        uint16_t type = result->type();
+        if (expr->guard != 0) {
+            if (type != expr->guard) {
+                Specializer::deoptimize(expr->spec);
+            }
+        }
+        else {
+            expr->result_types |= type;
+        }
+        return result;
+    }
+
+    // Whether an Inline's name still refers to its function, in the
+    // globals the copy was made for. Hooks see every call, so with hooks
+    // set the call is made.
+    bool runs_inline(Inline* expr) {
+        if (hooks != nullptr) {
+            return false;
+        }
+        Builtin* builtin = nullptr;
+        Closure* closure = callee(expr->call, nullptr, builtin);
+        return closure != nullptr && closure->function == expr->function && closure->globals == global_env;
+    }
+
+    // resolves the callee and calls it
+    Object* call(Call* expr) {
+        Builtin* builtin = nullptr;
+        Object* object = expr->object != nullptr ? evaluate(expr->object) : nullptr;
+        Closure* closure = callee(expr, object, builtin);
+        if (builtin != nullptr) {
+            return call_builtin(builtin, expr);
+        }
+
+        // the arguments are evaluated straight into the callee's frame
+        ArgBuffer slots(closure->function->num_slots);
+        for (size_t i = 0; i < expr->args.size(); i++) {
+            slots[i] = evaluate(expr->args[i]);
+        }
+
+        return run_function(closure, slots.get());
+    }
+
+    // The function a call refers to; object is the module of module.f().
+    // A builtin is returned through builtin, with a null result.
+    Closure* callee(Call* expr, Object* object, Builtin*& builtin) {
+        const std::string& name = expr->callee.value;
+
+        Closure* closure = nullptr;
+        if (object != nullptr) {
+            closure = dynamic_cast<Closure*>(attribute(object, name));
+        }
+        else if (expr->ref.kind == VAR_GLOBAL) {
+            GlobalCache& cache = lookup_global(expr->ref, name);
+            closure = cache.function;
+            if (closure == nullptr) {
+                if (cache.value == nullptr) {
+                    builtin = cache.builtin;
+                    if (builtin == nullptr) {
+                        throw std::runtime_error("name '" + name + "' is not defined");
+                    }
+                    return nullptr;
+                }
+                closure = dynamic_cast<Closure*>(*cache.value);
+            }
+        }
+        else {
+            closure = dynamic_cast<Closure*>(load(expr->ref, name));
+        }
+        if (closure == nullptr) {
+            throw std::runtime_error("'" + name + "' is not callable");
+        }
+        if (expr->args.size() != closure->function->params.size()) {
+            throw std::runtime_error("wrong sized arguments");
+        }
+        return closure;
+    }
+
+    Object* call_builtin(Builtin* b, Call* expr) {
+        size_t argc = expr->args.size();
+        if (argc < b->min_args || argc > b->max_args) {
+            throw std::runtime_error(b->name + "() called with wrong number of arguments");
+        }
+        if (argc == 1 && b->call1 != nullptr) {
+            return b->call1(evaluate(expr->args[0]));
+        }
+        if (argc == 2 && b->call2 != nullptr) {
+            Object* lhs = evaluate(expr->args[0]);
+            return b->call2(lhs, evaluate(expr->args[1]));
+        }
+        ArgBuffer args(argc);
+        for (size_t i = 0; i < argc; i++) {
+            args[i] = evaluate(expr->args[i]);
+        }
+        if (b->callI != nullptr) {
+            return b->callI(*this, args.get(), argc);
+        }
+        return b->callN(args.get(), argc);
+    }
+
+    Object* load(const VarRef& ref, const std::string& name) {
+        Object* value;
+        switch (ref.kind) {
+        case VAR_LOCAL:
+            value = frame[ref.slot];
+            break;
+        case VAR_CELL:
+        case VAR_FREE:
+            value = static_cast<Cell*>(frame[ref.slot])->value;
+            break;
+        default:
+            return load_global(ref, name);
+        }
+        if (value == nullptr) {
+            throw std::runtime_error("local variable '" + name + "' referenced before assignment");
+        }
+        return value;
+    }
+
+    void store(const VarRef& ref, const std::string& name, Object* value) {
+        switch (ref.kind) {
+        case VAR_LOCAL:
+            frame[ref.slot] = value;
+            break;
+        case VAR_CELL:
+        case VAR_FREE:
+            static_cast<Cell*>(frame[ref.slot])->value = value;
+            break;
+        default:
+            store_global(ref, name, value);
+        }
+    }
+
+    Object* load_global(const VarRef& ref, const std::string& name) {
+        GlobalCache& cache = lookup_global(ref, name);
+        if (cache.value != nullptr) {
+            return *cache.value;
+        }
+        // a top-level def used as a value
+        if (cache.function != nullptr) {
+            return cache.function;
+        }
+        throw std::runtime_error("name '" + name + "' is not defined");
+    }
+
+    void store_global(const VarRef& ref, const std::string& name, Object* value) {
+        GlobalCache& cache = lookup_global(ref, name);
+        if (cache.value != nullptr) {
+            *cache.value = value;
+        }
+        else {
+            // compiled code calls a def it found directly
+            if (cache.function != nullptr) {
+                jit.invalidate();
+            }
+            global_env->set(name, value);
+        }
+    }
+
+    // The inline cache of a global reference, refilled if the namespace
+    // changed since it was filled (or it was filled for another module).
+    GlobalCache& lookup_global(const VarRef& ref, const std::string& name) {
+        GlobalCache& cache = ref.cache;
+        if (cache.env != global_env || cache.version != global_env->version) {
+            cache.env = global_env;
+            cache.version = global_env->version;
+            cache.value = global_env->find(name);
+            cache.function = global_env->get_function(name);
+            cache.builtin = cache.value == nullptr && cache.function == nullptr ? Builtins::find(name) : nullptr;
+        }
+        return cache;
+    }
 
     void error() {
         throw std::runtime_error("Error interpreter");
     }
 };
 
+#include "generator.h"
+#include "compiler.h"
+#include "parallel.h"
@@ -0,0 +1,762 @@
+#pragma once
+
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hashmap.h"
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+#include "environment.h"
+#include "object.h"
+#include "budget.h"
+
+// Baseline template JIT for hot integer functions (x86-64 System V only).
+//
+// Once a function has been called JIT_THRESHOLD times the interpreter asks
+// the JIT to compile it. Compilation covers the function and every function
+// it calls by name, as one group, and only succeeds if all of them stay
+// within a small typed subset:
+//
+//   - parameters, locals and results are ints or booleans, each name keeping
+//     one type; parameters are ints;
+//   - statements are assignments to locals, if/else, return and expression
+//     statements; every path ends in a return;
+//   - expressions are int/bool literals, locals, + - *, comparisons,
+//     and/or/not, unary minus and calls to other functions of the group
+//     with at most six arguments.
+//
+// Return types are found by iterating to a fixpoint over the group, so
+// recursive and mutually recursive functions type-check. Each node is then
+// translated by a fixed machine-code template: values live in eax,
+// temporaries are pushed on the machine stack, locals live in the native
+// frame and calls between compiled functions are direct native calls.
+//
+// The interpreter only enters compiled code when every argument is an
+// Integer; any other call, and every function the JIT refused, runs in the
+// interpreter as before. Rebinding a compiled function's name with a new def
+// throws all compiled code away.
+//
+// Calls between compiled functions do not pass through the interpreter, so
+// each compiled function checks the stack itself: below the thread's
+// stack_limit (budget.h) it jumps back to the Jit::call that entered
+// compiled code, which reports that the stack is full.
+
+enum JitType {
+    JIT_UNKNOWN, JIT_INT, JIT_BOOL,
+};
+
+typedef int64_t (*JitEntry)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t);
+
+// Thrown while analysing or compiling a function the JIT cannot handle.
+class JitBailout : public std::exception {
+public:
+    const char* what() const noexcept {
+        return "function not supported by the JIT";
+    }
+};
+
+// A function of the group being compiled.
+// The Jit::call running compiled code on this thread. Compiled frames have
+// nothing to clean up, so a function that finds the stack full drops them
+// all by jumping back to it.
+inline thread_local jmp_buf* jit_escape = nullptr;
+
+[[noreturn]] inline void jitOutOfStack() {
+    longjmp(*jit_escape, 1);
+}
+
+struct JitFunction {
+    Closure* closure;
+    Function* function;
+    JitType returns = JIT_UNKNOWN;
+    std::vector<JitType> slot_types;
+    size_t offset = 0;
+};
+
+typedef HashMap<Function*, JitFunction*> JitGroup;
+
+// Finds the callee of a call inside a function being compiled: a top-level
+// function of the same module. Adds it to the group when it is new.
+inline JitFunction* jitCallee(Call* expr, JitFunction* caller, JitGroup& group, std::vector<JitFunction*>& order) {
+    if (expr->object != nullptr || expr->ref.kind != VAR_GLOBAL || expr->args.size() > 6) {
+        throw JitBailout();
+    }
+    Closure* callee = caller->closure->globals->get_function(expr->callee.value);
+    if (callee == nullptr || !callee->cells.empty() || callee->function->params.size() != expr->args.size()) {
+        throw JitBailout();
+    }
+    if (JitFunction** known = group.find(callee->function)) {
+        return *known;
+    }
+    JitFunction* jf = new JitFunction();
+    jf->closure = callee;
+    jf->function = callee->function;
+    if (jf->function->jit_code != nullptr) {
+        jf->returns = jf->function->jit_returns_bool ? JIT_BOOL : JIT_INT;
+    }
+    group.set(callee->function, jf);
+    order.push_back(jf);
+    return jf;
+}
+
+// Type analysis of one function of the group. In the optimistic passes a
+// call to a function whose return type is not known yet has type UNKNOWN;
+// the strict pass requires every type to be known.
+class JitAnalysis : Visitor<void> {
+public:
+    JitAnalysis(JitGroup& group, std::vector<JitFunction*>& order) : group(group), order(order) {}
+
+    void analyze(JitFunction* jf, bool strict) {
+        this->jf = jf;
+        this->strict = strict;
+        Function* f = jf->function;
+        if (f->params.size() > 6 || !f->cells.empty() || f->num_slots != f->free_base) {
+            throw JitBailout();
+        }
+        jf->slot_types.assign(f->num_slots, JIT_UNKNOWN);
+        assigned.assign(f->num_slots, false);
+        for (size_t i = 0; i < f->params.size(); i++) {
+            jf->slot_types[i] = JIT_INT;
+            assigned[i] = true;
+        }
+        bool returns = false;
+        for (Statement* s : f->body) {
+            s->accept(this);
+            returns = returns || done;
+        }
+        if (!returns) {
+            // falling off the end returns None
+            throw JitBailout();
+        }
+    }
+
+private:
+    JitGroup& group;
+    std::vector<JitFunction*>& order;
+    JitFunction* jf = nullptr;
+    bool strict = false;
+    // type of the last expression visited
+    JitType type = JIT_UNKNOWN;
+    // locals definitely assigned at this point
+    std::vector<bool> assigned;
+    // the last statement always returns
+    bool done = false;
+
+    JitType typeOf(Expr* expr) {
+        expr->accept(this);
+        if (strict && type == JIT_UNKNOWN) {
+            throw JitBailout();
+        }
+        return type;
+    }
+
+    void expect(JitType actual, JitType wanted) {
+        if (actual != JIT_UNKNOWN && actual != wanted) {
+            throw JitBailout();
+        }
+    }
+
+    void unify(JitType& slot, JitType actual) {
+        if (actual == JIT_UNKNOWN) {
+            return;
+        }
+        if (slot != JIT_UNKNOWN && slot != actual) {
+            throw JitBailout();
+        }
+        slot = actual;
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        if (stmt->ref.kind != VAR_LOCAL) {
+            throw JitBailout();
+        }
+        unify(jf->slot_types[stmt->ref.slot], typeOf(stmt->initial));
+        assigned[stmt->ref.slot] = true;
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        bool any = false;
+        for (Statement* s : stmt->statements) {
+            s->accept(this);
+            any = any || done;
+        }
+        done = any;
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        typeOf(stmt->expr);
+        done = false;
+    };
+
+    void visitIfStmt(If* stmt) override {
+        expect(typeOf(stmt->condition), JIT_BOOL);
+
+        std::vector<bool> before = assigned;
+        stmt->thenBranch->accept(this);
+        bool then_done = done;
+        std::vector<bool> after_then = assigned;
+
+        assigned = before;
+        bool else_done = false;
+        if (stmt->elseBranch != nullptr) {
+            stmt->elseBranch->accept(this);
+            else_done = done;
+        }
+        // a branch that returns does not constrain what follows
+        if (else_done && !then_done) {
+            assigned = after_then;
+        }
+        else if (!then_done) {
+            for (size_t i = 0; i < assigned.size(); i++) {
+                assigned[i] = assigned[i] && after_then[i];
+            }
+        }
+        done = then_done && else_done;
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        if (stmt->value == nullptr) {
+            throw JitBailout();
+        }
+        unify(jf->returns, typeOf(stmt->value));
+        done = true;
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        JitType lhs = typeOf(expr->left);
+        JitType rhs = typeOf(expr->right);
+        switch (expr->op.type) {
+        case PLUS:
+        case MINUS:
+        case MULTIPLY:
+            expect(lhs, JIT_INT);
+            expect(rhs, JIT_INT);
+            type = JIT_INT;
+            return;
+        case LESS_THAN:
+        case LESS_THAN_EQUAL_TO:
+        case GREATER_THAN:
+        case GREATER_THAN_EQUAL_TO:
+            expect(lhs, JIT_INT);
+            expect(rhs, JIT_INT);
+            type = JIT_BOOL;
+            return;
+        case EQUAL_TO:
+        case NOT_EQUAL_TO:
+            if (lhs != JIT_UNKNOWN && rhs != JIT_UNKNOWN && lhs != rhs) {
+                throw JitBailout();
+            }
+            type = JIT_BOOL;
+            return;
+        default:
+            throw JitBailout();
+        }
+    };
+
+    void visitCallExpr(Call* expr) override {
+        JitFunction* callee = jitCallee(expr, jf, group, order);
+        for (Expr* a : expr->args) {
+            expect(typeOf(a), JIT_INT);
+        }
+        type = callee->returns;
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        type = typeOf(expr->expression);
+    };
+
+    // compiled as the call
+    void visitInlineExpr(Inline* expr) override {
+        visitCallExpr(expr->call);
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        switch (expr->token.type) {
+        case NUMBER:
+            type = JIT_INT;
+            return;
+        case TRUE:
+        case FALSE:
+            type = JIT_BOOL;
+            return;
+        case IDENTIFIER:
+            if (expr->ref.kind != VAR_LOCAL || !assigned[expr->ref.slot]) {
+                throw JitBailout();
+            }
+            type = jf->slot_types[expr->ref.slot];
+            return;
+        default:
+            throw JitBailout();
+        }
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        expect(typeOf(expr->condition), JIT_BOOL);
+        JitType value = JIT_UNKNOWN;
+        unify(value, typeOf(expr->thenBranch));
+        unify(value, typeOf(expr->elseBranch));
+        type = value;
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        expect(typeOf(expr->left), JIT_BOOL);
+        expect(typeOf(expr->right), JIT_BOOL);
+        type = JIT_BOOL;
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        JitType operand = typeOf(expr->right);
+        if (expr->op.type == MINUS) {
+            expect(operand, JIT_INT);
+            type = JIT_INT;
+        }
+        else {
+            expect(operand, JIT_BOOL);
+            type = JIT_BOOL;
+        }
+    };
+
+    void visitForStmt(For* stmt) override { throw JitBailout(); };
+    void visitFunctionStmt(Function* stmt) override { throw JitBailout(); };
+    void visitGlobalStmt(Global* stmt) override { throw JitBailout(); };
+    void visitImportStmt(Import* stmt) override { throw JitBailout(); };
+    void visitNonlocalStmt(Nonlocal* stmt) override { throw JitBailout(); };
+    void visitPrintStatement(Print* stmt) override { throw JitBailout(); };
+    void visitYieldStmt(Yield* stmt) override { throw JitBailout(); };
+    void visitAssignExpr(Assign* expr) override { throw JitBailout(); };
+    void visitDictLiteralExpr(DictLiteral* expr) override { throw JitBailout(); };
+    void visitGetExpr(Get* expr) override { throw JitBailout(); };
+    void visitListLiteralExpr(ListLiteral* expr) override { throw JitBailout(); };
+    void visitSetItemExpr(SetItem* expr) override { throw JitBailout(); };
+    void visitSubscriptExpr(Subscript* expr) override { throw JitBailout(); };
+    void visitVariableExpr(Variable* expr) override { throw JitBailout(); };
+};
+
+// x86-64 machine code templates for an analysed group.
+class JitCodegen : Visitor<void> {
+public:
+    std::vector<uint8_t> code;
+    // offsets of the 64-bit immediates of calls, and who they call
+    std::vector<std::pair<size_t, JitFunction*>> calls;
+
+    JitCodegen(JitGroup& group, std::vector<JitFunction*>& order) : group(group), order(order) {}
+
+    void compile(JitFunction* jf) {
+        this->jf = jf;
+        Function* f = jf->function;
+        jf->offset = code.size();
+
+        // push rbp; mov rbp, rsp; sub rsp, frame
+        emit({ 0x55, 0x48, 0x89, 0xE5, 0x48, 0x81, 0xEC });
+        emit32((int32_t)((f->num_slots * 8 + 15) & ~15));
+
+        // cmp rsp, fs:[stack_limit]; jae past; and rsp, -16;
+        // mov rax, jitOutOfStack; call rax; past:
+        emit({ 0x64, 0x48, 0x3B, 0x24, 0x25 });
+        emit32(threadOffset(&stack_limit));
+        emit({ 0x73, 0x10, 0x48, 0x83, 0xE4, 0xF0, 0x48, 0xB8 });
+        emit64((uint64_t)&jitOutOfStack);
+        emit({ 0xFF, 0xD0 });
+
+        // mov [rbp + slot], <i-th argument register>
+        for (size_t i = 0; i < f->params.size(); i++) {
+            emit({ (uint8_t)(i < 4 ? 0x48 : 0x4C), 0x89, (uint8_t)(0x85 | (ARG_REGS[i] << 3)) });
+            emit32(slotOffset((int)i));
+        }
+
+        for (Statement* s : f->body) {
+            s->accept(this);
+        }
+        // unreachable: every path returned
+        emit({ 0x0F, 0x0B });
+    }
+
+private:
+    JitGroup& group;
+    std::vector<JitFunction*>& order;
+    JitFunction* jf = nullptr;
+
+    // rdi, rsi, rdx, rcx, r8, r9 (the last two need a REX prefix)
+    static constexpr uint8_t ARG_REGS[6] = { 7, 6, 2, 1, 0, 1 };
+
+    void emit(std::initializer_list<uint8_t> bytes) {
+        code.insert(code.end(), bytes);
+    }
+
+    void emit32(int32_t value) {
+        uint8_t bytes[4];
+        std::memcpy(bytes, &value, 4);
+        code.insert(code.end(), bytes, bytes + 4);
+    }
+
+    void emit64(uint64_t value) {
+        emit32((int32_t)(uint32_t)value);
+        emit32((int32_t)(uint32_t)(value >> 32));
+    }
+
+    // The fs-relative offset of a thread_local of the executable, which is
+    // the same on every thread.
+    static int32_t threadOffset(const void* var) {
+#if defined(__x86_64__) && defined(__linux__)
+        uintptr_t self;
+        asm("mov %%fs:0, %0" : "=r"(self));
+        return (int32_t)((intptr_t)var - (intptr_t)self);
+#else
+        return 0;
+#endif
+    }
+
+    static int32_t slotOffset(int slot) {
+        return -8 * (slot + 1);
+    }
+
+    // jz/jnz/jmp with a rel32 to patch later
+    size_t jump(std::initializer_list<uint8_t> opcode) {
+        emit(opcode);
+        size_t at = code.size();
+        emit32(0);
+        return at;
+    }
+
+    void bind(size_t at) {
+        int32_t rel = (int32_t)(code.size() - (at + 4));
+        std::memcpy(&code[at], &rel, 4);
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        stmt->initial->accept(this);
+        // mov [rbp + slot], eax
+        emit({ 0x89, 0x85 });
+        emit32(slotOffset(stmt->ref.slot));
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        for (Statement* s : stmt->statements) {
+            s->accept(this);
+        }
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        stmt->expr->accept(this);
+    };
+
+    void visitIfStmt(If* stmt) override {
+        stmt->condition->accept(this);
+        // test eax, eax; jz else
+        emit({ 0x85, 0xC0 });
+        size_t to_else = jump({ 0x0F, 0x84 });
+        stmt->thenBranch->accept(this);
+        size_t to_end = jump({ 0xE9 });
+        bind(to_else);
+        if (stmt->elseBranch != nullptr) {
+            stmt->elseBranch->accept(this);
+        }
+        bind(to_end);
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        stmt->value->accept(this);
+        // leave; ret
+        emit({ 0xC9, 0xC3 });
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        expr->left->accept(this);
+        // push rax
+        emit({ 0x50 });
+        expr->right->accept(this);
+        // mov ecx, eax; pop rax
+        emit({ 0x89, 0xC1, 0x58 });
+        uint8_t setcc = 0;
+        switch (expr->op.type) {
+        case PLUS:
+            emit({ 0x01, 0xC8 });
+            return;
+        case MINUS:
+            emit({ 0x29, 0xC8 });
+            return;
+        case MULTIPLY:
+            emit({ 0x0F, 0xAF, 0xC1 });
+            return;
+        case LESS_THAN: setcc = 0x9C; break;
+        case LESS_THAN_EQUAL_TO: setcc = 0x9E; break;
+        case GREATER_THAN: setcc = 0x9F; break;
+        case GREATER_THAN_EQUAL_TO: setcc = 0x9D; break;
+        case EQUAL_TO: setcc = 0x94; break;
+        case NOT_EQUAL_TO: setcc = 0x95; break;
+        default:
+            throw JitBailout();
+        }
+        // cmp eax, ecx; setcc al; movzx eax, al
+        emit({ 0x39, 0xC8, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0 });
+    };
+
+    void visitCallExpr(Call* expr) override {
+        JitFunction* callee = jitCallee(expr, jf, group, order);
+        for (Expr* a : expr->args) {
+            a->accept(this);
+            emit({ 0x50 });
+        }
+        // pop the arguments into the argument registers, last one first
+        for (size_t i = expr->args.size(); i-- > 0; ) {
+            if (i >= 4) {
+                emit({ 0x41 });
+            }
+            emit({ (uint8_t)(0x58 + ARG_REGS[i]) });
+        }
+        // mov rax, imm64; call rax
+        emit({ 0x48, 0xB8 });
+        calls.push_back(std::make_pair(code.size(), callee));
+        emit32(0);
+        emit32(0);
+        emit({ 0xFF, 0xD0 });
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        expr->expression->accept(this);
+    };
+
+    void visitInlineExpr(Inline* expr) override {
+        visitCallExpr(expr->call);
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        switch (expr->token.type) {
+        case NUMBER:
+            // mov eax, imm32
+            emit({ 0xB8 });
+            emit32((int32_t)std::stoi(expr->token.value));
+            return;
+        case TRUE:
+            emit({ 0xB8, 0x01, 0x00, 0x00, 0x00 });
+            return;
+        case FALSE:
+            emit({ 0x31, 0xC0 });
+            return;
+        default:
+            // mov eax, [rbp + slot]
+            emit({ 0x8B, 0x85 });
+            emit32(slotOffset(expr->ref.slot));
+        }
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        expr->condition->accept(this);
+        // test eax, eax; jz else
+        emit({ 0x85, 0xC0 });
+        size_t to_else = jump({ 0x0F, 0x84 });
+        expr->thenBranch->accept(this);
+        size_t to_end = jump({ 0xE9 });
+        bind(to_else);
+        expr->elseBranch->accept(this);
+        bind(to_end);
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        expr->left->accept(this);
+        // test eax, eax; jz/jnz end -- the left operand decides
+        emit({ 0x85, 0xC0 });
+        size_t to_end = jump({ 0x0F, (uint8_t)(expr->op.type == AND ? 0x84 : 0x85) });
+        expr->right->accept(this);
+        bind(to_end);
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        expr->right->accept(this);
+        if (expr->op.type == MINUS) {
+            // neg eax
+            emit({ 0xF7, 0xD8 });
+        }
+        else {
+            // xor eax, 1
+            emit({ 0x83, 0xF0, 0x01 });
+        }
+    };
+
+    void visitForStmt(For* stmt) override { throw JitBailout(); };
+    void visitFunctionStmt(Function* stmt) override { throw JitBailout(); };
+    void visitGlobalStmt(Global* stmt) override { throw JitBailout(); };
+    void visitImportStmt(Import* stmt) override { throw JitBailout(); };
+    void visitNonlocalStmt(Nonlocal* stmt) override { throw JitBailout(); };
+    void visitPrintStatement(Print* stmt) override { throw JitBailout(); };
+    void visitYieldStmt(Yield* stmt) override { throw JitBailout(); };
+    void visitAssignExpr(Assign* expr) override { throw JitBailout(); };
+    void visitDictLiteralExpr(DictLiteral* expr) override { throw JitBailout(); };
+    void visitGetExpr(Get* expr) override { throw JitBailout(); };
+    void visitListLiteralExpr(ListLiteral* expr) override { throw JitBailout(); };
+    void visitSetItemExpr(SetItem* expr) override { throw JitBailout(); };
+    void visitSubscriptExpr(Subscript* expr) override { throw JitBailout(); };
+    void visitVariableExpr(Variable* expr) override { throw JitBailout(); };
+};
+
+class Jit {
+public:
+    static const int JIT_THRESHOLD = 1000;
+
+#if defined(__x86_64__) && defined(__linux__)
+    bool enabled = true;
+#else
+    bool enabled = false;
+#endif
+
+    ~Jit() {
+        if (perf_map != nullptr) {
+            std::fclose(perf_map);
+        }
+    }
+
+    // Compiles closure's function and its callees. Returns false, and marks
+    // the function so it is not tried again, if any of them is unsupported.
+    bool compile(Closure* closure) {
+        Function* f = closure->function;
+        JitGroup group;
+        std::vector<JitFunction*> order;
+        JitFunction* root = new JitFunction();
+        root->closure = closure;
+        root->function = f;
+        group.set(f, root);
+        order.push_back(root);
+
+        bool ok = true;
+        try {
+            analyze(group, order);
+            install(group, order);
+        }
+        catch (JitBailout&) {
+            f->jit_failed = true;
+            ok = false;
+        }
+        for (JitFunction* jf : order) {
+            delete jf;
+        }
+        return ok;
+    }
+
+    // Runs f's compiled code; null if it ran out of stack.
+    static Object* call(Function* f, Object** args) {
+        int64_t a[6] = { 0, 0, 0, 0, 0, 0 };
+        for (size_t i = 0; i < f->params.size(); i++) {
+            a[i] = static_cast<Integer*>(args[i])->value;
+        }
+        jmp_buf escape;
+        jmp_buf* outer = jit_escape;
+        jit_escape = &escape;
+        if (setjmp(escape) != 0) {
+            jit_escape = outer;
+            return nullptr;
+        }
+        int result = (int)((JitEntry)f->jit_code)(a[0], a[1], a[2], a[3], a[4], a[5]);
+        jit_escape = outer;
+        if (f->jit_returns_bool) {
+            return new Boolean(result != 0);
+        }
+        return new Integer(result);
+    }
+
+    // A compiled function's name was rebound; the direct calls baked into
+    // compiled code may now be wrong.
+    void invalidate() {
+        for (Function* f : compiled) {
+            f->jit_code = nullptr;
+            f->calls = 0;
+        }
+        compiled.clear();
+    }
+
+    bool hasCompiled(Function* f) {
+        return f->jit_code != nullptr;
+    }
+
+private:
+    std::vector<Function*> compiled;
+    FILE* perf_map = nullptr;
+
+    void analyze(JitGroup& group, std::vector<JitFunction*>& order) {
+        JitAnalysis analysis(group, order);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            // order grows as calls are discovered
+            for (size_t i = 0; i < order.size(); i++) {
+                if (order[i]->function->jit_code != nullptr) {
+                    continue;
+                }
+                JitType before = order[i]->returns;
+                analysis.analyze(order[i], false);
+                changed = changed || order[i]->returns != before;
+            }
+        }
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i]->function->jit_code == nullptr) {
+                analysis.analyze(order[i], true);
+            }
+            if (order[i]->returns == JIT_UNKNOWN) {
+                throw JitBailout();
+            }
+        }
+    }
+
+    void install(JitGroup& group, std::vector<JitFunction*>& order) {
+#if defined(__x86_64__) && defined(__linux__)
+        JitCodegen codegen(group, order);
+        std::vector<JitFunction*> fresh;
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i]->function->jit_code == nullptr) {
+                fresh.push_back(order[i]);
+                codegen.compile(order[i]);
+            }
+        }
+
+        size_t size = codegen.code.size();
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            throw JitBailout();
+        }
+        uint8_t* base = (uint8_t*)mem;
+        std::memcpy(base, codegen.code.data(), size);
+        for (auto& call : codegen.calls) {
+            JitFunction* target = call.second;
+            uint64_t address = target->function->jit_code != nullptr
+                ? (uint64_t)target->function->jit_code
+                : (uint64_t)(base + target->offset);
+            std::memcpy(base + call.first, &address, 8);
+        }
+        if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(mem, size);
+            throw JitBailout();
+        }
+
+        for (size_t i = 0; i < fresh.size(); i++) {
+            JitFunction* jf = fresh[i];
+            size_t end = i + 1 < fresh.size() ? fresh[i + 1]->offset : size;
+            jf->function->jit_code = base + jf->offset;
+            jf->function->jit_returns_bool = jf->returns == JIT_BOOL;
+            compiled.push_back(jf->function);
+            writePerfMap(base + jf->offset, end - jf->offset, jf->function->name.value);
+        }
+#else
+        throw JitBailout();
+#endif
+    }
+
+    // /tmp/perf-<pid>.map lets perf symbolize samples in compiled code.
+    void writePerfMap(void* start, size_t size, const std::string& name) {
+        if (perf_map == nullptr) {
+            std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+            perf_map = std::fopen(path.c_str(), "a");
+            if (perf_map == nullptr) {
+                return;
+            }
+        }
+        std::fprintf(perf_map, "%lx %zx py::%s\n", (unsigned long)start, size, name.c_str());
+        std::fflush(perf_map);
+    }
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "hashmap.h"
+#include "statement.h"
+
+// Line profiler (--line-profile).
+//
+// While it runs, the tree walker reports every statement it starts and
+// finishes. The time between two such events is charged to the statement
+// that was running, so a line's time is its self time: a call on it counts
+// the evaluation of the call, and the callee's lines their own. The blocks
+// of if and for have no line and are not timed, and an if or for statement
+// is charged for its condition or iterating, not for its body. A generator
+// runs its own loops and yields (generator.h), so those go to the line that
+// resumed it. Time is read from the steady clock at every start and finish,
+// which about doubles the time a short statement takes; the report is about
+// where the time goes, not how much there is.
+//
+// Statements are counted by node and summed by line for the report; the
+// statements of imported modules, which are not in the script, make one
+// line of their own. Only the tree walker reports statements: the JIT, the
+// closure engine and specialization (which runs copies of the AST) are off
+// while profiling lines, and parallel_map runs serially.
+
+class LineProfiler {
+public:
+    // Starts timing stmt and returns what to give leave() when it is done.
+    size_t enter(Statement* stmt) {
+        if (stmt->line == 0) {
+            return cursor;
+        }
+        size_t outer = cursor;
+        charge();
+        cursor = counts(stmt);
+        entries[cursor].hits++;
+        return outer;
+    }
+
+    // Finishes the statement entered last, going back to the one it
+    // interrupted.
+    void leave(size_t outer) {
+        charge();
+        cursor = outer;
+    }
+
+    void start() {
+        last = std::chrono::steady_clock::now();
+    }
+
+    // Times one statement for as long as it is in scope.
+    class Timer {
+    public:
+        Timer(LineProfiler* profiler, Statement* stmt) : profiler(profiler), outer(profiler->enter(stmt)) {}
+        ~Timer() {
+            profiler->leave(outer);
+        }
+
+    private:
+        LineProfiler* profiler;
+        size_t outer;
+    };
+
+    // Writes the lines of the script, as parsed into program and read from
+    // source, ordered by the time spent on them.
+    void report(const std::vector<Statement*>& program, const std::string& source, std::ostream& out) {
+        HashMap<Statement*, bool> script;
+        collect(program, script);
+
+        std::vector<Line> lines;
+        std::vector<size_t> line_index;
+        Line modules;
+        uint64_t total = 0;
+        for (auto& e : index) {
+            Counts& c = entries[e.value];
+            total += c.ns;
+            if (!script.contains(e.key)) {
+                modules.hits += c.hits;
+                modules.ns += c.ns;
+                continue;
+            }
+            uint32_t n = e.key->line;
+            if (n >= line_index.size()) {
+                line_index.resize(n + 1, NONE);
+            }
+            if (line_index[n] == NONE) {
+                line_index[n] = lines.size();
+                lines.push_back(Line{ n });
+            }
+            Line& line = lines[line_index[n]];
+            line.hits += c.hits;
+            line.ns += c.ns;
+        }
+        std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) {
+            return a.ns != b.ns ? a.ns > b.ns : a.number < b.number;
+        });
+
+        std::vector<std::string> text = split(source);
+        char row[96];
+        std::snprintf(row, sizeof(row), "line profile: %.3f ms in %zu lines\n", total / 1e6, lines.size());
+        out << row;
+        std::snprintf(row, sizeof(row), "%6s %12s %12s %7s  %s\n", "line", "hits", "ms", "time%", "source");
+        out << row;
+        double all = std::max<double>(total, 1);
+        for (Line& line : lines) {
+            std::snprintf(row, sizeof(row), "%6u %12llu %12.3f %6.1f%%  ", line.number, (unsigned long long)line.hits,
+                          line.ns / 1e6, 100 * line.ns / all);
+            out << row << (line.number <= text.size() ? text[line.number - 1] : "") << "\n";
+        }
+        if (modules.hits != 0) {
+            std::snprintf(row, sizeof(row), "%6s %12llu %12.3f %6.1f%%  ", "-", (unsigned long long)modules.hits,
+                          modules.ns / 1e6, 100 * modules.ns / all);
+            out << row << "(imported modules)\n";
+        }
+    }
+
+private:
+    struct Counts {
+        uint64_t hits = 0;
+        uint64_t ns = 0;
+    };
+
+    struct Line {
+        uint32_t number = 0;
+        uint64_t hits = 0;
+        uint64_t ns = 0;
+    };
+
+    // the counts of each statement seen, by node
+    HashMap<Statement*, size_t> index;
+    std::vector<Counts> entries;
+    static constexpr size_t NONE = SIZE_MAX;
+
+    // the counts of the statement running
+    size_t cursor = NONE;
+    std::chrono::steady_clock::time_point last;
+
+    size_t counts(Statement* stmt) {
+        if (size_t* i = index.find(stmt)) {
+            return *i;
+        }
+        index.set(stmt, entries.size());
+        entries.push_back(Counts());
+        return entries.size() - 1;
+    }
+
+    void charge() {
+        auto now = std::chrono::steady_clock::now();
+        if (cursor != NONE) {
+            entries[cursor].ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+        }
+        last = now;
+    }
+
+    // Adds stmts and every statement nested in them to script.
+    static void collect(const std::vector<Statement*>& stmts, HashMap<Statement*, bool>& script) {
+        for (Statement* s : stmts) {
+            collect(s, script);
+        }
+    }
+
+    static void collect(Statement* stmt, HashMap<Statement*, bool>& script) {
+        if (stmt == nullptr) {
+            return;
+        }
+        script.set(stmt, true);
+        if (Block* b = dynamic_cast<Block*>(stmt)) {
+            collect(b->statements, script);
+        }
+        else if (For* f = dynamic_cast<For*>(stmt)) {
+            collect(f->body, script);
+        }
+        else if (If* i = dynamic_cast<If*>(stmt)) {
+            collect(i->thenBranch, script);
+            collect(i->elseBranch, script);
+        }
+        else if (Function* f = dynamic_cast<Function*>(stmt)) {
+            collect(f->body, script);
+        }
+    }
+
+    static std::vector<std::string> split(const std::string& source) {
+        std::vector<std::string> lines;
+        size_t from = 0;
+        while (from <= source.size()) {
+            size_t to = source.find('\n', from);
+            if (to == std::string::npos) {
+                to = source.size();
+            }
+            std::string line = source.substr(from, to - from);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            lines.push_back(line);
+            from = to + 1;
+        }
+        return lines;
+    }
+};
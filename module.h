@@ -0,0 +1,126 @@
+#pragma once
+
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "hashmap.h"
+#include "scanner.h"
+#include "parser.h"
+#include "resolver.h"
+#include "statement.h"
+
+// A module's source after scanning, parsing and resolving. The statements
+// are a template: importers run a copy of them (AstCloner), so they are
+// never modified after the module is cached and can be shared by any
+// number of interpreters and threads.
+struct CompiledModule {
+    std::string path;
+    struct timespec mtime;
+    std::vector<Statement*> statements;
+};
+
+// Process-wide cache of compiled modules, keyed by path and validated by
+// modification time, so a module imported from many places (or by several
+// interpreters) is read and parsed once. A file that changed on disk since
+// it was cached is compiled again.
+class ModuleCache {
+public:
+    static ModuleCache& instance() {
+        static ModuleCache cache;
+        return cache;
+    }
+
+    CompiledModule* load(const std::string& path) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            throw std::runtime_error("cannot open module '" + path + "'");
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        CompiledModule** cached = modules.find(path);
+        if (cached != nullptr && sameTime((*cached)->mtime, st.st_mtim)) {
+            return *cached;
+        }
+
+        std::ifstream file(path);
+        std::string code((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        Scanner scan(code);
+        Parser parser(scan.getTokens());
+
+        CompiledModule* module = new CompiledModule();
+        module->path = path;
+        module->mtime = st.st_mtim;
+        module->statements = parser.parse();
+        Resolver resolver;
+        resolver.resolve(module->statements);
+
+        modules.set(path, module);
+        compiles++;
+        return module;
+    }
+
+    // number of times a module source was parsed
+    size_t compileCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return compiles;
+    }
+
+private:
+    std::mutex mutex;
+    HashMap<std::string, CompiledModule*> modules;
+    size_t compiles = 0;
+
+    ModuleCache() {}
+
+    static bool sameTime(const struct timespec& a, const struct timespec& b) {
+        return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+    }
+};
+
+// Resolves module names against a list of directories: the directory of the
+// main script first, then each entry of $MYPYTHONPATH.
+class ModulePath {
+public:
+    std::vector<std::string> dirs;
+
+    void addScript(const std::string& script) {
+        size_t slash = script.find_last_of('/');
+        dirs.push_back(slash == std::string::npos ? "." : script.substr(0, slash));
+    }
+
+    void addEnvironment(const char* value) {
+        if (value == nullptr) {
+            return;
+        }
+        std::string paths = value;
+        size_t start = 0;
+        while (start <= paths.size()) {
+            size_t end = paths.find(':', start);
+            if (end == std::string::npos) {
+                end = paths.size();
+            }
+            if (end > start) {
+                dirs.push_back(paths.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+    }
+
+    std::string find(const std::string& name) {
+        for (auto& dir : dirs) {
+            std::string path = dir + "/" + name + ".py";
+            char resolved[PATH_MAX];
+            if (realpath(path.c_str(), resolved) != nullptr) {
+                return resolved;
+            }
+        }
+        throw std::runtime_error("No module named '" + name + "'");
+    }
+};
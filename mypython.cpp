@@ -3,49 +3,194 @@
 #include <vector>
 #include <cctype>
 #include <algorithm>
+#include <cstdlib>
+#include <thread>
 #include <fstream>
+#include <iterator>
 
 #include "scanner.h"
 #include "parser.h"
 #include "statement.h"
 #include "printer.h"
+#include "resolver.h"
 #include "interpreter.h"
+#include "runner.h"
 
-std::string openFile(std::string filename) {
-    std::ifstream file;
-    file.open(filename);
-
-    std::string contents;
-    while (file.good()) {
-        char c;
-        file.get(c);
-        contents += c;
+// Sets the limit of a --max-steps=N, --max-ms=N, --max-memory=N[K|M|G] or
+// --max-depth=N flag. Returns false if the flag or its value is not valid.
+static bool limitFlag(const std::string& arg, RunOptions& options) {
+    size_t eq = arg.find('=');
+    if (eq == std::string::npos || eq + 1 == arg.size()) {
+        return false;
+    }
+    std::string name = arg.substr(0, eq);
+    char* end;
+    uint64_t value = std::strtoull(arg.c_str() + eq + 1, &end, 10);
+    std::string suffix = end;
+    if (name == "--max-memory" && !suffix.empty()) {
+        if (suffix == "K") {
+            value <<= 10;
+        }
+        else if (suffix == "M") {
+            value <<= 20;
+        }
+        else if (suffix == "G") {
+            value <<= 30;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (!suffix.empty() || !std::isdigit((unsigned char)arg[eq + 1])) {
+        return false;
     }
 
-    file.close();
-    return contents;
+    if (name == "--max-steps") {
+        options.max_steps = value;
+    }
+    else if (name == "--max-ms") {
+        options.max_ms = value;
+    }
+    else if (name == "--max-memory") {
+        options.max_memory = value;
+    }
+    else if (name == "--max-depth") {
+        options.max_depth = value;
+    }
+    else {
+        return false;
+    }
+    return true;
 }
 
 // Main function
 int main(int argc, char * argv[]) {
-    if (argc != 2) {
-        std::cout << "usage: mypython <file.py>\n";
+    std::string filename;
+    std::string batch;
+    unsigned jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    RunOptions options;
+    FlightRecorder::catchFatal();
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--jit") {
+            options.use_jit = true;
+        }
+        else if (arg == "--no-jit") {
+            options.use_jit = false;
+        }
+        else if (arg == "--no-specialize") {
+            options.specialize = false;
+        }
+        else if (arg == "--engine=walk") {
+            options.engine = ENGINE_WALK;
+        }
+        else if (arg == "--engine=closure") {
+            options.engine = ENGINE_CLOSURE;
+        }
+        else if (arg == "--batch" && i + 1 < argc) {
+            batch = argv[++i];
+        }
+        else if (arg == "-j" && i + 1 < argc) {
+            jobs = (unsigned)std::max(std::atoi(argv[++i]), 1);
+        }
+        else if (arg.compare(0, 6, "--max-") == 0 && limitFlag(arg, options)) {
+            continue;
+        }
+        else if (arg == "--profile") {
+            options.profile = "profile.folded";
+        }
+        else if (arg.compare(0, 10, "--profile=") == 0 && arg.size() > 10) {
+            options.profile = arg.substr(10);
+        }
+        else if (arg == "--alloc-profile") {
+            options.alloc_profile = 1;
+        }
+        else if (arg.compare(0, 16, "--alloc-profile=") == 0 && std::isdigit((unsigned char)arg[16])) {
+            options.alloc_profile = std::max<uint64_t>(std::strtoull(arg.c_str() + 16, nullptr, 10), 1);
+        }
+        else if (arg == "--line-profile") {
+            options.line_profile = true;
+        }
+        else if (arg == "--stats" || arg == "--stats=json") {
+            options.stats = true;
+            options.stats_json = arg == "--stats=json";
+        }
+        else if (arg == "--check") {
+            options.check = true;
+        }
+        else if (arg == "--no-typecheck") {
+            options.typecheck = false;
+        }
+        else if (arg == "--no-inline") {
+            options.inline_calls = false;
+        }
+        else if (arg == "--inline-report") {
+            options.inline_report = true;
+        }
+        else if (arg.compare(0, 15, "--snapshot-out=") == 0 && arg.size() > 15) {
+            options.snapshot_out = arg.substr(15);
+        }
+        else if (arg.compare(0, 14, "--snapshot-in=") == 0 && arg.size() > 14) {
+            options.snapshot_in = arg.substr(14);
+        }
+        else if (filename.empty() && arg[0] != '-') {
+            filename = arg;
+        }
+        else {
+            filename.clear();
+            batch.clear();
+            break;
+        }
+    }
+    // one timer per process, and reports go to stderr: only a single script
+    // can be profiled, and one that runs
+    bool profiling = !options.profile.empty() || options.alloc_profile != 0 || options.line_profile;
+    // a snapshot is of one script, and a resumed one has no source to
+    // check or profile against
+    bool resuming = !options.snapshot_in.empty();
+    bool snapshot = resuming || !options.snapshot_out.empty();
+    int sources = !filename.empty() + !batch.empty() + resuming;
+    if (sources != 1 || ((!batch.empty() || options.check) && profiling) ||
+        (snapshot && (!batch.empty() || options.check || profiling || (resuming && !options.snapshot_out.empty())))) {
+        std::cout << "usage: mypython [--jit | --no-jit] [--no-specialize] [--engine=walk|closure] [-j N]\n"
+                  << "                [--max-steps=N] [--max-ms=N] [--max-memory=N[K|M|G]] [--max-depth=N]\n"
+                  << "                [--profile[=file]] [--alloc-profile[=N]] [--line-profile] [--stats[=json]]\n"
+                  << "                [--check | --no-typecheck] [--no-inline | --inline-report]\n"
+                  << "                [--snapshot-out=image] <file.py>\n"
+                  << "       mypython [options] --snapshot-in=image\n"
+                  << "       mypython [options] --batch <dir | list-file> [-j N]\n";
         return 1;
     }
-    std::string filename = std::string(argv[1]);
-
-    //std::string filename = "./testcases/in08.py";
 
-    std::string code = openFile(filename);
-    Scanner scan(code);
-    Parser parser(scan.getTokens());
-    std::vector<Statement*> s = parser.parse();
-
-    //Printer printer;
-    //printer.print(s);
+    if (!batch.empty()) {
+        // the scripts already keep every thread busy
+        options.parallel_jobs = 1;
+        Output out;
+        size_t failed;
+        try {
+            BatchRunner runner;
+            failed = runner.run(BatchRunner::collect(batch), options, jobs, out);
+        }
+        catch (std::exception& e) {
+            out.flush();
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+        return failed == 0 ? 0 : 1;
+    }
 
+    options.parallel_jobs = jobs;
     Interpreter interpreter;
-    interpreter.run(s);
-
-    return 0;
+    std::string error;
+    RunStats stats;
+    bool ok = resuming ? resumeSnapshot(options, interpreter, error, options.stats ? &stats : nullptr)
+                       : runScript(filename, options, interpreter, error, options.stats ? &stats : nullptr);
+    interpreter.out.flush();
+    if (!ok) {
+        std::cerr << error << "\n";
+    }
+    if (options.stats) {
+        std::cerr << stats.format(options.stats_json);
+    }
+    return ok ? 0 : interpreter.budget.exitCode();
 }
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "token.h"
+#include "object.h"
+
+// Arithmetic on ints and floats, for both engines and the builtins.
+//
+// A Number is an int or a float out of its box. The engines work out a
+// nested arithmetic expression on Numbers and box only its final value, so
+// x * x + y * y allocates one object, not three. As in Python, an int meeting
+// a float is converted to float, / always gives a float and // rounds towards
+// minus infinity. Ints stay 32-bit and wrap on overflow, as before. Booleans
+// are not numbers here, as everywhere else in the interpreter.
+
+struct Number {
+    bool is_float = false;
+    int i = 0;
+    double f = 0;
+
+    static Number ofInt(int i) {
+        Number n;
+        n.i = i;
+        return n;
+    }
+
+    static Number ofFloat(double f) {
+        Number n;
+        n.is_float = true;
+        n.f = f;
+        return n;
+    }
+
+    double real() const {
+        return is_float ? f : i;
+    }
+};
+
+// Takes the number out of obj; false if obj is not an int or a float.
+inline bool unbox(Object* obj, Number& n) {
+    switch (obj->type()) {
+    case TYPE_INT:
+        n = Number::ofInt(static_cast<Integer*>(obj)->value);
+        return true;
+    case TYPE_FLOAT:
+        n = Number::ofFloat(static_cast<Float*>(obj)->value);
+        return true;
+    default:
+        return false;
+    }
+}
+
+inline Object* box(const Number& n) {
+    if (n.is_float) {
+        return new Float(n.f);
+    }
+    return new Integer(n.i);
+}
+
+inline bool isArithmetic(TokenType op) {
+    return op == PLUS || op == MINUS || op == MULTIPLY || op == DIVIDE || op == FLOOR_DIVIDE;
+}
+
+[[noreturn]] inline void divisionByZero(const char* what) {
+    throw std::runtime_error(std::string("ZeroDivisionError: ") + what);
+}
+
+inline int floorDivide(int a, int b) {
+    if (b == 0) {
+        divisionByZero("integer division or modulo by zero");
+    }
+    // INT_MIN / -1 traps; Python would give 2**31, we wrap like the other ops
+    if (b == -1) {
+        return (int)(0u - (unsigned)a);
+    }
+    int q = a / b;
+    if (q * b != a && (a < 0) != (b < 0)) {
+        q--;
+    }
+    return q;
+}
+
+// Python's float floor division: the quotient of the exact remainder, so
+// 0.7 // 0.1 is 6.0 like in Python, not 7.0.
+inline double floorDivide(double a, double b) {
+    if (b == 0) {
+        divisionByZero("float floor division by zero");
+    }
+    double mod = std::fmod(a, b);
+    double div = (a - mod) / b;
+    if (mod != 0 && (b < 0) != (mod < 0)) {
+        div -= 1;
+    }
+    if (div == 0) {
+        return std::copysign(0.0, a / b);
+    }
+    double floor = std::floor(div);
+    return div - floor > 0.5 ? floor + 1 : floor;
+}
+
+// a op b for an arithmetic op (isArithmetic).
+inline Number arithmetic(TokenType op, const Number& a, const Number& b) {
+    if (op == DIVIDE) {
+        double y = b.real();
+        if (y == 0) {
+            divisionByZero(a.is_float || b.is_float ? "float division by zero" : "division by zero");
+        }
+        return Number::ofFloat(a.real() / y);
+    }
+    if (!a.is_float && !b.is_float) {
+        switch (op) {
+        case PLUS: return Number::ofInt((int)((unsigned)a.i + (unsigned)b.i));
+        case MINUS: return Number::ofInt((int)((unsigned)a.i - (unsigned)b.i));
+        case MULTIPLY: return Number::ofInt((int)((unsigned)a.i * (unsigned)b.i));
+        default: return Number::ofInt(floorDivide(a.i, b.i));
+        }
+    }
+    double x = a.real();
+    double y = b.real();
+    switch (op) {
+    case PLUS: return Number::ofFloat(x + y);
+    case MINUS: return Number::ofFloat(x - y);
+    case MULTIPLY: return Number::ofFloat(x * y);
+    default: return Number::ofFloat(floorDivide(x, y));
+    }
+}
+
+// a op b for a comparison op. An int is compared with a float exactly, as
+// every int converts to a double without rounding.
+inline bool compare(TokenType op, const Number& a, const Number& b) {
+    if (!a.is_float && !b.is_float) {
+        switch (op) {
+        case EQUAL_TO: return a.i == b.i;
+        case NOT_EQUAL_TO: return a.i != b.i;
+        case GREATER_THAN: return a.i > b.i;
+        case LESS_THAN: return a.i < b.i;
+        case GREATER_THAN_EQUAL_TO: return a.i >= b.i;
+        default: return a.i <= b.i;
+        }
+    }
+    double x = a.real();
+    double y = b.real();
+    switch (op) {
+    case EQUAL_TO: return x == y;
+    case NOT_EQUAL_TO: return x != y;
+    case GREATER_THAN: return x > y;
+    case LESS_THAN: return x < y;
+    case GREATER_THAN_EQUAL_TO: return x >= y;
+    default: return x <= y;
+    }
+}
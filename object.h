@@ -1,17 +1,125 @@
 #pragma once
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <fstream>
+#include <stdexcept>
+#include "hashmap.h"
+#include "output.h"
 
 
+class Function;
+class Environment;
+
+// One bit per kind of value, so the types seen at a call site or parameter
+// can be or-ed together into a mask (type feedback, specialize.h).
+enum TypeBits : uint16_t {
+	TYPE_INT = 1, TYPE_FLOAT = 2, TYPE_BOOL = 4, TYPE_STRING = 8, TYPE_NONE = 16,
+	TYPE_LIST = 32, TYPE_DICT = 64, TYPE_FUNCTION = 128, TYPE_OTHER = 256,
+};
+// number of TypeBits, and their names in bit order
+const int TYPE_KINDS = 9;
+inline const char* const TYPE_NAMES[TYPE_KINDS] = {
+	"int", "float", "bool", "str", "None", "list", "dict", "function", "other",
+};
+
+// Bytes of Objects allocated and not freed by this thread, for the memory
+// budget (budget.h).
+inline thread_local size_t object_bytes = 0;
+// Objects allocated by this thread, indexed by the bit of their TypeBits
+// (--stats, stats.h)
+inline thread_local size_t objects_allocated[TYPE_KINDS] = {};
+
+// Sees some of the allocations of this thread while installed: one each
+// time countdown runs out, which sampled() resets (allocations.h).
+class AllocationHook {
+public:
+	int64_t countdown = 1;
+
+	virtual ~AllocationHook() {};
+	virtual void sampled(size_t size, uint16_t type) = 0;
+};
+
+inline thread_local AllocationHook* allocation_hook = nullptr;
+
+// Set while a memory budget runs on this thread (budget.h): an allocation
+// that would take object_bytes over object_limit calls object_over_limit,
+// which throws instead.
+inline thread_local size_t object_limit = SIZE_MAX;
+inline thread_local void (*object_over_limit)() = nullptr;
+
 class Object {
 public:
+	// subclasses with a type of their own count under it
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_OTHER);
+	}
+
+	static void* allocate(size_t size, uint16_t type) {
+		if (object_bytes + size > object_limit) {
+			object_over_limit();
+		}
+		object_bytes += size;
+		objects_allocated[__builtin_ctz(type)]++;
+		if (allocation_hook != nullptr && --allocation_hook->countdown == 0) {
+			allocation_hook->sampled(size, type);
+		}
+		return ::operator new(size);
+	}
+
+	static void operator delete(void* p, size_t size) {
+		object_bytes -= size;
+		::operator delete(p);
+	}
+
 	virtual ~Object() {};
 	virtual std::string toString() = 0;
+
+	virtual uint16_t type() {
+		return TYPE_OTHER;
+	}
+
+	// as a condition, and for and/or/not: false for zero, empty and None
+	virtual bool truthy() {
+		return true;
+	}
+
+	// print() formats through here; override to skip building a string
+	virtual void write(Output& out) {
+		out.write(toString());
+	}
+
+	// how the value prints inside a container, e.g. 'a' for a String
+	virtual std::string repr() {
+		return toString();
+	}
+
+	virtual size_t hash() {
+		throw std::runtime_error("unhashable type");
+	}
+
+	virtual bool equals(Object* other) {
+		return this == other;
+	}
+
+	virtual Object* getItem(Object* index) {
+		throw std::runtime_error("object is not subscriptable");
+	}
+
+	virtual void setItem(Object* index, Object* value) {
+		throw std::runtime_error("object does not support item assignment");
+	}
 };
 
 class Integer : public Object {
 public:
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_INT);
+	}
+
 	int value;
 
 	Integer(int value) {
@@ -22,6 +130,24 @@ public:
 		return std::to_string(value);
 	}
 
+	uint16_t type() {
+		return TYPE_INT;
+	}
+
+	bool truthy() {
+		return value != 0;
+	}
+
+	void write(Output& out) {
+		out.writeInt(value);
+	}
+
+	size_t hash() {
+		return std::hash<int>()(value);
+	}
+
+	bool equals(Object* other);
+
 	Integer operator+ (const Integer &rhs) const {
 		return Integer(this->value + rhs.value);
 	}
@@ -69,8 +195,52 @@ public:
 
 };
 
+class Float : public Object {
+public:
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_FLOAT);
+	}
+
+	double value;
+
+	Float(double value) {
+		this->value = value;
+	}
+
+	std::string toString() {
+		char text[FLOAT_CHARS];
+		return std::string(text, formatFloat(text, value));
+	}
+
+	uint16_t type() {
+		return TYPE_FLOAT;
+	}
+
+	bool truthy() {
+		return value != 0;
+	}
+
+	void write(Output& out) {
+		out.writeFloat(value);
+	}
+
+	// 2.0 == 2, so a whole float must hash like the Integer
+	size_t hash() {
+		if (value >= INT_MIN && value <= INT_MAX && value == (int)value) {
+			return std::hash<int>()((int)value);
+		}
+		return std::hash<double>()(value);
+	}
+
+	bool equals(Object* other);
+};
+
 class String : public Object {
 public:
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_STRING);
+	}
+
 	std::string value;
 
 	String(std::string value) {
@@ -81,6 +251,31 @@ public:
 		return value;
 	}
 
+	uint16_t type() {
+		return TYPE_STRING;
+	}
+
+	bool truthy() {
+		return !value.empty();
+	}
+
+	void write(Output& out) {
+		out.write(value);
+	}
+
+	std::string repr() {
+		return "'" + value + "'";
+	}
+
+	size_t hash() {
+		return std::hash<std::string>()(value);
+	}
+
+	bool equals(Object* other) {
+		String* rhs = dynamic_cast<String*>(other);
+		return rhs != nullptr && rhs->value == value;
+	}
+
 	friend std::ostream& operator<< (std::ostream& out, const String& obj) {
 		return out << obj.value;
 	}
@@ -88,6 +283,10 @@ public:
 
 class Boolean : public Object {
 public:
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_BOOL);
+	}
+
 	bool value;
 
 	Boolean(bool value) {
@@ -95,9 +294,28 @@ public:
 	}
 
 	std::string toString() {
-		return std::to_string(value);
+		return value ? "True" : "False";
+	}
+
+	uint16_t type() {
+		return TYPE_BOOL;
+	}
+
+	bool truthy() {
+		return value;
+	}
+
+	void write(Output& out) {
+		out.write(value ? "True" : "False");
 	}
 
+	// True == 1 and False == 0, so both must hash like the Integer
+	size_t hash() {
+		return std::hash<int>()(value);
+	}
+
+	bool equals(Object* other);
+
 	bool operator!=(const Boolean& rhs) {
 		return this->value != rhs.value;
 	}
@@ -119,9 +337,276 @@ public:
 
 class None : public Object {
 public:
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_NONE);
+	}
 
 	std::string toString() {
 		return "None";
 	}
 
+	uint16_t type() {
+		return TYPE_NONE;
+	}
+
+	bool truthy() {
+		return false;
+	}
+
+	void write(Output& out) {
+		out.write("None");
+	}
+
+	size_t hash() {
+		return 0;
+	}
+
+	bool equals(Object* other) {
+		return dynamic_cast<None*>(other) != nullptr;
+	}
+
+};
+
+inline bool Integer::equals(Object* other) {
+	if (Integer* rhs = dynamic_cast<Integer*>(other)) {
+		return rhs->value == value;
+	}
+	if (Float* rhs = dynamic_cast<Float*>(other)) {
+		return rhs->value == value;
+	}
+	if (Boolean* rhs = dynamic_cast<Boolean*>(other)) {
+		return (int)rhs->value == value;
+	}
+	return false;
+}
+
+inline bool Float::equals(Object* other) {
+	if (Float* rhs = dynamic_cast<Float*>(other)) {
+		return rhs->value == value;
+	}
+	if (Integer* rhs = dynamic_cast<Integer*>(other)) {
+		return rhs->value == value;
+	}
+	if (Boolean* rhs = dynamic_cast<Boolean*>(other)) {
+		return (int)rhs->value == value;
+	}
+	return false;
+}
+
+inline bool Boolean::equals(Object* other) {
+	if (Boolean* rhs = dynamic_cast<Boolean*>(other)) {
+		return rhs->value == value;
+	}
+	if (Integer* rhs = dynamic_cast<Integer*>(other)) {
+		return rhs->value == (int)value;
+	}
+	if (Float* rhs = dynamic_cast<Float*>(other)) {
+		return rhs->value == (int)value;
+	}
+	return false;
+}
+
+struct ObjectHash {
+	size_t operator()(Object* obj) const {
+		return obj->hash();
+	}
+};
+
+struct ObjectEquals {
+	bool operator()(Object* lhs, Object* rhs) const {
+		return lhs->equals(rhs);
+	}
+};
+
+// Containers whose repr is being built by this thread, outermost first. A
+// container met again inside its own repr prints as {...} or [...], as in
+// Python, instead of recursing until the stack runs out.
+inline thread_local std::vector<Object*> repr_active;
+
+class ReprGuard {
+public:
+	// false if object is already being printed further out
+	bool entered;
+
+	explicit ReprGuard(Object* object) {
+		entered = std::find(repr_active.begin(), repr_active.end(), object) == repr_active.end();
+		if (entered) {
+			repr_active.push_back(object);
+		}
+	}
+
+	~ReprGuard() {
+		if (entered) {
+			repr_active.pop_back();
+		}
+	}
+};
+
+class Dict : public Object {
+public:
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_DICT);
+	}
+
+	HashMap<Object*, Object*, ObjectHash, ObjectEquals> items;
+
+	Dict() {}
+
+	std::string toString() {
+		ReprGuard guard(this);
+		if (!guard.entered) {
+			return "{...}";
+		}
+		std::string out = "{";
+		bool comma = false;
+		for (auto& e : items) {
+			if (comma) {
+				out += ", ";
+			}
+			out += e.key->repr() + ": " + e.value->repr();
+			comma = true;
+		}
+		return out + "}";
+	}
+
+	uint16_t type() {
+		return TYPE_DICT;
+	}
+
+	bool truthy() {
+		return items.size() != 0;
+	}
+
+	Object* getItem(Object* key) {
+		Object** value = items.find(key);
+		if (value == nullptr) {
+			throw std::runtime_error("KeyError: " + key->repr());
+		}
+		return *value;
+	}
+
+	void setItem(Object* key, Object* value) {
+		items.set(key, value);
+	}
+};
+
+class List : public Object {
+public:
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_LIST);
+	}
+
+	std::vector<Object*> items;
+
+	List() {}
+
+	List(std::vector<Object*> items) {
+		this->items = items;
+	}
+
+	std::string toString() {
+		ReprGuard guard(this);
+		if (!guard.entered) {
+			return "[...]";
+		}
+		std::string out = "[";
+		for (size_t i = 0; i < items.size(); i++) {
+			if (i != 0) {
+				out += ", ";
+			}
+			out += items[i]->repr();
+		}
+		return out + "]";
+	}
+
+	uint16_t type() {
+		return TYPE_LIST;
+	}
+
+	bool truthy() {
+		return !items.empty();
+	}
+
+	Object* getItem(Object* index) {
+		return items[position(index)];
+	}
+
+	void setItem(Object* index, Object* value) {
+		items[position(index)] = value;
+	}
+
+private:
+	size_t position(Object* index) {
+		Integer* i = dynamic_cast<Integer*>(index);
+		if (i == nullptr) {
+			throw std::runtime_error("list indices must be integers");
+		}
+		long long pos = i->value < 0 ? i->value + (long long)items.size() : i->value;
+		if (pos < 0 || pos >= (long long)items.size()) {
+			throw std::runtime_error("IndexError: list index out of range");
+		}
+		return (size_t)pos;
+	}
+};
+
+// Box for a variable shared between a frame and the closures created in it.
+class Cell : public Object {
+public:
+	Object* value;
+
+	Cell(Object* value) {
+		this->value = value;
+	}
+
+	std::string toString() {
+		return value != nullptr ? value->toString() : "<empty cell>";
+	}
+};
+
+// A function value: the definition, the globals of the module it was
+// defined in, and the Cells it captured when its def statement ran.
+// Top-level functions capture nothing.
+class Closure : public Object {
+public:
+	static void* operator new(size_t size) {
+		return allocate(size, TYPE_FUNCTION);
+	}
+
+	Function* function;
+	Environment* globals;
+	std::vector<Object*> cells;
+
+	Closure(Function* function, Environment* globals) {
+		this->function = function;
+		this->globals = globals;
+	}
+
+	std::string toString();
+
+	uint16_t type() {
+		return TYPE_FUNCTION;
+	}
+};
+
+// A call of a generator function, paused at a yield (generator.h). next()
+// runs it to its next yield and returns the value, or null once it has
+// returned.
+class Generator : public Object {
+public:
+	virtual Object* next() = 0;
+};
+
+class Module : public Object {
+public:
+	std::string name;
+	Environment* env;
+
+	Module(std::string name, Environment* env) {
+		this->name = name;
+		this->env = env;
+	}
+
+	std::string toString() {
+		return "<module '" + name + "'>";
+	}
 };
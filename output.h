@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+// Longest text formatFloat writes: a sign, 17 digits, a point, "e-308".
+const size_t FLOAT_CHARS = 32;
+
+// Writes value to buf as Python's repr() does: the fewest digits that read
+// back as the same double (std::to_chars), positional with at least one
+// digit after the point unless the exponent is below -4 or above 15, and
+// inf and nan by name. Returns the end of the text.
+inline char* formatFloat(char* buf, double value) {
+    if (std::isnan(value)) {
+        std::memcpy(buf, "nan", 3);
+        return buf + 3;
+    }
+    char* p = buf;
+    if (std::signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+    if (std::isinf(value)) {
+        std::memcpy(p, "inf", 3);
+        return p + 3;
+    }
+    // d.ddde+XX, then split into the digits and the exponent
+    char sci[FLOAT_CHARS];
+    char* end = std::to_chars(sci, sci + sizeof(sci), value, std::chars_format::scientific).ptr;
+    char* e = std::find(sci, end, 'e');
+    int exp = 0;
+    std::from_chars(e + (e[1] == '+' ? 2 : 1), end, exp);
+    char digits[20] = {};
+    int n = 0;
+    for (char* c = sci; c < e; c++) {
+        if (*c != '.') {
+            digits[n++] = *c;
+        }
+    }
+    if (exp < -4 || exp > 15) {
+        *p++ = digits[0];
+        if (n > 1) {
+            *p++ = '.';
+            std::memcpy(p, digits + 1, n - 1);
+            p += n - 1;
+        }
+        *p++ = 'e';
+        *p++ = exp < 0 ? '-' : '+';
+        if (std::abs(exp) < 10) {
+            *p++ = '0';
+        }
+        return std::to_chars(p, p + 4, std::abs(exp)).ptr;
+    }
+    if (exp < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > exp; i--) {
+            *p++ = '0';
+        }
+        std::memcpy(p, digits, n);
+        return p + n;
+    }
+    for (int i = 0; i <= exp; i++) {
+        *p++ = i < n ? digits[i] : '0';
+    }
+    *p++ = '.';
+    if (n <= exp + 1) {
+        *p++ = '0';
+        return p;
+    }
+    std::memcpy(p, digits + exp + 1, n - exp - 1);
+    return p + n - exp - 1;
+}
+
+// Buffered writer for program output. print goes through here instead of
+// std::cout: values are formatted straight into a large user-space buffer
+// (numbers with std::to_chars, no temporary strings) and the buffer is handed
+// to write(2) only when it fills up, at exit, before an error is reported, or
+// when a fatal signal kills the process (recorder.h).
+// When the descriptor is a terminal the buffer is flushed at every newline so
+// interactive output still appears line by line. An Output can also capture
+// into a string instead of writing to a descriptor (the batch runner).
+class Output {
+public:
+    static const size_t CAPACITY = 1 << 16;
+
+    explicit Output(int fd = STDOUT_FILENO) {
+        this->fd = fd;
+        line_buffered = isatty(fd);
+        buffer = new char[CAPACITY];
+    }
+
+    explicit Output(std::string* capture) {
+        fd = -1;
+        this->capture = capture;
+        line_buffered = false;
+        buffer = new char[CAPACITY];
+    }
+
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    ~Output() {
+        flush();
+        delete[] buffer;
+    }
+
+    void setLineBuffered(bool enabled) {
+        line_buffered = enabled;
+    }
+
+    void write(const char* s, size_t n) {
+        if (n > CAPACITY - used) {
+            flush();
+            if (n > CAPACITY) {
+                writeAll(s, n);
+                return;
+            }
+        }
+        std::memcpy(buffer + used, s, n);
+        used += n;
+    }
+
+    void write(const char* s) {
+        write(s, std::strlen(s));
+    }
+
+    void write(const std::string& s) {
+        write(s.data(), s.size());
+    }
+
+    void write(char c) {
+        if (used == CAPACITY) {
+            flush();
+        }
+        buffer[used++] = c;
+    }
+
+    void writeInt(long long value) {
+        // 20 digits and a sign always fit
+        if (CAPACITY - used < 24) {
+            flush();
+        }
+        used = std::to_chars(buffer + used, buffer + CAPACITY, value).ptr - buffer;
+    }
+
+    void writeFloat(double value) {
+        if (CAPACITY - used < FLOAT_CHARS) {
+            flush();
+        }
+        used = formatFloat(buffer + used, value) - buffer;
+    }
+
+    void newline() {
+        write('\n');
+        if (line_buffered) {
+            flush();
+        }
+    }
+
+    void flush() {
+        writeAll(buffer, used);
+        used = 0;
+    }
+
+    // Hands what is buffered to write(2) from a fatal signal handler, so the
+    // output printed before a crash is not lost. Captured output stays in
+    // the buffer: appending to a string is not safe in a handler.
+    void flushFromSignal() {
+        if (capture == nullptr) {
+            writeAll(buffer, used);
+            used = 0;
+        }
+    }
+
+private:
+    int fd;
+    std::string* capture = nullptr;
+    bool line_buffered;
+    char* buffer;
+    size_t used = 0;
+
+    void writeAll(const char* s, size_t n) {
+        if (capture != nullptr) {
+            capture->append(s, n);
+            return;
+        }
+        while (n > 0) {
+            ssize_t written = ::write(fd, s, n);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // the reader went away (EPIPE etc.); nothing sensible to do
+                return;
+            }
+            s += written;
+            n -= written;
+        }
+    }
+};
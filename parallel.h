@@ -0,0 +1,585 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "visitor.h"
+#include "clone.h"
+#include "statement.h"
+#include "expression.h"
+#include "object.h"
+#include "environment.h"
+#include "builtins.h"
+#include "interpreter.h"
+
+// parallel_map(f, items): [f(x) for x in items], with the calls spread over
+// worker threads.
+//
+// Each worker is an Interpreter of its own, with its own frames, JIT and
+// specializer, running its own copies of f and of every function f can
+// call (clone.h), so nothing the interpreter keeps on the nodes is shared.
+// Its globals are a copy of f's module namespace; the values in it, the
+// items and the cells f captured are shared and only read. The workers
+// (WorkerPool) are started by the first parallel_map that needs them and
+// kept, with their interpreters and copies, for the rest of the process.
+//
+// That only holds for a function that writes nothing but its own locals,
+// which PurityCheck makes sure of before going parallel, and for values
+// that reading does not change: a generator advances when it is iterated,
+// and runs on the interpreter that created it (generator.h), so one that
+// the items, the cells or the globals f reads lead to keeps the map on the
+// calling interpreter as well. Any other function (and -j 1, a budget,
+// budget.h, allocation or line profiling, or hooks) is mapped serially on
+// the calling interpreter, so the results and errors are the same either
+// way: results come back in input order, and an error is the one the first
+// failing item raises.
+//
+// The first item is always run by the caller. When the rest would take less
+// time at its pace than handing them out costs, they are run there too.
+// Otherwise they are dealt to the workers in contiguous ranges. A worker
+// takes its items from the front of its own range and, when that is empty,
+// steals the back half of the largest remaining one.
+
+// Whether a function, and everything it calls, only writes its own locals.
+// Collects the module-level functions it calls in order, and the globals
+// they read.
+class PurityCheck : Visitor<void> {
+public:
+    std::vector<Closure*> reachable;
+    std::vector<std::string> reads;
+
+    explicit PurityCheck(Environment* globals) {
+        this->globals = globals;
+    }
+
+    bool check(Closure* closure) {
+        add(closure);
+        for (size_t i = 0; i < reachable.size() && pure; i++) {
+            for (Statement* s : reachable[i]->function->body) {
+                s->accept(this);
+            }
+        }
+        return pure;
+    }
+
+    // Whether a generator can be reached from the items, the cells of the
+    // functions checked or the globals they read, through containers,
+    // cells, closures and modules.
+    bool sharesGenerator(const std::vector<Object*>& items) {
+        std::vector<Object*> pending = items;
+        for (Closure* c : reachable) {
+            pending.insert(pending.end(), c->cells.begin(), c->cells.end());
+        }
+        for (const std::string& name : reads) {
+            pending.push_back(globals->get(name));
+        }
+        std::unordered_set<Object*> seen;
+        while (!pending.empty()) {
+            Object* o = pending.back();
+            pending.pop_back();
+            if (o == nullptr || (o->type() & (TYPE_INT | TYPE_FLOAT | TYPE_BOOL | TYPE_STRING | TYPE_NONE))
+                || !seen.insert(o).second) {
+                continue;
+            }
+            if (dynamic_cast<Generator*>(o) != nullptr) {
+                return true;
+            }
+            if (List* list = dynamic_cast<List*>(o)) {
+                pending.insert(pending.end(), list->items.begin(), list->items.end());
+            }
+            else if (Dict* dict = dynamic_cast<Dict*>(o)) {
+                for (auto& e : dict->items) {
+                    pending.push_back(e.key);
+                    pending.push_back(e.value);
+                }
+            }
+            else if (Cell* cell = dynamic_cast<Cell*>(o)) {
+                pending.push_back(cell->value);
+            }
+            else if (Closure* closure = dynamic_cast<Closure*>(o)) {
+                pending.insert(pending.end(), closure->cells.begin(), closure->cells.end());
+            }
+            else if (Module* module = dynamic_cast<Module*>(o)) {
+                for (auto& e : module->env->data) {
+                    pending.push_back(e.value);
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    Environment* globals;
+    bool pure = true;
+
+    void add(Closure* closure) {
+        if (std::find(reachable.begin(), reachable.end(), closure) == reachable.end()) {
+            reachable.push_back(closure);
+        }
+    }
+
+    void visit(Expr* expr) {
+        expr->accept(this);
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        pure = pure && stmt->ref.kind != VAR_GLOBAL;
+        visit(stmt->initial);
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        for (Statement* s : stmt->statements) {
+            s->accept(this);
+        }
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        visit(stmt->expr);
+    };
+
+    void visitForStmt(For* stmt) override {
+        pure = pure && stmt->ref.kind != VAR_GLOBAL;
+        visit(stmt->iterable);
+        stmt->body->accept(this);
+    };
+
+    void visitFunctionStmt(Function* stmt) override {
+        pure = pure && stmt->binding.kind != VAR_GLOBAL;
+        for (Statement* s : stmt->body) {
+            s->accept(this);
+        }
+    };
+
+    void visitGlobalStmt(Global* stmt) override {
+        pure = false;
+    };
+
+    void visitIfStmt(If* stmt) override {
+        visit(stmt->condition);
+        stmt->thenBranch->accept(this);
+        if (stmt->elseBranch != nullptr) {
+            stmt->elseBranch->accept(this);
+        }
+    };
+
+    void visitImportStmt(Import* stmt) override {
+        pure = false;
+    };
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {
+        pure = false;
+    };
+
+    void visitPrintStatement(Print* stmt) override {
+        pure = false;
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        if (stmt->value != nullptr) {
+            visit(stmt->value);
+        }
+    };
+
+    // the generator would belong to the worker
+    void visitYieldStmt(Yield* stmt) override {
+        pure = false;
+    };
+
+    void visitAssignExpr(Assign* expr) override {};
+
+    void visitBinaryExpr(Binary* expr) override {
+        visit(expr->left);
+        visit(expr->right);
+    };
+
+    // Only calls to module-level defs of the same module, and to builtins
+    // that do not run user code, can be followed.
+    void visitCallExpr(Call* expr) override {
+        for (Expr* a : expr->args) {
+            visit(a);
+        }
+        if (expr->object != nullptr || expr->ref.kind != VAR_GLOBAL) {
+            pure = false;
+            return;
+        }
+        const std::string& name = expr->callee.value;
+        if (Closure* callee = globals->get_function(name)) {
+            if (callee->globals != globals) {
+                pure = false;
+            }
+            add(callee);
+            return;
+        }
+        if (globals->exists(name)) {
+            pure = false;
+            return;
+        }
+        Builtin* builtin = Builtins::find(name);
+        pure = pure && builtin != nullptr && builtin->callI == nullptr;
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        visit(expr->condition);
+        visit(expr->thenBranch);
+        visit(expr->elseBranch);
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        for (size_t i = 0; i < expr->keys.size(); i++) {
+            visit(expr->keys[i]);
+            visit(expr->values[i]);
+        }
+    };
+
+    void visitGetExpr(Get* expr) override {
+        visit(expr->object);
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        visit(expr->expression);
+    };
+
+    void visitInlineExpr(Inline* expr) override {
+        visitCallExpr(expr->call);
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        for (Expr* e : expr->items) {
+            visit(e);
+        }
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        if (expr->token.type == IDENTIFIER && expr->ref.kind == VAR_GLOBAL
+            && std::find(reads.begin(), reads.end(), expr->token.value) == reads.end()) {
+            reads.push_back(expr->token.value);
+        }
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        visit(expr->left);
+        visit(expr->right);
+    };
+
+    // the container may be shared
+    void visitSetItemExpr(SetItem* expr) override {
+        pure = false;
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        visit(expr->object);
+        visit(expr->index);
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        visit(expr->right);
+    };
+
+    void visitVariableExpr(Variable* expr) override {};
+};
+
+// The threads parallel_map runs on. Started when first needed, and grown to
+// the most jobs asked for; each builds its Interpreter on its own thread, and
+// its budget's stack limit is that thread's.
+class WorkerPool {
+public:
+    struct Worker {
+        Interpreter in;
+        // the private copy of each function run here, by the original
+        HashMap<Closure*, Closure*> copies;
+    };
+
+    typedef std::function<void(unsigned, Worker&)> Task;
+
+    static WorkerPool& instance() {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_all();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    // Runs task(w, worker) on workers 0 to jobs - 1 and waits for them all.
+    // One map at a time.
+    void run(unsigned jobs, const Task& task) {
+        std::lock_guard<std::mutex> one(busy);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (threads.size() < jobs) {
+            unsigned w = (unsigned)threads.size();
+            uint64_t seen = generation;
+            threads.emplace_back([this, w, seen]() { loop(w, seen); });
+        }
+        this->task = &task;
+        this->jobs = jobs;
+        running = jobs;
+        generation++;
+        wake.notify_all();
+        done.wait(lock, [this]() { return running == 0; });
+        this->task = nullptr;
+    }
+
+private:
+    std::mutex busy;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::vector<std::thread> threads;
+    const Task* task = nullptr;
+    unsigned jobs = 0;
+    // workers still on the current task
+    unsigned running = 0;
+    // bumped for each task, and to stop
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    WorkerPool() {}
+
+    void loop(unsigned w, uint64_t seen) {
+        Worker worker;
+        worker.in.parallel_jobs = 1;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this, seen]() { return generation != seen; });
+            seen = generation;
+            if (stopping) {
+                return;
+            }
+            if (w >= jobs) {
+                continue;
+            }
+            lock.unlock();
+            (*task)(w, worker);
+            lock.lock();
+            if (--running == 0) {
+                done.notify_one();
+            }
+        }
+    }
+};
+
+class ParallelMap {
+public:
+    // How long the items after the first must be expected to take, at the
+    // first one's pace, for the workers to be worth it. Handing a map to the
+    // workers and collecting the results costs about 8 us
+    // (bench/parallel_small.py), and two workers save half the time of the
+    // items, so they break even at twice that.
+    static const int64_t MIN_PARALLEL_NS = 16000;
+
+    explicit ParallelMap(Interpreter& caller) : caller(caller) {}
+
+    Object* run(Object** args, size_t argc) {
+        Closure* closure = dynamic_cast<Closure*>(args[0]);
+        if (closure == nullptr) {
+            throw std::runtime_error("parallel_map() argument 1 must be a function");
+        }
+        if (closure->function->params.size() != 1) {
+            throw std::runtime_error("wrong sized arguments");
+        }
+        List* list = dynamic_cast<List*>(args[1]);
+        if (list == nullptr) {
+            throw std::runtime_error("parallel_map() argument 2 must be a list");
+        }
+        items = list->items;
+        results.assign(items.size(), nullptr);
+
+        size_t n = items.size();
+        PurityCheck purity(closure->globals);
+        // workers would not count against the caller's budget, nor be seen
+        // by its profilers or hooks
+        bool serial = caller.parallel_jobs < 2 || n < 2 || caller.budget.limited()
+                      || caller.allocs != nullptr || caller.lines != nullptr || caller.hooks != nullptr;
+        if (serial || !purity.check(closure) || purity.sharesGenerator(items)) {
+            return mapSerially(closure, 0);
+        }
+        // the first item runs here, and its time tells whether the rest are
+        // worth handing out
+        auto started = std::chrono::steady_clock::now();
+        results[0] = call(caller, closure, items[0]);
+        auto took = std::chrono::steady_clock::now() - started;
+        if (std::chrono::duration_cast<std::chrono::nanoseconds>(took).count() * (int64_t)(n - 1) < MIN_PARALLEL_NS) {
+            return mapSerially(closure, 1);
+        }
+
+        unsigned jobs = (unsigned)std::min<size_t>(caller.parallel_jobs, n - 1);
+        ranges = std::vector<Range>(jobs);
+        for (unsigned w = 0; w < jobs; w++) {
+            ranges[w].begin = 1 + (n - 1) * w / jobs;
+            ranges[w].end = 1 + (n - 1) * (w + 1) / jobs;
+        }
+        failed_at = SIZE_MAX;
+        WorkerPool::instance().run(jobs, [&](unsigned w, WorkerPool::Worker& worker) {
+            work(w, worker, closure, purity.reachable);
+        });
+
+        if (failed_at != SIZE_MAX) {
+            if (out_of_stack) {
+                caller.budget.outOfStack();
+            }
+            throw std::runtime_error(error);
+        }
+        return new List(results);
+    }
+
+private:
+    // items [begin, end) not yet taken
+    struct Range {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    Interpreter& caller;
+    std::vector<Object*> items;
+    std::vector<Object*> results;
+    std::vector<Range> ranges;
+
+    // lowest failing item so far; items after it are not run
+    std::atomic<size_t> failed_at;
+    std::mutex error_mutex;
+    std::string error;
+    // whether that item ran out of the worker's stack
+    bool out_of_stack = false;
+
+    // results from item first on, on the calling interpreter
+    Object* mapSerially(Closure* closure, size_t first) {
+        for (size_t i = first; i < items.size(); i++) {
+            results[i] = call(caller, closure, items[i]);
+        }
+        return new List(results);
+    }
+
+    static Object* call(Interpreter& in, Closure* closure, Object* item) {
+        ArgBuffer slots(closure->function->num_slots);
+        slots[0] = item;
+        return in.run_function(closure, slots.get());
+    }
+
+    void work(unsigned w, WorkerPool::Worker& worker, Closure* closure, const std::vector<Closure*>& reachable) {
+        Interpreter& in = worker.in;
+        in.engine = caller.engine;
+        in.jit.enabled = caller.jit.enabled;
+        in.specializer.enabled = caller.specializer.enabled;
+        // against this thread's stack, and afresh after a map that ran out
+        in.budget.start();
+
+        // the module namespace as it is now, with the functions that will
+        // run replaced by the worker's copies; a version the inline caches
+        // of the copies have not seen
+        Environment* globals = in.global_env;
+        uint64_t version = globals->version;
+        *globals = *closure->globals;
+        globals->version = std::max(version, globals->version) + 1;
+        Closure* entry = nullptr;
+        bool cloned = false;
+        for (Closure* c : reachable) {
+            Closure*& copy = worker.copies[c];
+            if (copy == nullptr) {
+                copy = new Closure(static_cast<Function*>(AstCloner(true).clone(c->function)), globals);
+                copy->cells = c->cells;
+                cloned = true;
+            }
+            if (c == closure) {
+                entry = copy;
+            }
+            if (globals->get_function(c->function->name.value) == c) {
+                globals->data_function.set(c->function->name.value, copy);
+            }
+        }
+        // compiled copies call the copies they found directly, and a def
+        // rebound since may have replaced one
+        if (cloned) {
+            in.jit.invalidate();
+        }
+
+        size_t i;
+        while (next(w, i)) {
+            if (i >= failed_at) {
+                continue;
+            }
+            try {
+                results[i] = call(in, entry, items[i]);
+            }
+            catch (std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (i < failed_at) {
+                    failed_at = i;
+                    error = e.what();
+                    out_of_stack = in.budget.exceeded == LIMIT_DEPTH;
+                }
+            }
+        }
+    }
+
+    // The next item for worker w: the front of its own range, else the
+    // back half of the largest other range.
+    bool next(unsigned w, size_t& item) {
+        if (take(ranges[w], item)) {
+            return true;
+        }
+        while (true) {
+            Range* victim = nullptr;
+            size_t most = 0;
+            for (Range& r : ranges) {
+                std::lock_guard<std::mutex> lock(r.mutex);
+                if (r.end - r.begin > most) {
+                    most = r.end - r.begin;
+                    victim = &r;
+                }
+            }
+            if (victim == nullptr) {
+                return false;
+            }
+            size_t begin;
+            size_t end;
+            {
+                std::lock_guard<std::mutex> lock(victim->mutex);
+                size_t left = victim->end - victim->begin;
+                if (left == 0) {
+                    // taken meanwhile, look again
+                    continue;
+                }
+                end = victim->end;
+                begin = end - (left + 1) / 2;
+                victim->end = begin;
+            }
+            std::lock_guard<std::mutex> lock(ranges[w].mutex);
+            ranges[w].begin = begin + 1;
+            ranges[w].end = end;
+            item = begin;
+            return true;
+        }
+    }
+
+    static bool take(Range& r, size_t& item) {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (r.begin == r.end) {
+            return false;
+        }
+        item = r.begin++;
+        return true;
+    }
+};
+
+inline Object* parallelMap(Interpreter& in, Object** args, size_t argc) {
+    return ParallelMap(in).run(args, argc);
+}
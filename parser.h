@@ -33,6 +33,13 @@ private:
 	int current = 0;
 
 	Statement* declaration() {
+		uint32_t line = peek().line;
+		Statement* stmt = anyDeclaration();
+		stmt->line = line;
+		return stmt;
+	}
+
+	Statement* anyDeclaration() {
 		if (match(DEF)) {
 			return functionDeclaration();
 		}
@@ -59,8 +66,7 @@ private:
 		consume(NEWLINE);
 		consume(INDENT);
 		std::vector<Statement*> body;
-		body.push_back(declaration());
-		while (!check(DEDENT)) {
+		while (true) {
 			while (match(NEWLINE)) { ; }
 			if (check(END) || match(DEDENT)) {
 				break;
@@ -86,12 +92,32 @@ private:
 		if (match(IF)) {
 			return ifStatement();
 		}
+		if (match(FOR)) {
+			return forStatement();
+		}
+		if (match(GLOBAL)) {
+			return new Global(names());
+		}
+		if (match(NONLOCAL)) {
+			return new Nonlocal(names());
+		}
+		if (match(IMPORT)) {
+			return new Import(consume(IDENTIFIER), std::vector<Token>());
+		}
+		if (match(FROM)) {
+			Token module = consume(IDENTIFIER);
+			consume(IMPORT);
+			return new Import(module, names());
+		}
 		if (match(PRINT)) {
 			return printStatement();
 		}
 		if (match(RETURN)) {
 			return returnStatement();
 		}
+		if (match(YIELD)) {
+			return yieldStatement();
+		}
 		return expressionStatement();
 	}
 
@@ -113,6 +139,25 @@ private:
 		return new If(conditional, thenBranch, elseBranch);
 	}
 
+	Statement* forStatement() {
+		Token name = consume(IDENTIFIER);
+		consume(IN);
+		Expr* iterable = expression();
+		consume(COLON);
+		consume(NEWLINE);
+		consume(INDENT);
+		return new For(name, iterable, blockStatement());
+	}
+
+	std::vector<Token> names() {
+		std::vector<Token> names;
+		names.push_back(consume(IDENTIFIER));
+		while (match(COMMA)) {
+			names.push_back(consume(IDENTIFIER));
+		}
+		return names;
+	}
+
 	Statement* printStatement() {
 		std::vector<Expr*> args = arguments();
 		return new Print(args);
@@ -129,6 +174,16 @@ private:
 		return new Return(ret, value);
 	}
 
+	Statement* yieldStatement() {
+		Token keyword = previous();
+		Expr* value = nullptr;
+		if (match(NEWLINE)) {
+			return new Yield(keyword, value);
+		}
+		value = expression();
+		return new Yield(keyword, value);
+	}
+
 	Statement* blockStatement() {
 		std::vector<Statement*> lines;
 		while (!match(DEDENT)) {
@@ -141,11 +196,29 @@ private:
 
 	Statement* expressionStatement() {
 		Expr* expr = expression();
+		if (match(EQUAL)) {
+			Subscript* target = dynamic_cast<Subscript*>(expr);
+			if (target == nullptr) {
+				error();
+			}
+			Expr* value = expression();
+			return new Expression(at(target->line, new SetItem(target->object, target->index, value)));
+		}
 		return new Expression(expr);
 	}
 
+	// a conditional expression binds loosest: a or b if c else d is
+	// (a or b) if c else d
 	Expr* expression() {
-		return or_();
+		Expr* expr = or_();
+		if (match(IF)) {
+			uint32_t line = previous().line;
+			Expr* condition = or_();
+			consume(ELSE);
+			Expr* otherwise = expression();
+			expr = at(line, new Conditional(condition, expr, otherwise));
+		}
+		return expr;
 	}
 
 	Expr* or_() {
@@ -153,7 +226,7 @@ private:
 		while (match(OR)) {
 			Token op = previous();
 			Expr* rhs = and_();
-			expr = new Logical(expr, op, rhs);
+			expr = at(op.line, new Logical(expr, op, rhs));
 		}
 		return expr;
 	}
@@ -163,7 +236,7 @@ private:
 		while (match(AND)) {
 			Token op = previous();
 			Expr* rhs = comparison();
-			expr = new Logical(expr, op, rhs);
+			expr = at(op.line, new Logical(expr, op, rhs));
 		}
 		return expr;
 	}
@@ -173,7 +246,7 @@ private:
 		while (match(TokenTypes{NOT_EQUAL_TO, EQUAL_TO, GREATER_THAN_EQUAL_TO, GREATER_THAN, LESS_THAN, LESS_THAN_EQUAL_TO})) {
 			Token op = previous();
 			Expr* rhs = term();
-			expr = new Binary(expr, op, rhs);
+			expr = at(op.line, new Binary(expr, op, rhs));
 		}
 		return expr;
 	}
@@ -183,17 +256,17 @@ private:
 		while (match(TokenTypes{ MINUS, PLUS })) {
 			Token op = previous();
 			Expr* rhs = factor();
-			expr = new Binary(expr, op, rhs);
+			expr = at(op.line, new Binary(expr, op, rhs));
 		}
 		return expr;
 	}
 
 	Expr* factor() {
 		Expr* expr = unary();
-		while (match(TokenTypes{ MULTIPLY, DIVIDE })) {
+		while (match(TokenTypes{ MULTIPLY, DIVIDE, FLOOR_DIVIDE })) {
 			Token op = previous();
 			Expr* rhs = unary();
-			expr = new Binary(expr, op, rhs);
+			expr = at(op.line, new Binary(expr, op, rhs));
 		}
 		return expr;
 	}
@@ -202,7 +275,7 @@ private:
 		if (match({ MINUS, NOT })) {
 			Token op = previous();
 			Expr* rhs = unary();
-			return new Unary(op, rhs);
+			return at(op.line, new Unary(op, rhs));
 		}
 		return call();
 	}
@@ -213,30 +286,87 @@ private:
 			Token name = advance();
 			std::vector<Expr*> args = arguments();
 			Token paren = previous();
-			return new Call(name, paren, args);
+			return at(name.line, new Call(name, paren, args));
 		}
 		else {
 			expr = primary();
 		}
+		while (true) {
+			if (match(LBRACKET)) {
+				uint32_t line = previous().line;
+				Expr* index = expression();
+				consume(RBRACKET);
+				expr = at(line, new Subscript(expr, index));
+			}
+			else if (match(DOT)) {
+				Token name = consume(IDENTIFIER);
+				if (check(LPARAN)) {
+					std::vector<Expr*> args = arguments();
+					expr = at(name.line, new Call(name, previous(), args, expr));
+				}
+				else {
+					expr = at(name.line, new Get(expr, name));
+				}
+			}
+			else {
+				break;
+			}
+		}
 		return expr;
 	}
 
 	Expr* primary() {
 		if (match(TokenTypes{ TRUE, FALSE, NONE })) {
-			return new Literal(previous(), "");
+			return at(previous().line, new Literal(previous(), ""));
 		}
 		if (match(LPARAN)) {
+			uint32_t line = previous().line;
 			Expr* expr = expression();
 			consume(RPARAN);
-			return new Grouping(expr);
+			return at(line, new Grouping(expr));
 		}
-		if (match(TokenTypes{ IDENTIFIER, NUMBER, STRING })) {
-			return new Literal(previous(), previous().value);
+		if (match(LBRACE)) {
+			return at(previous().line, dictLiteral());
+		}
+		if (match(LBRACKET)) {
+			uint32_t line = previous().line;
+			std::vector<Expr*> items;
+			while (!match(RBRACKET)) {
+				if (items.size() > 0) {
+					consume(COMMA);
+					if (match(RBRACKET)) {
+						break;
+					}
+				}
+				items.push_back(expression());
+			}
+			return at(line, new ListLiteral(items));
+		}
+		if (match(TokenTypes{ IDENTIFIER, NUMBER, FLOAT, STRING })) {
+			return at(previous().line, new Literal(previous(), previous().value));
 		}
 		error();
 		return nullptr;
 	}
 
+	Expr* dictLiteral() {
+		std::vector<Expr*> keys;
+		std::vector<Expr*> values;
+		while (!match(RBRACE)) {
+			if (keys.size() > 0) {
+				consume(COMMA);
+				// trailing comma
+				if (match(RBRACE)) {
+					break;
+				}
+			}
+			keys.push_back(expression());
+			consume(COLON);
+			values.push_back(expression());
+		}
+		return new DictLiteral(keys, values);
+	}
+
 	std::vector<Expr*> arguments() {
 		std::vector<Expr*> args;
 		consume(LPARAN);
@@ -250,11 +380,18 @@ private:
 		return args;
 	}
 
+	// expr, made from a token on line
+	Expr* at(uint32_t line, Expr* expr) {
+		expr->line = line;
+		return expr;
+	}
+
 	void error() {
-		std::cout << "\n" << tokenNames[previous().type] << " " << previous().value;
-		std::cout << "\n" << tokenNames[peek().type] << " " << peek().value;
-		std::cout << "\n" << tokenNames[peekNext().type] << " " << peekNext().value;
-		throw std::runtime_error("Error parsing Token: " + tokenNames[peek().type]);
+		// the context goes into the message; printing it would end up in
+		// the program's output
+		throw std::runtime_error("Error parsing Token: " + tokenNames[peek().type]
+			+ " '" + peek().value + "' after " + tokenNames[previous().type] + " '" + previous().value + "'"
+			+ " at line " + std::to_string(peek().line) + ", column " + std::to_string(peek().column));
 	}
 
 	bool match(std::vector<TokenType> types) {
@@ -43,6 +43,14 @@ public:
         std::cout << ")";
     };
 
+    void visitForStmt(For* stmt) override {
+        std::cout << "(For, " << stmt->name.value << ", ";
+        stmt->iterable->accept(this);
+        std::cout << ", ";
+        stmt->body->accept(this);
+        std::cout << ")";
+    };
+
     void visitFunctionStmt(Function* stmt) override {
         std::cout << "(Function " << stmt->name.value << ", ";
         std::cout << "(";
@@ -55,6 +63,14 @@ public:
         std::cout << "\n))";
     };
 
+    void visitGlobalStmt(Global* stmt) override {
+        std::cout << "(Global";
+        for (auto n : stmt->names) {
+            std::cout << ", " << n.value;
+        }
+        std::cout << ")";
+    };
+
     void visitIfStmt(If* stmt) override {
         std::cout << "(If, ";
         stmt->condition->accept(this);
@@ -64,6 +80,20 @@ public:
         stmt->elseBranch->accept(this);
         std::cout << ")";
     };
+    void visitImportStmt(Import* stmt) override {
+        std::cout << "(Import, " << stmt->module.value;
+        for (auto n : stmt->names) {
+            std::cout << ", " << n.value;
+        }
+        std::cout << ")";
+    };
+    void visitNonlocalStmt(Nonlocal* stmt) override {
+        std::cout << "(Nonlocal";
+        for (auto n : stmt->names) {
+            std::cout << ", " << n.value;
+        }
+        std::cout << ")";
+    };
     void visitPrintStatement(Print* stmt) override {
         std::cout << "(Print, ";
         for (size_t i = 0; i < stmt->exprs.size(); i++) {
@@ -79,6 +109,14 @@ public:
         stmt->value->accept(this);
         std::cout << ")";
     };
+    void visitYieldStmt(Yield* stmt) override {
+        std::cout << "(Yield";
+        if (stmt->value != nullptr) {
+            std::cout << ", ";
+            stmt->value->accept(this);
+        }
+        std::cout << ")";
+    };
 
     void visitAssignExpr(Assign* expr) override {};
     void visitBinaryExpr(Binary* expr) override {
@@ -90,6 +128,10 @@ public:
     };
     void visitCallExpr(Call* expr) override {
         std::cout << "(";
+        if (expr->object != nullptr) {
+            expr->object->accept(this);
+            std::cout << ".";
+        }
         std::cout << expr->callee.value << ", ";
         std::cout << "(";
 
@@ -104,11 +146,51 @@ public:
         std::cout << ")";
         std::cout << ")";
     };
+    void visitConditionalExpr(Conditional* expr) override {
+        std::cout << "(If, ";
+        expr->condition->accept(this);
+        std::cout << ", ";
+        expr->thenBranch->accept(this);
+        std::cout << ", ";
+        expr->elseBranch->accept(this);
+        std::cout << ")";
+    };
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        std::cout << "(Dict";
+        for (size_t i = 0; i < expr->keys.size(); i++) {
+            std::cout << ", (";
+            expr->keys[i]->accept(this);
+            std::cout << ", ";
+            expr->values[i]->accept(this);
+            std::cout << ")";
+        }
+        std::cout << ")";
+    };
+    void visitGetExpr(Get* expr) override {
+        std::cout << "(Get, ";
+        expr->object->accept(this);
+        std::cout << ", " << expr->name.value << ")";
+    };
     void visitGroupingExpr(Grouping* expr) override {
         std::cout << "(";
         expr->expression->accept(this);
         std::cout << ")";
     };
+    void visitInlineExpr(Inline* expr) override {
+        std::cout << "(Inline, ";
+        expr->call->accept(this);
+        std::cout << ", ";
+        expr->body->accept(this);
+        std::cout << ")";
+    };
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        std::cout << "(List";
+        for (Expr* e : expr->items) {
+            std::cout << ", ";
+            e->accept(this);
+        }
+        std::cout << ")";
+    };
     void visitLiteralExpr(Literal* expr) override {
         std::cout << "(" << tokenNames[expr->token.type] << ", " << expr->value << ")";
     };
@@ -119,6 +201,22 @@ public:
         expr->right->accept(this);
         std::cout << ")";
     };
+    void visitSetItemExpr(SetItem* expr) override {
+        std::cout << "(SetItem, ";
+        expr->object->accept(this);
+        std::cout << ", ";
+        expr->index->accept(this);
+        std::cout << ", ";
+        expr->value->accept(this);
+        std::cout << ")";
+    };
+    void visitSubscriptExpr(Subscript* expr) override {
+        std::cout << "(Subscript, ";
+        expr->object->accept(this);
+        std::cout << ", ";
+        expr->index->accept(this);
+        std::cout << ")";
+    };
     void visitUnaryExpr(Unary* expr) override {
         std::cout << "(" << tokenNames[expr->op.type] << ", ";
         expr->right->accept(this);
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "hashmap.h"
+#include "statement.h"
+
+// Sampling profiler (--profile).
+//
+// While profiling, the interpreter pushes every Function it enters onto a
+// ShadowStack and pops it on the way out, generator resumes included. A
+// SIGPROF timer interrupts the process every INTERVAL_US of CPU time and
+// the handler copies the shadow stack into a preallocated sample buffer:
+// it takes no lock and allocates nothing, and the interpreter only pays two
+// relaxed stores per call. After the run the samples are written as
+// collapsed stacks ("<module>;f;g 12" per line), the input format of
+// flamegraph.pl and speedscope, and summarized in a table of the functions
+// with the most self time.
+//
+// The JIT is off while profiling: compiled code does not maintain the
+// shadow stack.
+
+class ShadowStack {
+public:
+    // frames deeper than this are counted but not recorded
+    static const int CAPACITY = 1 << 16;
+
+    ShadowStack() : frames(new std::atomic<Function*>[CAPACITY]) {}
+
+    void push(Function* f) {
+        int d = depth.load(std::memory_order_relaxed);
+        if (d < CAPACITY) {
+            frames[d].store(f, std::memory_order_relaxed);
+        }
+        depth.store(d + 1, std::memory_order_release);
+    }
+
+    void pop() {
+        depth.store(depth.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+    }
+
+private:
+    friend class Profiler;
+
+    std::atomic<int> depth{ 0 };
+    std::unique_ptr<std::atomic<Function*>[]> frames;
+};
+
+class Profiler {
+public:
+    static const int INTERVAL_US = 1000;
+    // frames kept of each sample: the outermost ones and the leaf
+    static const uint32_t MAX_DEPTH = 256;
+    static const size_t MAX_SAMPLES = 1 << 20;
+    static const size_t POOL_SIZE = 1 << 22;
+    static const size_t TOP = 20;
+
+    ShadowStack stack;
+
+    Profiler() : samples(new Sample[MAX_SAMPLES]), pool(new Function*[POOL_SIZE]) {}
+
+    void start() {
+        Profiler* none = nullptr;
+        if (!active.compare_exchange_strong(none, this)) {
+            throw std::runtime_error("a profiler is already running");
+        }
+        struct sigaction action = {};
+        action.sa_handler = onSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &previous);
+        struct itimerval timer = {};
+        timer.it_interval.tv_usec = INTERVAL_US;
+        timer.it_value.tv_usec = INTERVAL_US;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+    }
+
+    void stop() {
+        struct itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        sigaction(SIGPROF, &previous, nullptr);
+        active = nullptr;
+    }
+
+    // Writes the collapsed stacks to path and the table to out.
+    void report(const std::string& path, std::ostream& out) {
+        HashMap<std::string, size_t> stacks;
+        HashMap<Function*, Totals> totals;
+        std::vector<Function*> seen;
+        for (size_t i = 0; i < count; i++) {
+            Sample& s = samples[i];
+            std::string line = "<module>";
+            seen.clear();
+            for (uint32_t j = 0; j < s.depth; j++) {
+                Function* f = pool[s.offset + j];
+                line += ';';
+                if (f == nullptr) {
+                    line += "...";
+                    continue;
+                }
+                line += f->name.value;
+                if (std::find(seen.begin(), seen.end(), f) == seen.end()) {
+                    seen.push_back(f);
+                    totals[f].total++;
+                }
+            }
+            if (s.depth > 0) {
+                totals[pool[s.offset + s.depth - 1]].self++;
+            }
+            stacks[line]++;
+        }
+
+        std::ofstream file(path);
+        if (!file) {
+            throw std::runtime_error("cannot write profile '" + path + "'");
+        }
+        for (auto& e : stacks) {
+            file << e.key << ' ' << e.value << '\n';
+        }
+
+        std::vector<std::pair<Function*, Totals>> rows;
+        for (auto& e : totals) {
+            rows.push_back({ e.key, e.value });
+        }
+        std::sort(rows.begin(), rows.end(), [](const std::pair<Function*, Totals>& a, const std::pair<Function*, Totals>& b) {
+            return a.second.self != b.second.self ? a.second.self > b.second.self : a.second.total > b.second.total;
+        });
+
+        out << "profile: " << count << " samples, 1 every " << INTERVAL_US << " us of CPU time";
+        if (dropped != 0) {
+            out << " (" << dropped << " dropped)";
+        }
+        out << "; collapsed stacks in " << path << "\n";
+        char line[160];
+        std::snprintf(line, sizeof(line), "%8s %8s %10s %10s  %s\n", "self%", "total%", "self ms", "total ms", "function");
+        out << line;
+        double n = std::max(count, (size_t)1);
+        double ms = INTERVAL_US / 1000.0;
+        for (size_t i = 0; i < rows.size() && i < TOP; i++) {
+            Totals& t = rows[i].second;
+            std::snprintf(line, sizeof(line), "%7.1f%% %7.1f%% %10.1f %10.1f  ", 100 * t.self / n, 100 * t.total / n,
+                          t.self * ms, t.total * ms);
+            out << line << rows[i].first->name.value << "\n";
+        }
+    }
+
+private:
+    struct Sample {
+        uint32_t offset;
+        uint32_t depth;
+    };
+
+    struct Totals {
+        size_t self = 0;
+        size_t total = 0;
+    };
+
+    static inline std::atomic<Profiler*> active{ nullptr };
+
+    std::unique_ptr<Sample[]> samples;
+    std::unique_ptr<Function*[]> pool;
+    size_t count = 0;
+    size_t used = 0;
+    size_t dropped = 0;
+    // set while a handler runs, in case the signal lands on two threads
+    std::atomic_flag sampling = ATOMIC_FLAG_INIT;
+    struct sigaction previous;
+
+    // Runs in the signal handler: no locks, no allocation.
+    static void onSignal(int) {
+        Profiler* p = active.load();
+        if (p == nullptr || p->sampling.test_and_set(std::memory_order_acquire)) {
+            return;
+        }
+        p->sample();
+        p->sampling.clear(std::memory_order_release);
+    }
+
+    // copies the shadow stack into the buffers
+    void sample() {
+        ShadowStack& s = stack;
+        int depth = std::min(s.depth.load(std::memory_order_acquire), ShadowStack::CAPACITY);
+        uint32_t kept = std::min((uint32_t)std::max(depth, 0), MAX_DEPTH);
+        if (count == MAX_SAMPLES || used + kept > POOL_SIZE) {
+            dropped++;
+            return;
+        }
+        Function** out = &pool[used];
+        if ((uint32_t)depth > MAX_DEPTH) {
+            // the outermost frames, an elision marker and the leaf
+            for (uint32_t i = 0; i < MAX_DEPTH - 2; i++) {
+                out[i] = s.frames[i].load(std::memory_order_relaxed);
+            }
+            out[MAX_DEPTH - 2] = nullptr;
+            out[MAX_DEPTH - 1] = s.frames[depth - 1].load(std::memory_order_relaxed);
+        }
+        else {
+            for (uint32_t i = 0; i < kept; i++) {
+                out[i] = s.frames[i].load(std::memory_order_relaxed);
+            }
+        }
+        samples[count] = Sample{ (uint32_t)used, kept };
+        used += kept;
+        count++;
+    }
+};
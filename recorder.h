@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <signal.h>
+#include <unistd.h>
+
+#include "statement.h"
+#include "output.h"
+
+// Flight recorder.
+//
+// Every interpreter keeps its last CAPACITY calls, returns and statements
+// in a ring of 16-byte records, overwriting the oldest. Recording is three
+// stores and an increment, with no lock and no allocation, so it is always
+// on; calls inside JIT-compiled code are not seen. When a script stops with
+// an error, the runner adds the last TAIL events to the message, and a
+// fatal signal (SIGSEGV, SIGFPE, SIGBUS, SIGILL, SIGABRT) or an exception
+// nothing caught writes the whole ring of the thread's interpreter to
+// stderr before the process dies.
+//
+// A statement is recorded by its line only: the calls around it tell which
+// function it is in.
+
+enum EventKind : uint8_t {
+    EVENT_NONE, EVENT_CALL, EVENT_RETURN, EVENT_UNWIND, EVENT_STATEMENT,
+};
+
+class FlightRecorder {
+public:
+    static const uint32_t CAPACITY = 256;
+    // events added to an error message
+    static const uint32_t TAIL = 16;
+
+    void call(Function* f) {
+        record(EVENT_CALL, f, 0);
+    }
+
+    void ret(Function* f) {
+        record(EVENT_RETURN, f, 0);
+    }
+
+    // f was left by an error
+    void unwind(Function* f) {
+        record(EVENT_UNWIND, f, 0);
+    }
+
+    void statement(uint32_t line) {
+        record(EVENT_STATEMENT, nullptr, line);
+    }
+
+    // The last count events, oldest first, one per line; empty if none.
+    std::string recent(uint32_t count) const {
+        std::string out;
+        if (next != 0) {
+            out = "recent events, oldest first:\n";
+        }
+        write(count, [&](const char* text, size_t size) {
+            out.append(text, size);
+        });
+        return out;
+    }
+
+    // Makes this the recorder the fatal signal and terminate handlers dump
+    // for the calling thread, and gives the thread a stack of its own to
+    // run the signal handler on, so that a stack overflow can be reported
+    // too. The handlers flush output first, if given.
+    void install(Output* output = nullptr) {
+        current = this;
+        this->output = output;
+        static thread_local char alt[64 * 1024];
+        stack_t ss = {};
+        ss.ss_sp = alt;
+        ss.ss_size = sizeof(alt);
+        sigaltstack(&ss, nullptr);
+    }
+
+    // Installs the handlers, for the whole process.
+    static void catchFatal() {
+        static const int SIGNALS[] = { SIGSEGV, SIGFPE, SIGBUS, SIGILL, SIGABRT };
+        for (int s : SIGNALS) {
+            struct sigaction action = {};
+            action.sa_handler = onFatal;
+            action.sa_flags = SA_ONSTACK | SA_RESETHAND;
+            sigemptyset(&action.sa_mask);
+            sigaction(s, &action, nullptr);
+        }
+        std::set_terminate(onTerminate);
+    }
+
+private:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    struct Event {
+        Function* function;
+        uint32_t line;
+        EventKind kind;
+    };
+
+    static inline thread_local FlightRecorder* current = nullptr;
+
+    Event events[CAPACITY] = {};
+    uint64_t next = 0;
+    // the program output of the interpreter being recorded
+    Output* output = nullptr;
+
+    void record(EventKind kind, Function* f, uint32_t line) {
+        Event& e = events[next++ & (CAPACITY - 1)];
+        e.function = f;
+        e.line = line;
+        e.kind = kind;
+    }
+
+    // Formats the last count events into a stack buffer each and hands
+    // them to out, so a signal handler can use it.
+    template <class Out>
+    void write(uint32_t count, Out out) const {
+        uint64_t n = next < count ? next : count;
+        for (uint64_t i = next - n; i < next; i++) {
+            const Event& e = events[i & (CAPACITY - 1)];
+            char line[128];
+            size_t size = format(e, line, sizeof(line));
+            out(line, size);
+        }
+    }
+
+    static size_t format(const Event& e, char* buf, size_t capacity) {
+        size_t size = 0;
+        auto add = [&](const char* s, size_t n) {
+            n = n < capacity - 1 - size ? n : capacity - 1 - size;
+            std::memcpy(buf + size, s, n);
+            size += n;
+        };
+        add("  ", 2);
+        switch (e.kind) {
+        case EVENT_STATEMENT: {
+            add("line ", 5);
+            char digits[12];
+            size_t d = sizeof(digits);
+            uint32_t v = e.line;
+            do {
+                digits[--d] = (char)('0' + v % 10);
+                v /= 10;
+            } while (v != 0);
+            add(digits + d, sizeof(digits) - d);
+            break;
+        }
+        case EVENT_CALL: add("call ", 5); break;
+        case EVENT_RETURN: add("return ", 7); break;
+        case EVENT_UNWIND: add("error out of ", 13); break;
+        default: add("?", 1);
+        }
+        if (e.kind != EVENT_STATEMENT && e.function != nullptr) {
+            add(e.function->name.value.data(), e.function->name.value.size());
+        }
+        add("\n", 1);
+        return size;
+    }
+
+    static void dump(const char* why) {
+        FlightRecorder* r = current;
+        if (r != nullptr && r->output != nullptr) {
+            r->output->flushFromSignal();
+        }
+        ::write(2, why, std::strlen(why));
+        if (r != nullptr) {
+            const char* header = "recent events, oldest first:\n";
+            ::write(2, header, std::strlen(header));
+            r->write(CAPACITY, [](const char* text, size_t size) {
+                ::write(2, text, size);
+            });
+        }
+    }
+
+    static void onFatal(int signal) {
+        const char* why = "fatal signal\n";
+        switch (signal) {
+        case SIGSEGV: why = "fatal signal: segmentation fault\n"; break;
+        case SIGFPE: why = "fatal signal: arithmetic error\n"; break;
+        case SIGBUS: why = "fatal signal: bus error\n"; break;
+        case SIGILL: why = "fatal signal: illegal instruction\n"; break;
+        case SIGABRT: why = "fatal signal: abort\n"; break;
+        }
+        dump(why);
+        // the handler was reset: this time the signal kills the process
+        raise(signal);
+    }
+
+    static void onTerminate() {
+        // abort() would dump again
+        signal(SIGABRT, SIG_DFL);
+        dump("terminated by an uncaught exception\n");
+        std::abort();
+    }
+};
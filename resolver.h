@@ -0,0 +1,379 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "hashmap.h"
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+
+// Static pass run between the parser and the interpreter. It decides, with
+// Python's scoping rules, whether every name is a local of the current
+// function, a variable captured from an enclosing function, or a global,
+// and gives each function a flat frame layout:
+//
+//   - a name assigned anywhere in a function (or a parameter, or a nested
+//     def) is local to it unless declared global or nonlocal;
+//   - a name that is not local but is local to an enclosing function is
+//     captured. Every function between the owner and the user captures it
+//     too, so a closure only ever copies Cells out of its immediate parent's
+//     frame when its def runs, and reads them back from its own frame;
+//   - anything else is global.
+class Resolver : Visitor<void> {
+public:
+    Resolver() {}
+
+    void resolve(std::vector<Statement*>& stmts) {
+        for (Statement* s : stmts) {
+            s->accept(this);
+        }
+    }
+
+private:
+    struct Scope {
+        Function* function;
+        Scope* parent;
+        HashMap<std::string, int> locals;
+        std::vector<bool> is_cell;
+        HashMap<std::string, bool> globals;
+        HashMap<std::string, bool> nonlocals;
+        HashMap<std::string, int> free;
+        // slot in the parent frame each free variable is captured from
+        std::vector<int> captures;
+        // LOCAL refs whose kind becomes CELL if something captures the slot
+        std::vector<VarRef*> local_refs;
+    };
+
+    Scope* scope = nullptr;
+
+    void declare(Scope* s, const std::string& name) {
+        if (s->locals.find(name) == nullptr) {
+            s->locals.set(name, (int)s->is_cell.size());
+            s->is_cell.push_back(false);
+        }
+    }
+
+    // Assignments anywhere in the body, not descending into nested defs.
+    void collect(Statement* stmt, std::vector<std::string>& assigned, Scope* s) {
+        if (Var* v = dynamic_cast<Var*>(stmt)) {
+            assigned.push_back(v->name.value);
+        }
+        else if (For* f = dynamic_cast<For*>(stmt)) {
+            assigned.push_back(f->name.value);
+            collect(f->body, assigned, s);
+        }
+        else if (Function* f = dynamic_cast<Function*>(stmt)) {
+            assigned.push_back(f->name.value);
+        }
+        else if (Block* b = dynamic_cast<Block*>(stmt)) {
+            for (Statement* inner : b->statements) {
+                collect(inner, assigned, s);
+            }
+        }
+        else if (If* i = dynamic_cast<If*>(stmt)) {
+            collect(i->thenBranch, assigned, s);
+            if (i->elseBranch != nullptr) {
+                collect(i->elseBranch, assigned, s);
+            }
+        }
+        else if (Import* i = dynamic_cast<Import*>(stmt)) {
+            if (i->names.empty()) {
+                assigned.push_back(i->module.value);
+            }
+            for (auto& n : i->names) {
+                assigned.push_back(n.value);
+            }
+        }
+        else if (Global* g = dynamic_cast<Global*>(stmt)) {
+            for (auto& n : g->names) {
+                s->globals.set(n.value, true);
+            }
+        }
+        else if (Nonlocal* n = dynamic_cast<Nonlocal*>(stmt)) {
+            for (auto& name : n->names) {
+                s->nonlocals.set(name.value, true);
+            }
+        }
+    }
+
+    // Sets yields on the statements that are or contain a yield, not
+    // descending into nested defs.
+    bool markYields(Statement* stmt) {
+        bool yields = false;
+        if (dynamic_cast<Yield*>(stmt) != nullptr) {
+            yields = true;
+        }
+        else if (For* f = dynamic_cast<For*>(stmt)) {
+            yields = markYields(f->body);
+        }
+        else if (Block* b = dynamic_cast<Block*>(stmt)) {
+            for (Statement* inner : b->statements) {
+                yields = markYields(inner) || yields;
+            }
+        }
+        else if (If* i = dynamic_cast<If*>(stmt)) {
+            yields = markYields(i->thenBranch);
+            if (i->elseBranch != nullptr) {
+                yields = markYields(i->elseBranch) || yields;
+            }
+        }
+        stmt->yields = yields;
+        return yields;
+    }
+
+    bool isLocal(Scope* s, const std::string& name) {
+        return s->locals.find(name) != nullptr && !s->globals.contains(name) && !s->nonlocals.contains(name);
+    }
+
+    // Slot of s's frame holding the Cell for name, or -1 when no enclosing
+    // function binds it.
+    int capture(Scope* s, const std::string& name) {
+        if (int* slot = s->free.find(name)) {
+            return *slot;
+        }
+        Scope* p = s->parent;
+        if (p == nullptr || p->globals.contains(name)) {
+            return -1;
+        }
+        int from;
+        if (isLocal(p, name)) {
+            from = *p->locals.find(name);
+            p->is_cell[from] = true;
+        }
+        else {
+            from = capture(p, name);
+            if (from < 0) {
+                return -1;
+            }
+        }
+        // all locals are declared before the body is visited, so the free
+        // slots can be numbered after them straight away
+        int slot = (int)(s->is_cell.size() + s->captures.size());
+        s->captures.push_back(from);
+        s->free.set(name, slot);
+        return slot;
+    }
+
+    void bind(VarRef& ref, const std::string& name) {
+        if (scope == nullptr || scope->globals.contains(name)) {
+            ref.kind = VAR_GLOBAL;
+            return;
+        }
+        if (isLocal(scope, name)) {
+            ref.kind = VAR_LOCAL;
+            ref.slot = *scope->locals.find(name);
+            scope->local_refs.push_back(&ref);
+            return;
+        }
+        int slot = capture(scope, name);
+        if (slot >= 0) {
+            ref.kind = VAR_FREE;
+            ref.slot = slot;
+        }
+        else if (scope->nonlocals.contains(name)) {
+            throw std::runtime_error("no binding for nonlocal '" + name + "' found");
+        }
+        else {
+            ref.kind = VAR_GLOBAL;
+        }
+    }
+
+    void finish(Scope* s) {
+        Function* f = s->function;
+        f->free_base = (int)s->is_cell.size();
+        f->num_slots = f->free_base + (int)s->captures.size();
+        f->captures = s->captures;
+        f->cells.clear();
+        for (size_t i = 0; i < s->is_cell.size(); i++) {
+            if (s->is_cell[i]) {
+                f->cells.push_back((int)i);
+            }
+        }
+        for (VarRef* ref : s->local_refs) {
+            if (s->is_cell[ref->slot]) {
+                ref->kind = VAR_CELL;
+            }
+        }
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        stmt->initial->accept(this);
+        bind(stmt->ref, stmt->name.value);
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        for (Statement* s : stmt->statements) {
+            s->accept(this);
+        }
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        stmt->expr->accept(this);
+    };
+
+    void visitForStmt(For* stmt) override {
+        stmt->iterable->accept(this);
+        bind(stmt->ref, stmt->name.value);
+        stmt->body->accept(this);
+    };
+
+    void visitFunctionStmt(Function* stmt) override {
+        bind(stmt->binding, stmt->name.value);
+
+        Scope s;
+        s.function = stmt;
+        s.parent = scope;
+        for (auto& p : stmt->params) {
+            declare(&s, p.value);
+        }
+        std::vector<std::string> assigned;
+        for (Statement* b : stmt->body) {
+            collect(b, assigned, &s);
+            stmt->generator = markYields(b) || stmt->generator;
+        }
+        for (auto& name : assigned) {
+            if (!s.globals.contains(name) && !s.nonlocals.contains(name)) {
+                declare(&s, name);
+            }
+        }
+
+        scope = &s;
+        for (Statement* b : stmt->body) {
+            b->accept(this);
+        }
+        // nonlocal names nothing reads still have to exist
+        for (auto& e : s.nonlocals) {
+            if (capture(&s, e.key) < 0) {
+                throw std::runtime_error("no binding for nonlocal '" + e.key + "' found");
+            }
+        }
+        scope = s.parent;
+        finish(&s);
+    };
+
+    void visitGlobalStmt(Global* stmt) override {};
+
+    void visitIfStmt(If* stmt) override {
+        stmt->condition->accept(this);
+        stmt->thenBranch->accept(this);
+        if (stmt->elseBranch != nullptr) {
+            stmt->elseBranch->accept(this);
+        }
+    };
+
+    void visitImportStmt(Import* stmt) override {
+        if (stmt->names.empty()) {
+            bind(stmt->refs[0], stmt->module.value);
+        }
+        for (size_t i = 0; i < stmt->names.size(); i++) {
+            bind(stmt->refs[i], stmt->names[i].value);
+        }
+    };
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {
+        if (scope == nullptr) {
+            throw std::runtime_error("nonlocal declaration not allowed at module level");
+        }
+    };
+
+    void visitPrintStatement(Print* stmt) override {
+        for (Expr* e : stmt->exprs) {
+            e->accept(this);
+        }
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        if (stmt->value != nullptr) {
+            stmt->value->accept(this);
+        }
+    };
+
+    void visitYieldStmt(Yield* stmt) override {
+        if (scope == nullptr) {
+            throw std::runtime_error("'yield' outside function");
+        }
+        if (stmt->value != nullptr) {
+            stmt->value->accept(this);
+        }
+    };
+
+    void visitAssignExpr(Assign* expr) override {};
+
+    void visitBinaryExpr(Binary* expr) override {
+        expr->left->accept(this);
+        expr->right->accept(this);
+    };
+
+    void visitCallExpr(Call* expr) override {
+        if (expr->object != nullptr) {
+            expr->object->accept(this);
+        }
+        else {
+            bind(expr->ref, expr->callee.value);
+        }
+        for (Expr* a : expr->args) {
+            a->accept(this);
+        }
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        expr->condition->accept(this);
+        expr->thenBranch->accept(this);
+        expr->elseBranch->accept(this);
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        for (size_t i = 0; i < expr->keys.size(); i++) {
+            expr->keys[i]->accept(this);
+            expr->values[i]->accept(this);
+        }
+    };
+
+    void visitGetExpr(Get* expr) override {
+        expr->object->accept(this);
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        expr->expression->accept(this);
+    };
+
+    // inlining comes after resolving; the copy was resolved in its function
+    void visitInlineExpr(Inline* expr) override {
+        expr->call->accept(this);
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        for (Expr* e : expr->items) {
+            e->accept(this);
+        }
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        if (expr->token.type == IDENTIFIER) {
+            bind(expr->ref, expr->token.value);
+        }
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        expr->left->accept(this);
+        expr->right->accept(this);
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        expr->object->accept(this);
+        expr->index->accept(this);
+        expr->value->accept(this);
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        expr->object->accept(this);
+        expr->index->accept(this);
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        expr->right->accept(this);
+    };
+
+    void visitVariableExpr(Variable* expr) override {};
+};
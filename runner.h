@@ -0,0 +1,444 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "scanner.h"
+#include "parser.h"
+#include "resolver.h"
+#include "interpreter.h"
+#include "output.h"
+#include "stats.h"
+#include "typecheck.h"
+#include "inline.h"
+#include "snapshot.h"
+
+// Command line settings applied to every interpreter.
+struct RunOptions {
+    bool use_jit = true;
+    bool specialize = true;
+    Engine engine = ENGINE_WALK;
+    // threads for parallel_map
+    unsigned parallel_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    // execution budget of each script, 0 for none (budget.h)
+    uint64_t max_steps = 0;
+    uint64_t max_ms = 0;
+    uint64_t max_memory = 0;
+    uint64_t max_depth = 0;
+    // where --profile writes collapsed stacks; empty when not profiling
+    std::string profile;
+    // --alloc-profile records one allocation in this many; 0 when not
+    // profiling allocations
+    uint64_t alloc_profile = 0;
+    // --line-profile
+    bool line_profile = false;
+    // --stats, --stats=json
+    bool stats = false;
+    bool stats_json = false;
+    // type check the script before running it (typecheck.h); with check,
+    // only type check it
+    bool typecheck = true;
+    bool check = false;
+    // inline small functions (inline.h); --inline-report lists the calls
+    bool inline_calls = true;
+    bool inline_report = false;
+    // write an image of the interpreter at the script's `# snapshot` line,
+    // or run the rest of the script from one (snapshot.h); empty when not
+    std::string snapshot_out;
+    std::string snapshot_in;
+};
+
+inline std::string openFile(std::string filename) {
+    std::ifstream file;
+    file.open(filename);
+
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    file.close();
+    return contents;
+}
+
+// Applies the engine and budget settings of options to interpreter.
+inline void configure(Interpreter& interpreter, const RunOptions& options) {
+    interpreter.jit.enabled = interpreter.jit.enabled && options.use_jit;
+    interpreter.specializer.enabled = options.specialize;
+    interpreter.engine = options.engine;
+    interpreter.parallel_jobs = options.parallel_jobs;
+    interpreter.budget.max_steps = options.max_steps;
+    interpreter.budget.max_ms = options.max_ms;
+    interpreter.budget.max_memory = options.max_memory;
+    interpreter.budget.max_depth = options.max_depth;
+    // compiled code does not count steps or calls, or keep the shadow stack
+    interpreter.jit.enabled = interpreter.jit.enabled && !interpreter.budget.limited() && options.profile.empty() &&
+                              !options.stats;
+}
+
+// Scans, parses, resolves and runs one script. On failure returns false
+// with the message in error; output printed so far stays in the
+// interpreter's buffer. stats, if given, is filled in either way. Type
+// errors found before the run and the inlining report go to warnings, or
+// to stderr if it is null.
+inline bool runScript(const std::string& filename, const RunOptions& options, Interpreter& interpreter, std::string& error,
+                      RunStats* stats = nullptr, std::string* warnings = nullptr) {
+    RunStats unused;
+    RunStats& st = stats != nullptr ? *stats : unused;
+    st.begin(PHASE_READ);
+    std::string code = openFile(filename);
+    st.source_bytes = code.size();
+
+    interpreter.module_path.addScript(filename);
+    interpreter.module_path.addEnvironment(getenv("MYPYTHONPATH"));
+    configure(interpreter, options);
+    std::unique_ptr<Profiler> profiler;
+    if (!options.profile.empty()) {
+        profiler.reset(new Profiler());
+        interpreter.shadow = &profiler->stack;
+        profiler->start();
+    }
+    // only the tree walker, on the original AST, tracks allocation sites
+    // and statements
+    if (options.alloc_profile != 0 || options.line_profile) {
+        interpreter.jit.enabled = false;
+        interpreter.specializer.enabled = false;
+        interpreter.engine = ENGINE_WALK;
+    }
+    std::unique_ptr<AllocationProfiler> allocs;
+    if (options.alloc_profile != 0) {
+        allocs.reset(new AllocationProfiler(options.alloc_profile));
+        interpreter.allocs = allocs.get();
+    }
+    std::unique_ptr<LineProfiler> lines;
+    if (options.line_profile) {
+        lines.reset(new LineProfiler());
+        interpreter.lines = lines.get();
+    }
+    interpreter.recorder.install(&interpreter.out);
+    std::vector<Statement*> s;
+    bool ok = true;
+    try {
+        st.begin(PHASE_SCAN);
+        Scanner scan(code);
+        std::vector<Token> tokens = scan.getTokens();
+        st.tokens = tokens.size();
+        st.begin(PHASE_PARSE);
+        Parser parser(tokens);
+        s = parser.parse();
+        st.begin(PHASE_RESOLVE);
+        Resolver resolver;
+        resolver.resolve(s);
+        if (stats != nullptr) {
+            AstSize size;
+            size.count(s);
+            st.ast_nodes = size.nodes;
+            st.ast_bytes = size.bytes;
+        }
+        if (options.typecheck || options.check) {
+            TypeChecker checker;
+            checker.check(s);
+            std::string found;
+            for (const TypeChecker::Error& e : checker.errors) {
+                found += filename + ":" + std::to_string(e.line) + ": TypeError: " + e.message + "\n";
+            }
+            if (warnings != nullptr) {
+                *warnings += found;
+            }
+            else {
+                std::cerr << found;
+            }
+            // nothing to run: the profilers are not used with check
+            if (options.check) {
+                st.end();
+                if (!checker.errors.empty()) {
+                    error = std::to_string(checker.errors.size()) + " type error(s) in " + filename;
+                    return false;
+                }
+                return true;
+            }
+        }
+        // the profilers see every call
+        if (options.inline_calls && options.profile.empty() && allocs == nullptr && lines == nullptr) {
+            Inliner inliner;
+            inliner.inlineCalls(s);
+            if (options.inline_report) {
+                std::ostringstream report;
+                inliner.report(report);
+                if (warnings != nullptr) {
+                    *warnings += report.str();
+                }
+                else {
+                    std::cerr << report.str();
+                }
+            }
+        }
+
+        //Printer printer;
+        //printer.print(s);
+
+        st.begin(PHASE_RUN);
+        st.startObjects();
+        interpreter.budget.start();
+        if (allocs != nullptr) {
+            allocs->start();
+        }
+        if (lines != nullptr) {
+            lines->start();
+        }
+        // with --snapshot-out, only up to the marker, and the image is
+        // written if that much ran
+        size_t resume = options.snapshot_out.empty() ? s.size() : snapshotPoint(code, s);
+        try {
+            if (resume == s.size()) {
+                interpreter.run(s);
+            }
+            else {
+                interpreter.run(std::vector<Statement*>(s.begin(), s.begin() + resume));
+            }
+        }
+        catch (...) {
+            if (allocs != nullptr) {
+                allocs->stop();
+            }
+            st.endObjects();
+            throw;
+        }
+        if (allocs != nullptr) {
+            allocs->stop();
+        }
+        st.endObjects();
+        if (!options.snapshot_out.empty()) {
+            SnapshotWriter(interpreter).write(options.snapshot_out, filename, s, resume);
+        }
+    }
+    catch (std::exception& e) {
+        error = e.what();
+        std::string events = interpreter.recorder.recent(FlightRecorder::TAIL);
+        if (!events.empty()) {
+            events.pop_back();
+            error += "\n" + events;
+        }
+        ok = false;
+    }
+    st.end();
+    st.calls = interpreter.calls;
+    st.max_depth = interpreter.max_depth;
+    if (profiler != nullptr) {
+        profiler->stop();
+        interpreter.shadow = nullptr;
+        interpreter.out.flush();
+        try {
+            profiler->report(options.profile, std::cerr);
+        }
+        catch (std::exception& e) {
+            if (ok) {
+                error = e.what();
+                ok = false;
+            }
+        }
+    }
+    if (allocs != nullptr) {
+        interpreter.allocs = nullptr;
+        interpreter.out.flush();
+        allocs->report(std::cerr);
+    }
+    if (lines != nullptr) {
+        interpreter.lines = nullptr;
+        interpreter.out.flush();
+        lines->report(s, code, std::cerr);
+    }
+    return ok;
+}
+
+// Loads the image of options.snapshot_in and runs the statements of its
+// script after the snapshot point, as runScript would have. The script is
+// not read again.
+inline bool resumeSnapshot(const RunOptions& options, Interpreter& interpreter, std::string& error, RunStats* stats = nullptr) {
+    RunStats unused;
+    RunStats& st = stats != nullptr ? *stats : unused;
+    configure(interpreter, options);
+    interpreter.recorder.install(&interpreter.out);
+    bool ok = true;
+    try {
+        st.begin(PHASE_READ);
+        SnapshotReader image(interpreter);
+        image.read(options.snapshot_in);
+        st.source_bytes = image.bytes;
+        interpreter.module_path.addScript(image.script);
+        interpreter.module_path.addEnvironment(getenv("MYPYTHONPATH"));
+        if (stats != nullptr) {
+            AstSize size;
+            size.count(image.program);
+            st.ast_nodes = size.nodes;
+            st.ast_bytes = size.bytes;
+        }
+
+        st.begin(PHASE_RUN);
+        st.startObjects();
+        interpreter.budget.start();
+        try {
+            interpreter.run(std::vector<Statement*>(image.program.begin() + image.resume, image.program.end()));
+        }
+        catch (...) {
+            st.endObjects();
+            throw;
+        }
+        st.endObjects();
+    }
+    catch (std::exception& e) {
+        error = e.what();
+        std::string events = interpreter.recorder.recent(FlightRecorder::TAIL);
+        if (!events.empty()) {
+            events.pop_back();
+            error += "\n" + events;
+        }
+        ok = false;
+    }
+    st.end();
+    st.calls = interpreter.calls;
+    st.max_depth = interpreter.max_depth;
+    return ok;
+}
+
+// Runs many scripts on a pool of threads, each in its own Interpreter with
+// its output captured, and prints every script's output in the order the
+// scripts were given, as soon as it and all scripts before it are done.
+// Interpreters share nothing but the read-only module cache.
+class BatchRunner {
+public:
+    // The .py files of a directory, sorted by name, or the paths listed in
+    // a file, one per line.
+    static std::vector<std::string> collect(const std::string& source) {
+        std::vector<std::string> scripts;
+        struct stat st;
+        if (stat(source.c_str(), &st) != 0) {
+            throw std::runtime_error("cannot open '" + source + "'");
+        }
+        if (S_ISDIR(st.st_mode)) {
+            DIR* dir = opendir(source.c_str());
+            if (dir == nullptr) {
+                throw std::runtime_error("cannot open '" + source + "'");
+            }
+            while (struct dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name.size() > 3 && name.compare(name.size() - 3, 3, ".py") == 0) {
+                    scripts.push_back(source + "/" + name);
+                }
+            }
+            closedir(dir);
+            std::sort(scripts.begin(), scripts.end());
+        }
+        else {
+            std::ifstream list(source);
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty()) {
+                    scripts.push_back(line);
+                }
+            }
+        }
+        return scripts;
+    }
+
+    // Returns the number of scripts that failed.
+    size_t run(const std::vector<std::string>& scripts, const RunOptions& options, unsigned jobs, Output& out) {
+        results.assign(scripts.size(), Result());
+        next = 0;
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < std::max(jobs, 1u); i++) {
+            workers.emplace_back([&]() { work(scripts, options); });
+        }
+
+        size_t failed = 0;
+        for (size_t i = 0; i < scripts.size(); i++) {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&]() { return results[i].done; });
+            lock.unlock();
+
+            Result& r = results[i];
+            out.write("==> ");
+            out.write(scripts[i]);
+            out.write(" <==");
+            out.newline();
+            // to stderr, as for a single script, after the header so it is
+            // clear which script they are about
+            if (!r.warnings.empty()) {
+                out.flush();
+                std::cerr << r.warnings;
+            }
+            out.write(r.output);
+            if (!r.ok) {
+                out.write(r.error);
+                out.newline();
+                failed++;
+            }
+            if (!r.stats.empty()) {
+                out.flush();
+                std::cerr << r.stats;
+            }
+            // release it, the batch can be large
+            std::string().swap(r.output);
+        }
+
+        for (std::thread& t : workers) {
+            t.join();
+        }
+        return failed;
+    }
+
+private:
+    struct Result {
+        std::string output;
+        // type errors and the inlining report
+        std::string warnings;
+        // --stats, to stderr as for a single script
+        std::string stats;
+        std::string error;
+        bool ok = false;
+        bool done = false;
+    };
+
+    std::vector<Result> results;
+    std::atomic<size_t> next;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    void work(const std::vector<std::string>& scripts, const RunOptions& options) {
+        for (size_t i = next++; i < scripts.size(); i = next++) {
+            std::string output;
+            std::string error;
+            std::string warnings;
+            std::string report;
+            bool ok;
+            {
+                Interpreter interpreter(&output);
+                RunStats stats;
+                ok = runScript(scripts[i], options, interpreter, error, options.stats ? &stats : nullptr, &warnings);
+                interpreter.out.flush();
+                if (options.stats) {
+                    report = stats.format(options.stats_json);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results[i].output.swap(output);
+            results[i].warnings.swap(warnings);
+            results[i].stats.swap(report);
+            results[i].error.swap(error);
+            results[i].ok = ok;
+            results[i].done = true;
+            finished.notify_all();
+        }
+    }
+};
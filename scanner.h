@@ -36,6 +36,13 @@ private:
     int current = 0;
     bool checkIndent = false;
     int currSpaces = 0;
+    // open (, [ and { -- newlines inside them are not significant
+    int nesting = 0;
+    // position of start: its line, where that line begins, and how far
+    // the code has been searched for line breaks
+    uint32_t line = 1;
+    int lineStart = 0;
+    int located = 0;
     std::map<std::string, TokenType> keywords = {
         {"if", IF},
         {"else", ELSE},
@@ -47,7 +54,14 @@ private:
         {"True", TRUE},
         {"False", FALSE},
         {"None", NONE},
-        {"print", PRINT}
+        {"print", PRINT},
+        {"for", FOR},
+        {"in", IN},
+        {"global", GLOBAL},
+        {"nonlocal", NONLOCAL},
+        {"import", IMPORT},
+        {"from", FROM},
+        {"yield", YIELD}
     };
 
     void scanTokens() {
@@ -55,6 +69,14 @@ private:
             start = current;
             scanToken();
         }
+        // close the last line and any blocks still open at end of file
+        if (!tokens.empty() && tokens.back().type != NEWLINE) {
+            addToken(NEWLINE);
+        }
+        while (currSpaces > 0) {
+            addToken(DEDENT);
+            currSpaces -= INDENT_SIZE;
+        }
         addToken(END);
     }
 
@@ -74,6 +96,9 @@ private:
             return;
         }
         if (c == '\n') {
+            if (nesting > 0) {
+                return;
+            }
             addToken(NEWLINE);
             checkIndent = true;
             return;
@@ -88,14 +113,40 @@ private:
         }
         if (c == '(') 
         {
+            nesting++;
             addToken(LPARAN); 
             return;
         }
         if (c == ')') 
         {
+            nesting--;
             addToken(RPARAN); 
             return;
         }
+        if (c == '{')
+        {
+            nesting++;
+            addToken(LBRACE);
+            return;
+        }
+        if (c == '}')
+        {
+            nesting--;
+            addToken(RBRACE);
+            return;
+        }
+        if (c == '[')
+        {
+            nesting++;
+            addToken(LBRACKET);
+            return;
+        }
+        if (c == ']')
+        {
+            nesting--;
+            addToken(RBRACKET);
+            return;
+        }
         if (c == '-') 
         {
             addToken(MINUS); 
@@ -108,7 +159,7 @@ private:
         }
         if (c == '/') 
         {
-            addToken(DIVIDE); 
+            addToken(match('/') ? FLOOR_DIVIDE : DIVIDE); 
             return;
         }
         if (c == '*') 
@@ -120,6 +171,14 @@ private:
             addToken(COMMA);
             return;
         }
+        if (c == '.' && isNumeric(peek())) {
+            number();
+            return;
+        }
+        if (c == '.') {
+            addToken(DOT);
+            return;
+        }
         if (c == ':')
         {
             addToken(COLON); 
@@ -269,21 +328,56 @@ private:
         }
     }
 
+    // 12, or a float: 1.5, 1., .5, 1e3, 2.5E-4
     void number() {
+        bool is_float = code[start] == '.';
         while (isNumeric(peek())) advance();
-        addToken(NUMBER, code.substr(start, current - start));
+        if (!is_float && peek() == '.') {
+            is_float = true;
+            advance();
+            while (isNumeric(peek())) advance();
+        }
+        if (peek() == 'e' || peek() == 'E') {
+            size_t digits = current + 1;
+            if (digits < code.size() && (code[digits] == '+' || code[digits] == '-')) {
+                digits++;
+            }
+            if (digits < code.size() && isNumeric(code[digits])) {
+                is_float = true;
+                current = digits;
+                while (isNumeric(peek())) advance();
+            }
+        }
+        addToken(is_float ? FLOAT : NUMBER, code.substr(start, current - start));
     }
 
     void addToken(TokenType t) {
-        tokens.push_back(Token(t, ""));
+        addToken(t, "");
     }
 
     void addToken(TokenType t, std::string v) {
-        tokens.push_back(Token(t, v));
+        Token token(t, v);
+        locate();
+        token.line = line;
+        token.column = (uint16_t)std::min(start - lineStart + 1, 0xffff);
+        tokens.push_back(token);
+    }
+
+    // Brings line and lineStart up to start; tokens are added in order, so
+    // each character is looked at once.
+    void locate() {
+        for (; located < start; located++) {
+            if (code[located] == '\n') {
+                line++;
+                lineStart = located + 1;
+            }
+        }
     }
 
     void error() {
-        throw std::runtime_error("Error parsing character");
+        locate();
+        throw std::runtime_error("Error parsing character at line " + std::to_string(line) + ", column "
+            + std::to_string(start - lineStart + 1));
     }
 };
 
@@ -0,0 +1,1203 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hashmap.h"
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+#include "object.h"
+#include "environment.h"
+#include "interpreter.h"
+
+// Heap snapshots, for programs whose top-level code takes long to set up.
+//
+// --snapshot-out runs a script's top-level statements up to a line that is
+// only `# snapshot` (or all of them) and writes an image of the interpreter
+// at that point: the script's tree as the Resolver, the type checker and
+// the inliner left it, the globals and functions of the script and of every
+// module it imported, and every object they reach. --snapshot-in maps the
+// image, rebuilds all of it in one pass and runs the statements after the
+// marker, without reading, parsing or checking the script again and
+// without rerunning its setup or its imports.
+//
+// Objects, environments and functions are written once each and refer to
+// each other by index, so sharing and cycles survive and the image does not
+// depend on where it is mapped. Run-time state is not saved: the JIT, the
+// specializer and the inline caches start over, and the output printed
+// before the marker is not printed again. A generator alive at the marker
+// cannot be saved. The image is only read by a build with the same format
+// version, and only if its checksum matches.
+
+enum SnapshotNode : uint8_t {
+    NODE_NULL,
+    // statements
+    NODE_BLOCK, NODE_EXPRESSION, NODE_FOR, NODE_FUNCTION, NODE_GLOBAL, NODE_IF,
+    NODE_IMPORT, NODE_NONLOCAL, NODE_PRINT, NODE_RETURN, NODE_VAR, NODE_YIELD,
+    // a def written earlier in the image, by index
+    NODE_FUNCTION_REF,
+    // expressions
+    NODE_ASSIGN, NODE_BINARY, NODE_CALL, NODE_CONDITIONAL, NODE_DICT_LITERAL,
+    NODE_GET, NODE_GROUPING, NODE_INLINE, NODE_LIST_LITERAL, NODE_LITERAL,
+    NODE_LOGICAL, NODE_SET_ITEM, NODE_SUBSCRIPT, NODE_UNARY, NODE_VARIABLE,
+};
+
+enum SnapshotObject : uint8_t {
+    OBJECT_INT, OBJECT_FLOAT, OBJECT_BOOL, OBJECT_STRING, OBJECT_NONE,
+    OBJECT_LIST, OBJECT_DICT, OBJECT_CELL, OBJECT_CLOSURE, OBJECT_MODULE,
+};
+
+const char SNAPSHOT_MAGIC[8] = { 'M', 'Y', 'P', 'Y', 'S', 'N', 'A', 'P' };
+// bumped whenever the layout below or a node's fields change
+const uint32_t SNAPSHOT_VERSION = 1;
+// magic, version and checksum of the rest
+const size_t SNAPSHOT_HEADER = sizeof(SNAPSHOT_MAGIC) + sizeof(uint32_t) + sizeof(uint64_t);
+// index of a null reference
+const uint32_t SNAPSHOT_NULL = UINT32_MAX;
+
+// FNV-1a, eight bytes at a time: the image is trusted like a parsed
+// script, so a damaged one must not get as far as running
+inline uint64_t snapshotChecksum(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Index of the first top-level statement after the `# snapshot` line of
+// code, or the number of statements if there is none.
+inline size_t snapshotPoint(const std::string& code, const std::vector<Statement*>& program) {
+    uint32_t line = 1;
+    size_t start = 0;
+    while (start < code.size()) {
+        size_t end = code.find('\n', start);
+        if (end == std::string::npos) {
+            end = code.size();
+        }
+        std::string text = code.substr(start, end - start);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+            text.pop_back();
+        }
+        if (text == "# snapshot") {
+            for (size_t i = 0; i < program.size(); i++) {
+                if (program[i]->line > line) {
+                    return i;
+                }
+            }
+            break;
+        }
+        start = end + 1;
+        line++;
+    }
+    return program.size();
+}
+
+// Writes the image of an interpreter whose top level has run up to resume.
+class SnapshotWriter : Visitor<void> {
+public:
+    explicit SnapshotWriter(Interpreter& interpreter) : in(interpreter) {}
+
+    void write(const std::string& path, const std::string& script, const std::vector<Statement*>& program, size_t resume) {
+        // finds the defs the closures use, so they are written with the tree
+        discover();
+
+        std::string image;
+        out = &image;
+        image.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        put<uint32_t>(SNAPSHOT_VERSION);
+        put<uint64_t>(0);
+        text(script);
+        put<uint32_t>(resume);
+        statements(program);
+        // defs not in the script's tree: those of imported modules
+        std::string roots;
+        uint32_t count = 0;
+        out = &roots;
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (!written[i]) {
+                functions[i]->accept(this);
+                count++;
+            }
+        }
+        out = &image;
+        put<uint32_t>(count);
+        image += roots;
+        heap();
+        uint64_t checksum = snapshotChecksum(image.data() + SNAPSHOT_HEADER, image.size() - SNAPSHOT_HEADER);
+        std::memcpy(&image[SNAPSHOT_HEADER - sizeof(checksum)], &checksum, sizeof(checksum));
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(image.data(), image.size());
+        if (!file) {
+            throw std::runtime_error("cannot write snapshot '" + path + "'");
+        }
+    }
+
+private:
+    Interpreter& in;
+    std::string* out = nullptr;
+    HashMap<Object*, uint32_t> object_ids;
+    std::vector<Object*> objects;
+    HashMap<Environment*, uint32_t> environment_ids;
+    std::vector<Environment*> environments;
+    HashMap<Function*, uint32_t> function_ids;
+    std::vector<Function*> functions;
+    std::vector<bool> written;
+
+    template <class T>
+    void put(T value) {
+        out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void text(const std::string& s) {
+        put<uint32_t>(s.size());
+        out->append(s);
+    }
+
+    void token(const Token& t) {
+        put<uint8_t>(t.type);
+        put<uint16_t>(t.column);
+        put<uint32_t>(t.line);
+        text(t.value);
+    }
+
+    void tokens(const std::vector<Token>& ts) {
+        put<uint32_t>(ts.size());
+        for (const Token& t : ts) {
+            token(t);
+        }
+    }
+
+    void ref(const VarRef& r) {
+        put<uint8_t>(r.kind);
+        put<int32_t>(r.slot);
+    }
+
+    void ints(const std::vector<int>& values) {
+        put<uint32_t>(values.size());
+        for (int v : values) {
+            put<int32_t>(v);
+        }
+    }
+
+    // --- heap ---
+
+    uint32_t object(Object* o) {
+        if (o == nullptr) {
+            return SNAPSHOT_NULL;
+        }
+        if (uint32_t* id = object_ids.find(o)) {
+            return *id;
+        }
+        object_ids.set(o, objects.size());
+        objects.push_back(o);
+        return objects.size() - 1;
+    }
+
+    uint32_t environment(Environment* env) {
+        if (uint32_t* id = environment_ids.find(env)) {
+            return *id;
+        }
+        environment_ids.set(env, environments.size());
+        environments.push_back(env);
+        return environments.size() - 1;
+    }
+
+    uint32_t function(Function* f) {
+        if (uint32_t* id = function_ids.find(f)) {
+            return *id;
+        }
+        function_ids.set(f, functions.size());
+        functions.push_back(f);
+        written.push_back(false);
+        return functions.size() - 1;
+    }
+
+    static SnapshotObject kind(Object* o) {
+        switch (o->type()) {
+        case TYPE_INT: return OBJECT_INT;
+        case TYPE_FLOAT: return OBJECT_FLOAT;
+        case TYPE_BOOL: return OBJECT_BOOL;
+        case TYPE_STRING: return OBJECT_STRING;
+        case TYPE_NONE: return OBJECT_NONE;
+        case TYPE_LIST: return OBJECT_LIST;
+        case TYPE_DICT: return OBJECT_DICT;
+        case TYPE_FUNCTION: return OBJECT_CLOSURE;
+        }
+        if (dynamic_cast<Cell*>(o) != nullptr) {
+            return OBJECT_CELL;
+        }
+        if (dynamic_cast<Module*>(o) != nullptr) {
+            return OBJECT_MODULE;
+        }
+        if (dynamic_cast<Generator*>(o) != nullptr) {
+            throw std::runtime_error("cannot snapshot a generator");
+        }
+        throw std::runtime_error("cannot snapshot " + o->toString());
+    }
+
+    // the names of a namespace map that are bound
+    template <class V>
+    static uint32_t bound(HashMap<std::string, V*>& names) {
+        uint32_t n = 0;
+        for (auto& e : names) {
+            n += e.value != nullptr;
+        }
+        return n;
+    }
+
+    // numbers every object, environment and def reachable from the globals
+    void discover() {
+        environment(in.global_env);
+        for (auto& e : in.modules) {
+            object(e.value);
+        }
+        size_t next_object = 0;
+        size_t next_environment = 0;
+        while (next_object < objects.size() || next_environment < environments.size()) {
+            if (next_environment < environments.size()) {
+                Environment* env = environments[next_environment++];
+                for (auto& e : env->data) {
+                    object(e.value);
+                }
+                for (auto& e : env->data_function) {
+                    object(e.value);
+                }
+                continue;
+            }
+            Object* o = objects[next_object++];
+            switch (kind(o)) {
+            case OBJECT_LIST:
+                for (Object* item : static_cast<List*>(o)->items) {
+                    object(item);
+                }
+                break;
+            case OBJECT_DICT:
+                for (auto& e : static_cast<Dict*>(o)->items) {
+                    object(e.key);
+                    object(e.value);
+                }
+                break;
+            case OBJECT_CELL:
+                object(static_cast<Cell*>(o)->value);
+                break;
+            case OBJECT_CLOSURE: {
+                Closure* c = static_cast<Closure*>(o);
+                function(c->function);
+                environment(c->globals);
+                for (Object* cell : c->cells) {
+                    object(cell);
+                }
+                break;
+            }
+            case OBJECT_MODULE:
+                environment(static_cast<Module*>(o)->env);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // Every object is written as its kind and value first, then what it
+    // refers to, so the reader can make them all before linking them.
+    void heap() {
+        put<uint32_t>(objects.size());
+        put<uint32_t>(environments.size());
+        for (Object* o : objects) {
+            SnapshotObject k = kind(o);
+            put<uint8_t>(k);
+            switch (k) {
+            case OBJECT_INT:
+                put<int32_t>(static_cast<Integer*>(o)->value);
+                break;
+            case OBJECT_FLOAT:
+                put<double>(static_cast<Float*>(o)->value);
+                break;
+            case OBJECT_BOOL:
+                put<uint8_t>(static_cast<Boolean*>(o)->value);
+                break;
+            case OBJECT_STRING:
+                text(static_cast<String*>(o)->value);
+                break;
+            case OBJECT_CLOSURE:
+                put<uint32_t>(*function_ids.find(static_cast<Closure*>(o)->function));
+                break;
+            case OBJECT_MODULE:
+                text(static_cast<Module*>(o)->name);
+                break;
+            default:
+                break;
+            }
+        }
+        for (Object* o : objects) {
+            switch (kind(o)) {
+            case OBJECT_LIST: {
+                List* list = static_cast<List*>(o);
+                put<uint32_t>(list->items.size());
+                for (Object* item : list->items) {
+                    put<uint32_t>(object(item));
+                }
+                break;
+            }
+            case OBJECT_DICT: {
+                Dict* dict = static_cast<Dict*>(o);
+                put<uint32_t>(dict->items.size());
+                for (auto& e : dict->items) {
+                    put<uint32_t>(object(e.key));
+                    put<uint32_t>(object(e.value));
+                }
+                break;
+            }
+            case OBJECT_CELL:
+                put<uint32_t>(object(static_cast<Cell*>(o)->value));
+                break;
+            case OBJECT_CLOSURE: {
+                Closure* c = static_cast<Closure*>(o);
+                put<uint32_t>(environment(c->globals));
+                put<uint32_t>(c->cells.size());
+                for (Object* cell : c->cells) {
+                    put<uint32_t>(object(cell));
+                }
+                break;
+            }
+            case OBJECT_MODULE:
+                put<uint32_t>(environment(static_cast<Module*>(o)->env));
+                break;
+            default:
+                break;
+            }
+        }
+        // the first is the interpreter's globals
+        for (Environment* env : environments) {
+            // a name rebound to the other kind left a null entry behind
+            put<uint32_t>(bound(env->data));
+            for (auto& e : env->data) {
+                if (e.value != nullptr) {
+                    text(e.key);
+                    put<uint32_t>(object(e.value));
+                }
+            }
+            put<uint32_t>(bound(env->data_function));
+            for (auto& e : env->data_function) {
+                if (e.value != nullptr) {
+                    text(e.key);
+                    put<uint32_t>(object(e.value));
+                }
+            }
+        }
+        put<uint32_t>(in.modules.size());
+        for (auto& e : in.modules) {
+            text(e.key);
+            put<uint32_t>(object(e.value));
+        }
+    }
+
+    // --- tree ---
+
+    void statements(const std::vector<Statement*>& stmts) {
+        put<uint32_t>(stmts.size());
+        for (Statement* s : stmts) {
+            statement(s);
+        }
+    }
+
+    void statement(Statement* stmt) {
+        if (stmt == nullptr) {
+            put<uint8_t>(NODE_NULL);
+            return;
+        }
+        stmt->accept(this);
+    }
+
+    void expressions(const std::vector<Expr*>& exprs) {
+        put<uint32_t>(exprs.size());
+        for (Expr* e : exprs) {
+            expression(e);
+        }
+    }
+
+    void expression(Expr* expr) {
+        if (expr == nullptr) {
+            put<uint8_t>(NODE_NULL);
+            return;
+        }
+        expr->accept(this);
+    }
+
+    void begin(SnapshotNode node, Statement* stmt) {
+        put<uint8_t>(node);
+        put<uint8_t>(stmt->yields);
+        put<uint32_t>(stmt->line);
+    }
+
+    void begin(SnapshotNode node, Expr* expr) {
+        put<uint8_t>(node);
+        put<uint32_t>(expr->line);
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        begin(NODE_VAR, stmt);
+        token(stmt->name);
+        expression(stmt->initial);
+        ref(stmt->ref);
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        begin(NODE_BLOCK, stmt);
+        statements(stmt->statements);
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        begin(NODE_EXPRESSION, stmt);
+        expression(stmt->expr);
+    };
+
+    void visitForStmt(For* stmt) override {
+        begin(NODE_FOR, stmt);
+        token(stmt->name);
+        expression(stmt->iterable);
+        statement(stmt->body);
+        ref(stmt->ref);
+    };
+
+    // the frame layout; none of the run-time state
+    void visitFunctionStmt(Function* stmt) override {
+        uint32_t id = function(stmt);
+        if (written[id]) {
+            put<uint8_t>(NODE_FUNCTION_REF);
+            put<uint32_t>(id);
+            return;
+        }
+        written[id] = true;
+        begin(NODE_FUNCTION, stmt);
+        put<uint32_t>(id);
+        token(stmt->name);
+        tokens(stmt->params);
+        statements(stmt->body);
+        put<int32_t>(stmt->num_slots);
+        put<int32_t>(stmt->free_base);
+        ints(stmt->cells);
+        ints(stmt->captures);
+        ref(stmt->binding);
+        put<uint8_t>(stmt->generator);
+    };
+
+    void visitGlobalStmt(Global* stmt) override {
+        begin(NODE_GLOBAL, stmt);
+        tokens(stmt->names);
+    };
+
+    void visitIfStmt(If* stmt) override {
+        begin(NODE_IF, stmt);
+        expression(stmt->condition);
+        statement(stmt->thenBranch);
+        statement(stmt->elseBranch);
+        put<uint16_t>(stmt->typed);
+    };
+
+    void visitImportStmt(Import* stmt) override {
+        begin(NODE_IMPORT, stmt);
+        token(stmt->module);
+        tokens(stmt->names);
+        for (const VarRef& r : stmt->refs) {
+            ref(r);
+        }
+    };
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {
+        begin(NODE_NONLOCAL, stmt);
+        tokens(stmt->names);
+    };
+
+    void visitPrintStatement(Print* stmt) override {
+        begin(NODE_PRINT, stmt);
+        expressions(stmt->exprs);
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        begin(NODE_RETURN, stmt);
+        token(stmt->keyword);
+        expression(stmt->value);
+    };
+
+    void visitYieldStmt(Yield* stmt) override {
+        begin(NODE_YIELD, stmt);
+        token(stmt->keyword);
+        expression(stmt->value);
+    };
+
+    void visitAssignExpr(Assign* expr) override {
+        begin(NODE_ASSIGN, expr);
+        token(expr->name);
+        expression(expr->value);
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        begin(NODE_BINARY, expr);
+        expression(expr->left);
+        token(expr->op);
+        expression(expr->right);
+        put<uint16_t>(expr->typed);
+    };
+
+    void visitCallExpr(Call* expr) override {
+        begin(NODE_CALL, expr);
+        token(expr->callee);
+        token(expr->paren);
+        expressions(expr->args);
+        expression(expr->object);
+        ref(expr->ref);
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        begin(NODE_CONDITIONAL, expr);
+        expression(expr->condition);
+        expression(expr->thenBranch);
+        expression(expr->elseBranch);
+        put<uint16_t>(expr->typed);
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        begin(NODE_DICT_LITERAL, expr);
+        expressions(expr->keys);
+        expressions(expr->values);
+    };
+
+    void visitGetExpr(Get* expr) override {
+        begin(NODE_GET, expr);
+        expression(expr->object);
+        token(expr->name);
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        begin(NODE_GROUPING, expr);
+        expression(expr->expression);
+    };
+
+    void visitInlineExpr(Inline* expr) override {
+        begin(NODE_INLINE, expr);
+        expression(expr->call);
+        put<uint32_t>(function(expr->function));
+        expression(expr->body);
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        begin(NODE_LIST_LITERAL, expr);
+        expressions(expr->items);
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        begin(NODE_LITERAL, expr);
+        token(expr->token);
+        text(expr->value);
+        ref(expr->ref);
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        begin(NODE_LOGICAL, expr);
+        expression(expr->left);
+        token(expr->op);
+        expression(expr->right);
+        put<uint16_t>(expr->typed);
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        begin(NODE_SET_ITEM, expr);
+        expression(expr->object);
+        expression(expr->index);
+        expression(expr->value);
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        begin(NODE_SUBSCRIPT, expr);
+        expression(expr->object);
+        expression(expr->index);
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        begin(NODE_UNARY, expr);
+        token(expr->op);
+        expression(expr->right);
+        put<uint16_t>(expr->typed);
+    };
+
+    void visitVariableExpr(Variable* expr) override {
+        begin(NODE_VARIABLE, expr);
+        token(expr->name);
+    };
+};
+
+// Maps an image written by SnapshotWriter and rebuilds it into an
+// interpreter that has not run anything yet.
+class SnapshotReader {
+public:
+    // the script the image was made from
+    std::string script;
+    // its tree, and the index of the first statement left to run
+    std::vector<Statement*> program;
+    size_t resume = 0;
+    // size of the image
+    size_t bytes = 0;
+
+    explicit SnapshotReader(Interpreter& interpreter) : in(interpreter) {}
+
+    void read(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("cannot open snapshot '" + path + "'");
+        }
+        bytes = st.st_size;
+        if (bytes < SNAPSHOT_HEADER) {
+            close(fd);
+            throw std::runtime_error("'" + path + "' is not a snapshot");
+        }
+        void* image = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (image == MAP_FAILED) {
+            throw std::runtime_error("cannot map snapshot '" + path + "'");
+        }
+        at = static_cast<const char*>(image);
+        end = at + bytes;
+        try {
+            load(path);
+        }
+        catch (...) {
+            munmap(image, bytes);
+            throw;
+        }
+        munmap(image, bytes);
+    }
+
+private:
+    Interpreter& in;
+    const char* at = nullptr;
+    const char* end = nullptr;
+    std::vector<Object*> objects;
+    std::vector<Environment*> environments;
+    std::vector<Function*> functions;
+    // Inline nodes read before the def they refer to
+    std::vector<std::pair<Inline*, uint32_t>> inlines;
+
+    static void corrupt() {
+        throw std::runtime_error("corrupt snapshot");
+    }
+
+    void need(size_t n) {
+        if ((size_t)(end - at) < n) {
+            corrupt();
+        }
+    }
+
+    template <class T>
+    T get() {
+        need(sizeof(T));
+        T value;
+        std::memcpy(&value, at, sizeof(T));
+        at += sizeof(T);
+        return value;
+    }
+
+    std::string text() {
+        uint32_t n = get<uint32_t>();
+        need(n);
+        std::string s(at, n);
+        at += n;
+        return s;
+    }
+
+    Token token() {
+        Token t;
+        uint8_t type = get<uint8_t>();
+        if (type > INVALID) {
+            corrupt();
+        }
+        t.type = (TokenType)type;
+        t.column = get<uint16_t>();
+        t.line = get<uint32_t>();
+        t.value = text();
+        return t;
+    }
+
+    std::vector<Token> tokens() {
+        uint32_t n = get<uint32_t>();
+        std::vector<Token> ts;
+        for (uint32_t i = 0; i < n; i++) {
+            ts.push_back(token());
+        }
+        return ts;
+    }
+
+    VarRef ref() {
+        VarRef r;
+        uint8_t kind = get<uint8_t>();
+        if (kind > VAR_FREE) {
+            corrupt();
+        }
+        r.kind = (VarKind)kind;
+        r.slot = get<int32_t>();
+        return r;
+    }
+
+    std::vector<int> ints() {
+        uint32_t n = get<uint32_t>();
+        std::vector<int> values;
+        for (uint32_t i = 0; i < n; i++) {
+            values.push_back(get<int32_t>());
+        }
+        return values;
+    }
+
+    void load(const std::string& path) {
+        need(sizeof(SNAPSHOT_MAGIC));
+        if (std::memcmp(at, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            throw std::runtime_error("'" + path + "' is not a snapshot");
+        }
+        at += sizeof(SNAPSHOT_MAGIC);
+        if (get<uint32_t>() != SNAPSHOT_VERSION) {
+            throw std::runtime_error("snapshot '" + path + "' was made by another version");
+        }
+        if (get<uint64_t>() != snapshotChecksum(at, end - at)) {
+            corrupt();
+        }
+        script = text();
+        resume = get<uint32_t>();
+        program = statements();
+        if (resume > program.size()) {
+            corrupt();
+        }
+        uint32_t roots = get<uint32_t>();
+        for (uint32_t i = 0; i < roots; i++) {
+            if (dynamic_cast<Function*>(statement()) == nullptr) {
+                corrupt();
+            }
+        }
+        for (auto& i : inlines) {
+            i.first->function = function(i.second);
+        }
+        heap();
+        if (at != end) {
+            corrupt();
+        }
+    }
+
+    Object* object(uint32_t id) {
+        if (id == SNAPSHOT_NULL) {
+            return nullptr;
+        }
+        if (id >= objects.size()) {
+            corrupt();
+        }
+        return objects[id];
+    }
+
+    Environment* environment(uint32_t id) {
+        if (id >= environments.size()) {
+            corrupt();
+        }
+        return environments[id];
+    }
+
+    Function* function(uint32_t id) {
+        if (id >= functions.size() || functions[id] == nullptr) {
+            corrupt();
+        }
+        return functions[id];
+    }
+
+    template <class T>
+    T* as(Object* o) {
+        T* t = dynamic_cast<T*>(o);
+        if (t == nullptr) {
+            corrupt();
+        }
+        return t;
+    }
+
+    void heap() {
+        objects.resize(get<uint32_t>());
+        environments.resize(get<uint32_t>());
+        if (environments.empty()) {
+            corrupt();
+        }
+        environments[0] = in.global_env;
+        for (size_t i = 1; i < environments.size(); i++) {
+            environments[i] = new Environment();
+        }
+        std::vector<uint8_t> kinds(objects.size());
+        for (size_t i = 0; i < objects.size(); i++) {
+            kinds[i] = get<uint8_t>();
+            switch (kinds[i]) {
+            case OBJECT_INT:
+                objects[i] = new Integer(get<int32_t>());
+                break;
+            case OBJECT_FLOAT:
+                objects[i] = new Float(get<double>());
+                break;
+            case OBJECT_BOOL:
+                objects[i] = new Boolean(get<uint8_t>() != 0);
+                break;
+            case OBJECT_STRING:
+                objects[i] = new String(text());
+                break;
+            case OBJECT_NONE:
+                objects[i] = new None();
+                break;
+            case OBJECT_LIST:
+                objects[i] = new List();
+                break;
+            case OBJECT_DICT:
+                objects[i] = new Dict();
+                break;
+            case OBJECT_CELL:
+                objects[i] = new Cell(nullptr);
+                break;
+            case OBJECT_CLOSURE:
+                objects[i] = new Closure(function(get<uint32_t>()), nullptr);
+                break;
+            case OBJECT_MODULE:
+                objects[i] = new Module(text(), nullptr);
+                break;
+            default:
+                corrupt();
+            }
+        }
+        for (size_t i = 0; i < objects.size(); i++) {
+            switch (kinds[i]) {
+            case OBJECT_LIST: {
+                List* list = static_cast<List*>(objects[i]);
+                uint32_t n = get<uint32_t>();
+                for (uint32_t j = 0; j < n; j++) {
+                    list->items.push_back(item());
+                }
+                break;
+            }
+            case OBJECT_DICT: {
+                Dict* dict = static_cast<Dict*>(objects[i]);
+                uint32_t n = get<uint32_t>();
+                dict->items.reserve(n);
+                for (uint32_t j = 0; j < n; j++) {
+                    Object* key = item();
+                    dict->items.set(key, item());
+                }
+                break;
+            }
+            case OBJECT_CELL:
+                static_cast<Cell*>(objects[i])->value = object(get<uint32_t>());
+                break;
+            case OBJECT_CLOSURE: {
+                Closure* c = static_cast<Closure*>(objects[i]);
+                c->globals = environment(get<uint32_t>());
+                uint32_t n = get<uint32_t>();
+                for (uint32_t j = 0; j < n; j++) {
+                    c->cells.push_back(object(get<uint32_t>()));
+                }
+                break;
+            }
+            case OBJECT_MODULE:
+                static_cast<Module*>(objects[i])->env = environment(get<uint32_t>());
+                break;
+            }
+        }
+        for (Environment* env : environments) {
+            uint32_t n = get<uint32_t>();
+            for (uint32_t i = 0; i < n; i++) {
+                std::string name = text();
+                env->set(name, item());
+            }
+            n = get<uint32_t>();
+            for (uint32_t i = 0; i < n; i++) {
+                std::string name = text();
+                env->set_function(name, as<Closure>(item()));
+            }
+        }
+        uint32_t n = get<uint32_t>();
+        for (uint32_t i = 0; i < n; i++) {
+            std::string path = text();
+            in.modules.set(path, as<Module>(item()));
+        }
+    }
+
+    // an object that cannot be null
+    Object* item() {
+        Object* o = object(get<uint32_t>());
+        if (o == nullptr) {
+            corrupt();
+        }
+        return o;
+    }
+
+    std::vector<Statement*> statements() {
+        uint32_t n = get<uint32_t>();
+        std::vector<Statement*> stmts;
+        for (uint32_t i = 0; i < n; i++) {
+            Statement* s = statement();
+            if (s == nullptr) {
+                corrupt();
+            }
+            stmts.push_back(s);
+        }
+        return stmts;
+    }
+
+    std::vector<Expr*> expressions() {
+        uint32_t n = get<uint32_t>();
+        std::vector<Expr*> exprs;
+        for (uint32_t i = 0; i < n; i++) {
+            Expr* e = expression();
+            if (e == nullptr) {
+                corrupt();
+            }
+            exprs.push_back(e);
+        }
+        return exprs;
+    }
+
+    // a statement or expression that cannot be null
+    Statement* required(Statement* stmt) {
+        if (stmt == nullptr) {
+            corrupt();
+        }
+        return stmt;
+    }
+
+    Expr* required(Expr* expr) {
+        if (expr == nullptr) {
+            corrupt();
+        }
+        return expr;
+    }
+
+    Statement* statement() {
+        uint8_t node = get<uint8_t>();
+        if (node == NODE_NULL) {
+            return nullptr;
+        }
+        if (node == NODE_FUNCTION_REF) {
+            return function(get<uint32_t>());
+        }
+        bool yields = get<uint8_t>() != 0;
+        uint32_t line = get<uint32_t>();
+        Statement* stmt;
+        switch (node) {
+        case NODE_BLOCK:
+            stmt = new Block(statements());
+            break;
+        case NODE_EXPRESSION:
+            stmt = new Expression(required(expression()));
+            break;
+        case NODE_FOR: {
+            Token name = token();
+            Expr* iterable = required(expression());
+            For* f = new For(name, iterable, required(statement()));
+            f->ref = ref();
+            stmt = f;
+            break;
+        }
+        case NODE_FUNCTION: {
+            uint32_t id = get<uint32_t>();
+            Token name = token();
+            std::vector<Token> params = tokens();
+            Function* f = new Function(name, params, statements());
+            f->num_slots = get<int32_t>();
+            f->free_base = get<int32_t>();
+            f->cells = ints();
+            f->captures = ints();
+            f->binding = ref();
+            f->generator = get<uint8_t>() != 0;
+            if (f->num_slots < (int)params.size()) {
+                corrupt();
+            }
+            if (id >= functions.size()) {
+                functions.resize(id + 1, nullptr);
+            }
+            if (functions[id] != nullptr) {
+                corrupt();
+            }
+            functions[id] = f;
+            stmt = f;
+            break;
+        }
+        case NODE_GLOBAL:
+            stmt = new Global(tokens());
+            break;
+        case NODE_IF: {
+            Expr* condition = required(expression());
+            Statement* thenBranch = required(statement());
+            If* i = new If(condition, thenBranch, statement());
+            i->typed = get<uint16_t>();
+            stmt = i;
+            break;
+        }
+        case NODE_IMPORT: {
+            Token module = token();
+            Import* i = new Import(module, tokens());
+            for (VarRef& r : i->refs) {
+                r = ref();
+            }
+            stmt = i;
+            break;
+        }
+        case NODE_NONLOCAL:
+            stmt = new Nonlocal(tokens());
+            break;
+        case NODE_PRINT:
+            stmt = new Print(expressions());
+            break;
+        case NODE_RETURN: {
+            Token keyword = token();
+            stmt = new Return(keyword, expression());
+            break;
+        }
+        case NODE_VAR: {
+            Token name = token();
+            Var* v = new Var(name, required(expression()));
+            v->ref = ref();
+            stmt = v;
+            break;
+        }
+        case NODE_YIELD: {
+            Token keyword = token();
+            stmt = new Yield(keyword, expression());
+            break;
+        }
+        default:
+            corrupt();
+        }
+        stmt->yields = yields;
+        stmt->line = line;
+        return stmt;
+    }
+
+    Expr* expression() {
+        uint8_t node = get<uint8_t>();
+        if (node == NODE_NULL) {
+            return nullptr;
+        }
+        uint32_t line = get<uint32_t>();
+        Expr* expr;
+        switch (node) {
+        case NODE_ASSIGN: {
+            Token name = token();
+            expr = new Assign(name, required(expression()));
+            break;
+        }
+        case NODE_BINARY: {
+            Expr* left = required(expression());
+            Token op = token();
+            Binary* b = new Binary(left, op, required(expression()));
+            b->typed = get<uint16_t>();
+            expr = b;
+            break;
+        }
+        case NODE_CALL: {
+            Token callee = token();
+            Token paren = token();
+            std::vector<Expr*> args = expressions();
+            Call* c = new Call(callee, paren, args, expression());
+            c->ref = ref();
+            expr = c;
+            break;
+        }
+        case NODE_CONDITIONAL: {
+            Expr* condition = required(expression());
+            Expr* thenBranch = required(expression());
+            Conditional* c = new Conditional(condition, thenBranch, required(expression()));
+            c->typed = get<uint16_t>();
+            expr = c;
+            break;
+        }
+        case NODE_DICT_LITERAL: {
+            std::vector<Expr*> keys = expressions();
+            std::vector<Expr*> values = expressions();
+            if (keys.size() != values.size()) {
+                corrupt();
+            }
+            expr = new DictLiteral(keys, values);
+            break;
+        }
+        case NODE_GET: {
+            Expr* object = required(expression());
+            expr = new Get(object, token());
+            break;
+        }
+        case NODE_GROUPING:
+            expr = new Grouping(required(expression()));
+            break;
+        case NODE_INLINE: {
+            Call* call = dynamic_cast<Call*>(expression());
+            if (call == nullptr) {
+                corrupt();
+            }
+            uint32_t function = get<uint32_t>();
+            Inline* i = new Inline(call, nullptr, required(expression()));
+            inlines.push_back({ i, function });
+            expr = i;
+            break;
+        }
+        case NODE_LIST_LITERAL:
+            expr = new ListLiteral(expressions());
+            break;
+        case NODE_LITERAL: {
+            Token t = token();
+            Literal* l = new Literal(t, text());
+            l->ref = ref();
+            expr = l;
+            break;
+        }
+        case NODE_LOGICAL: {
+            Expr* left = required(expression());
+            Token op = token();
+            Logical* l = new Logical(left, op, required(expression()));
+            l->typed = get<uint16_t>();
+            expr = l;
+            break;
+        }
+        case NODE_SET_ITEM: {
+            Expr* object = required(expression());
+            Expr* index = required(expression());
+            expr = new SetItem(object, index, required(expression()));
+            break;
+        }
+        case NODE_SUBSCRIPT: {
+            Expr* object = required(expression());
+            expr = new Subscript(object, required(expression()));
+            break;
+        }
+        case NODE_UNARY: {
+            Token op = token();
+            Unary* u = new Unary(op, required(expression()));
+            u->typed = get<uint16_t>();
+            expr = u;
+            break;
+        }
+        case NODE_VARIABLE:
+            expr = new Variable(token());
+            break;
+        default:
+            corrupt();
+        }
+        expr->line = line;
+        return expr;
+    }
+};
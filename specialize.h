@@ -0,0 +1,428 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "visitor.h"
+#include "clone.h"
+#include "statement.h"
+#include "expression.h"
+#include "object.h"
+
+// Type feedback and per-signature specialization of function bodies.
+//
+// While a function runs its generic body the interpreter records the types
+// of its arguments, of the values every call site returns and of the items
+// every for loop iterates over. Once a function has been profiled for
+// SPECIALIZE_THRESHOLD calls with one type per parameter, it gets a copy of
+// its body specialized for that signature:
+//
+//   - types are propagated from the parameters through the locals (a local
+//     has a type when every assignment to it produces that type), from
+//     literals and from the operators, whose results always have one type;
+//   - a call or loop item whose site has only ever seen one type is assumed
+//     to keep producing it, and is guarded;
+//   - operators, conditions and not/and/or whose operands are known are
+//     marked typed, and the interpreter runs them without checking the
+//     operand types. It reads the mark only after evaluating the operands,
+//     since a guard failing in one of them clears it.
+//
+// A call enters the specialized body only when its arguments match the
+// signature; other calls run the generic body. When a guard sees another
+// type the specialization is deoptimized on the spot: every mark it made is
+// cleared, so frames still running it continue with the generic checks, and
+// the function goes back to profiling. A function that keeps deoptimizing,
+// or that is polymorphic, stays generic.
+
+struct Specialization {
+    Function* function;
+    // type of each parameter
+    std::vector<uint16_t> signature;
+    std::vector<Statement*> body;
+    // every typed/guard field set in body; cleared on deoptimization
+    std::vector<uint16_t*> facts;
+};
+
+// Propagates types through a specialized body and marks what it proves.
+// Runs to a fixpoint over the local slots first, then once more to mark.
+class TypeInference : Visitor<void> {
+public:
+    enum : uint16_t { ANY = 0xFFFF };
+
+    explicit TypeInference(Specialization* spec) {
+        this->spec = spec;
+    }
+
+    void infer() {
+        Function* f = spec->function;
+        slots.assign(f->num_slots, 0);
+        for (size_t i = 0; i < spec->signature.size(); i++) {
+            slots[i] = spec->signature[i];
+        }
+        // locals are only ever widened, so this terminates
+        do {
+            changed = false;
+            run();
+        } while (changed);
+
+        annotate = true;
+        run();
+    }
+
+private:
+    Specialization* spec;
+    std::vector<uint16_t> slots;
+    bool changed = false;
+    bool annotate = false;
+    // type of the last expression visited
+    uint16_t type = ANY;
+
+    static bool single(uint16_t mask) {
+        return mask != 0 && (mask & (mask - 1)) == 0;
+    }
+
+    void run() {
+        for (Statement* s : spec->body) {
+            s->accept(this);
+        }
+    }
+
+    // the types arithmetic on operands of types t can give: t itself if
+    // only ints and floats are in it (an int and a float make a float),
+    // otherwise ANY
+    static uint16_t numeric(uint16_t t) {
+        return (t & ~(TYPE_INT | TYPE_FLOAT)) == 0 ? t : ANY;
+    }
+
+    uint16_t typeOf(Expr* expr) {
+        expr->accept(this);
+        return type;
+    }
+
+    void store(const VarRef& ref, uint16_t t) {
+        if (ref.kind != VAR_LOCAL) {
+            return;
+        }
+        uint16_t& slot = slots[ref.slot];
+        if ((slot | t) != slot) {
+            slot |= t;
+            changed = true;
+        }
+    }
+
+    void mark(uint16_t& field, uint16_t t) {
+        if (annotate && field == 0) {
+            field = t;
+            spec->facts.push_back(&field);
+        }
+    }
+
+    // the type a call or loop site has always produced, or ANY
+    uint16_t expect(uint16_t seen, uint16_t& guard, Specialization*& owner) {
+        if (!single(seen)) {
+            return ANY;
+        }
+        if (annotate) {
+            mark(guard, seen);
+            owner = spec;
+        }
+        return seen;
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        store(stmt->ref, typeOf(stmt->initial));
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        for (Statement* s : stmt->statements) {
+            s->accept(this);
+        }
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        typeOf(stmt->expr);
+    };
+
+    void visitForStmt(For* stmt) override {
+        typeOf(stmt->iterable);
+        store(stmt->ref, expect(stmt->item_types, stmt->guard, stmt->spec));
+        stmt->body->accept(this);
+    };
+
+    void visitFunctionStmt(Function* stmt) override {};
+
+    void visitGlobalStmt(Global* stmt) override {};
+
+    void visitIfStmt(If* stmt) override {
+        if (typeOf(stmt->condition) == TYPE_BOOL) {
+            mark(stmt->typed, TYPE_BOOL);
+        }
+        stmt->thenBranch->accept(this);
+        if (stmt->elseBranch != nullptr) {
+            stmt->elseBranch->accept(this);
+        }
+    };
+
+    void visitImportStmt(Import* stmt) override {
+        for (VarRef& ref : stmt->refs) {
+            store(ref, ANY);
+        }
+    };
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {};
+
+    void visitPrintStatement(Print* stmt) override {
+        for (Expr* e : stmt->exprs) {
+            typeOf(e);
+        }
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        if (stmt->value != nullptr) {
+            typeOf(stmt->value);
+        }
+    };
+
+    void visitYieldStmt(Yield* stmt) override {
+        if (stmt->value != nullptr) {
+            typeOf(stmt->value);
+        }
+    };
+
+    void visitAssignExpr(Assign* expr) override {
+        type = ANY;
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        uint16_t lhs = typeOf(expr->left);
+        uint16_t rhs = typeOf(expr->right);
+        switch (expr->op.type) {
+        case EQUAL_TO:
+        case NOT_EQUAL_TO:
+            if (lhs == rhs && (lhs == TYPE_INT || lhs == TYPE_BOOL)) {
+                mark(expr->typed, lhs);
+            }
+            type = TYPE_BOOL;
+            return;
+        case LESS_THAN:
+        case LESS_THAN_EQUAL_TO:
+        case GREATER_THAN:
+        case GREATER_THAN_EQUAL_TO:
+            if (lhs == TYPE_INT && rhs == TYPE_INT) {
+                mark(expr->typed, TYPE_INT);
+            }
+            type = TYPE_BOOL;
+            return;
+        case PLUS:
+        case MINUS:
+        case MULTIPLY:
+        case FLOOR_DIVIDE:
+            if (lhs == TYPE_INT && rhs == TYPE_INT) {
+                mark(expr->typed, TYPE_INT);
+            }
+            type = numeric(lhs | rhs);
+            return;
+        case DIVIDE:
+            type = TYPE_FLOAT;
+            return;
+        default:
+            type = ANY;
+        }
+    };
+
+    void visitCallExpr(Call* expr) override {
+        if (expr->object != nullptr) {
+            typeOf(expr->object);
+        }
+        for (Expr* a : expr->args) {
+            typeOf(a);
+        }
+        type = expect(expr->result_types, expr->guard, expr->spec);
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        if (typeOf(expr->condition) == TYPE_BOOL) {
+            mark(expr->typed, TYPE_BOOL);
+        }
+        type = typeOf(expr->thenBranch) | typeOf(expr->elseBranch);
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        for (size_t i = 0; i < expr->keys.size(); i++) {
+            typeOf(expr->keys[i]);
+            typeOf(expr->values[i]);
+        }
+        type = TYPE_DICT;
+    };
+
+    void visitGetExpr(Get* expr) override {
+        typeOf(expr->object);
+        type = ANY;
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        type = typeOf(expr->expression);
+    };
+
+    // the copy is typed in its own frame: only the call is seen here
+    void visitInlineExpr(Inline* expr) override {
+        visitCallExpr(expr->call);
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        for (Expr* e : expr->items) {
+            typeOf(e);
+        }
+        type = TYPE_LIST;
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        switch (expr->token.type) {
+        case NUMBER:
+            type = TYPE_INT;
+            return;
+        case FLOAT:
+            type = TYPE_FLOAT;
+            return;
+        case TRUE:
+        case FALSE:
+            type = TYPE_BOOL;
+            return;
+        case STRING:
+            type = TYPE_STRING;
+            return;
+        case NONE:
+            type = TYPE_NONE;
+            return;
+        case IDENTIFIER:
+            // a local nothing has been assigned to yet still widens later
+            type = expr->ref.kind == VAR_LOCAL ? slots[expr->ref.slot] : ANY;
+            return;
+        default:
+            type = ANY;
+        }
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        uint16_t lhs = typeOf(expr->left);
+        uint16_t rhs = typeOf(expr->right);
+        if (lhs == TYPE_BOOL) {
+            mark(expr->typed, TYPE_BOOL);
+        }
+        // the operand that decides
+        type = lhs | rhs;
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        typeOf(expr->object);
+        typeOf(expr->index);
+        type = typeOf(expr->value);
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        typeOf(expr->object);
+        typeOf(expr->index);
+        type = ANY;
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        uint16_t operand = typeOf(expr->right);
+        if (expr->op.type == MINUS) {
+            if (operand == TYPE_INT) {
+                mark(expr->typed, TYPE_INT);
+            }
+            type = numeric(operand);
+            return;
+        }
+        if (operand == TYPE_BOOL) {
+            mark(expr->typed, TYPE_BOOL);
+        }
+        type = TYPE_BOOL;
+    };
+
+    void visitVariableExpr(Variable* expr) override {
+        type = ANY;
+    };
+};
+
+class Specializer {
+public:
+    static const int SPECIALIZE_THRESHOLD = 100;
+    static const int MAX_DEOPTS = 3;
+
+    bool enabled = true;
+
+    // The specialized body to run for these arguments, if any.
+    Specialization* select(Function* f, Object** args) {
+        Specialization* s = f->specialized;
+        if (s == nullptr) {
+            return nullptr;
+        }
+        for (size_t i = 0; i < s->signature.size(); i++) {
+            if (args[i]->type() != s->signature[i]) {
+                return nullptr;
+            }
+        }
+        return s;
+    }
+
+    // Records the argument types of a call running the generic body.
+    void profile(Function* f, Object** args) {
+        if (f->specialize_failed) {
+            return;
+        }
+        size_t n = f->params.size();
+        if (f->arg_types.size() != n) {
+            f->arg_types.assign(n, 0);
+        }
+        for (size_t i = 0; i < n; i++) {
+            f->arg_types[i] |= args[i]->type();
+        }
+        if (++f->profiled >= SPECIALIZE_THRESHOLD && f->specialized == nullptr) {
+            specialize(f);
+        }
+    }
+
+    // A guard of s saw a value of another type.
+    static void deoptimize(Specialization* s) {
+        for (uint16_t* fact : s->facts) {
+            *fact = 0;
+        }
+        s->facts.clear();
+        Function* f = s->function;
+        if (f->specialized == s) {
+            f->specialized = nullptr;
+            f->profiled = 0;
+            f->specialize_failed = ++f->deopts >= MAX_DEOPTS;
+        }
+    }
+
+private:
+    void specialize(Function* f) {
+        Specialization* s = new Specialization();
+        s->function = f;
+        for (uint16_t seen : f->arg_types) {
+            if (seen == 0 || (seen & (seen - 1)) != 0) {
+                // polymorphic: one body cannot cover it
+                f->specialize_failed = true;
+                delete s;
+                return;
+            }
+            s->signature.push_back(seen);
+        }
+
+        AstCloner cloner;
+        s->body = cloner.clone(f->body);
+        if (cloner.failed) {
+            f->specialize_failed = true;
+            return;
+        }
+        TypeInference(s).infer();
+        if (s->facts.empty()) {
+            // nothing to gain over the generic body
+            f->specialize_failed = true;
+            return;
+        }
+        f->specialized = s;
+    }
+};
@@ -6,8 +6,18 @@
 #include "visitor.h"
 #include "object.h"
 
+// a statement compiled by the closure engine (compiler.h)
+struct StmtCode;
+
 class Statement {
 public:
+	// set by the Resolver when the statement is, or contains, a yield of
+	// the enclosing generator function (generator.h)
+	bool yields = false;
+	// line the statement starts on; 0 for the blocks of if and for, which
+	// have no line of their own
+	uint32_t line = 0;
+
 	virtual ~Statement() {}
 	virtual void accept(Visitor<void>* v) {};
 	virtual Object* accept(Visitor<Object*>* v) { return nullptr;  };
@@ -47,12 +57,71 @@ public:
 	}
 };
 
+class For : public Statement {
+public:
+	Token name;
+	Expr* iterable;
+	Statement* body;
+	VarRef ref;
+	// types of the items this loop has iterated over, and in a specialized
+	// body the type each item is assumed to have (see Call)
+	uint16_t item_types = 0;
+	uint16_t guard = 0;
+	Specialization* spec = nullptr;
+
+	For(Token name, Expr* iterable, Statement* body) {
+		this->name = name;
+		this->iterable = iterable;
+		this->body = body;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitForStmt(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitForStmt(this);
+	}
+};
+
 class Function : public Statement {
 public:
 	Token name;
 	std::vector<Token> params;
 	std::vector<Statement*> body;
 
+	// frame layout, filled in by the Resolver: params occupy the first
+	// slots, then the other locals, then one slot per captured variable
+	int num_slots = 0;
+	int free_base = 0;
+	// local slots (params included) that inner functions capture
+	std::vector<int> cells;
+	// for each captured variable, the slot of the enclosing frame holding
+	// its Cell at the time the def runs
+	std::vector<int> captures;
+	// where the def statement stores the function
+	VarRef binding;
+
+	// JIT state (jit.h)
+	int calls = 0;
+	bool jit_failed = false;
+	void* jit_code = nullptr;
+	bool jit_returns_bool = false;
+
+	// type feedback: the types each parameter has been called with, over
+	// the calls that ran the generic body (specialize.h)
+	std::vector<uint16_t> arg_types;
+	int profiled = 0;
+	Specialization* specialized = nullptr;
+	int deopts = 0;
+	bool specialize_failed = false;
+
+	// body compiled by the closure engine, on its first call
+	StmtCode* compiled = nullptr;
+
+	// the body yields: calls return a Generator (generator.h)
+	bool generator = false;
+
 	Function(Token name, std::vector<Token> params, std::vector<Statement*> body) {
 		this->name = name;
 		this->params = params;
@@ -68,11 +137,54 @@ public:
 	}
 };
 
+class Global : public Statement {
+public:
+	std::vector<Token> names;
+
+	Global(std::vector<Token> names) {
+		this->names = names;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitGlobalStmt(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitGlobalStmt(this);
+	}
+};
+
+// import module            (names empty, binds the module)
+// from module import a, b   (binds each name)
+class Import : public Statement {
+public:
+	Token module;
+	std::vector<Token> names;
+	// one per bound name
+	std::vector<VarRef> refs;
+
+	Import(Token module, std::vector<Token> names) {
+		this->module = module;
+		this->names = names;
+		refs.resize(names.empty() ? 1 : names.size());
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitImportStmt(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitImportStmt(this);
+	}
+};
+
 class If : public Statement {
 public:
 	Expr* condition;
 	Statement* thenBranch;
 	Statement* elseBranch;
+	// the condition is proven to be a Boolean (typecheck.h, specialize.h)
+	uint16_t typed = 0;
 
 	If(Expr* condition, Statement* thenBranch, Statement* elseBranch) {
 		this->condition = condition;
@@ -90,6 +202,23 @@ public:
 };
 
 
+class Nonlocal : public Statement {
+public:
+	std::vector<Token> names;
+
+	Nonlocal(std::vector<Token> names) {
+		this->names = names;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitNonlocalStmt(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitNonlocalStmt(this);
+	}
+};
+
 class Print : public Statement {
 public:
 	std::vector<Expr*> exprs;
@@ -126,10 +255,32 @@ public:
 	}
 };
 
+// `yield value`: a statement, so a generator only ever pauses between
+// statements
+class Yield : public Statement {
+public:
+	Token keyword;
+	Expr* value;
+
+	Yield(Token keyword, Expr* value) {
+		this->keyword = keyword;
+		this->value = value;
+	}
+
+	void accept(Visitor<void>* v) override {
+		v->visitYieldStmt(this);
+	}
+
+	Object* accept(Visitor<Object*>* v) override {
+		return v->visitYieldStmt(this);
+	}
+};
+
 class Var : public Statement {
 public:
 	Token name;
 	Expr* initial;
+	VarRef ref;
 
 	Var(Token name, Expr* initial) {
 		this->name = name;
@@ -144,3 +295,7 @@ public:
 		return v->visitVarStatement(this);
 	}
 };
+
+inline std::string Closure::toString() {
+	return "<function " + function->name.value + ">";
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+#include "object.h"
+
+// Per-run statistics (--stats).
+//
+// runScript times each phase, wall clock and CPU time of the running
+// thread, and fills in the rest from counters that are always kept: the
+// interpreter's call count and deepest call nesting, and the per-thread
+// object allocation counts of object.h (read as the difference over the
+// run). The AST is measured by one walk over it after resolving. Nothing
+// here costs more than an increment while the script runs.
+
+// Number and size of the nodes of an AST, nested defs included.
+class AstSize : Visitor<void> {
+public:
+    size_t nodes = 0;
+    size_t bytes = 0;
+
+    void count(const std::vector<Statement*>& stmts) {
+        for (Statement* s : stmts) {
+            s->accept(this);
+        }
+    }
+
+private:
+    template <class T>
+    void add(T*) {
+        nodes++;
+        bytes += sizeof(T);
+    }
+
+    void visit(Expr* expr) {
+        if (expr != nullptr) {
+            expr->accept(this);
+        }
+    }
+
+    void visit(Statement* stmt) {
+        if (stmt != nullptr) {
+            stmt->accept(this);
+        }
+    }
+
+    void visitVarStatement(Var* stmt) override {
+        add(stmt);
+        visit(stmt->initial);
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        add(stmt);
+        count(stmt->statements);
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        add(stmt);
+        visit(stmt->expr);
+    };
+
+    void visitForStmt(For* stmt) override {
+        add(stmt);
+        visit(stmt->iterable);
+        visit(stmt->body);
+    };
+
+    void visitFunctionStmt(Function* stmt) override {
+        add(stmt);
+        count(stmt->body);
+    };
+
+    void visitGlobalStmt(Global* stmt) override {
+        add(stmt);
+    };
+
+    void visitIfStmt(If* stmt) override {
+        add(stmt);
+        visit(stmt->condition);
+        visit(stmt->thenBranch);
+        visit(stmt->elseBranch);
+    };
+
+    void visitImportStmt(Import* stmt) override {
+        add(stmt);
+    };
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {
+        add(stmt);
+    };
+
+    void visitPrintStatement(Print* stmt) override {
+        add(stmt);
+        for (Expr* e : stmt->exprs) {
+            visit(e);
+        }
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        add(stmt);
+        visit(stmt->value);
+    };
+
+    void visitYieldStmt(Yield* stmt) override {
+        add(stmt);
+        visit(stmt->value);
+    };
+
+    void visitAssignExpr(Assign* expr) override {
+        add(expr);
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        add(expr);
+        visit(expr->left);
+        visit(expr->right);
+    };
+
+    void visitCallExpr(Call* expr) override {
+        add(expr);
+        visit(expr->object);
+        for (Expr* a : expr->args) {
+            visit(a);
+        }
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        add(expr);
+        visit(expr->condition);
+        visit(expr->thenBranch);
+        visit(expr->elseBranch);
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        add(expr);
+        for (size_t i = 0; i < expr->keys.size(); i++) {
+            visit(expr->keys[i]);
+            visit(expr->values[i]);
+        }
+    };
+
+    void visitGetExpr(Get* expr) override {
+        add(expr);
+        visit(expr->object);
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        add(expr);
+        visit(expr->expression);
+    };
+
+    void visitInlineExpr(Inline* expr) override {
+        add(expr);
+        visit(expr->call);
+        visit(expr->body);
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        add(expr);
+        for (Expr* e : expr->items) {
+            visit(e);
+        }
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        add(expr);
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        add(expr);
+        visit(expr->left);
+        visit(expr->right);
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        add(expr);
+        visit(expr->object);
+        visit(expr->index);
+        visit(expr->value);
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        add(expr);
+        visit(expr->object);
+        visit(expr->index);
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        add(expr);
+        visit(expr->right);
+    };
+
+    void visitVariableExpr(Variable* expr) override {
+        add(expr);
+    };
+};
+
+enum Phase {
+    PHASE_READ, PHASE_SCAN, PHASE_PARSE, PHASE_RESOLVE, PHASE_RUN, PHASE_COUNT,
+};
+
+class RunStats {
+public:
+    double wall_ms[PHASE_COUNT] = {};
+    double cpu_ms[PHASE_COUNT] = {};
+    size_t source_bytes = 0;
+    size_t tokens = 0;
+    size_t ast_nodes = 0;
+    size_t ast_bytes = 0;
+    uint64_t calls = 0;
+    int max_depth = 0;
+    size_t objects[TYPE_KINDS] = {};
+    size_t object_bytes = 0;
+
+    // Times the phase from now until the next begin() or end().
+    void begin(Phase phase) {
+        end();
+        current = phase;
+        wall_start = std::chrono::steady_clock::now();
+        cpu_start = cpuNow();
+    }
+
+    void end() {
+        if (current == PHASE_COUNT) {
+            return;
+        }
+        wall_ms[current] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+        cpu_ms[current] += cpuNow() - cpu_start;
+        current = PHASE_COUNT;
+    }
+
+    // Starts counting the objects this thread allocates.
+    void startObjects() {
+        for (int i = 0; i < TYPE_KINDS; i++) {
+            objects[i] = objects_allocated[i];
+        }
+        object_bytes = ::object_bytes;
+    }
+
+    void endObjects() {
+        for (int i = 0; i < TYPE_KINDS; i++) {
+            objects[i] = objects_allocated[i] - objects[i];
+        }
+        object_bytes = ::object_bytes - object_bytes;
+    }
+
+    std::string format(bool json) const {
+        return json ? formatJson() : formatText();
+    }
+
+private:
+    Phase current = PHASE_COUNT;
+    std::chrono::steady_clock::time_point wall_start;
+    double cpu_start = 0;
+
+    static constexpr const char* PHASE_NAMES[PHASE_COUNT] = { "read", "scan", "parse", "resolve", "run" };
+
+    static double cpuNow() {
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+    }
+
+    // process-wide, in KB
+    static long peakRss() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    double lexMBs() const {
+        return wall_ms[PHASE_SCAN] > 0 ? source_bytes / 1e3 / wall_ms[PHASE_SCAN] : 0;
+    }
+
+    size_t totalObjects() const {
+        size_t total = 0;
+        for (size_t n : objects) {
+            total += n;
+        }
+        return total;
+    }
+
+    static void append(std::string& out, const char* format, ...) {
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        out += line;
+    }
+
+    std::string formatText() const {
+        std::string out;
+        append(out, "%-10s %10s %10s\n", "phase", "wall ms", "cpu ms");
+        double wall = 0;
+        double cpu = 0;
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            append(out, "%-10s %10.3f %10.3f\n", PHASE_NAMES[i], wall_ms[i], cpu_ms[i]);
+            wall += wall_ms[i];
+            cpu += cpu_ms[i];
+        }
+        append(out, "%-10s %10.3f %10.3f\n", "total", wall, cpu);
+        append(out, "tokens: %zu (%.1f MB/s)\n", tokens, lexMBs());
+        append(out, "ast: %zu nodes, %zu bytes\n", ast_nodes, ast_bytes);
+        append(out, "calls: %llu, max depth %d\n", (unsigned long long)calls, max_depth);
+        append(out, "objects: %zu, %zu bytes:", totalObjects(), object_bytes);
+        for (int i = 0; i < TYPE_KINDS; i++) {
+            append(out, " %s %zu", TYPE_NAMES[i], objects[i]);
+        }
+        append(out, "\npeak rss: %ld KB\n", peakRss());
+        return out;
+    }
+
+    std::string formatJson() const {
+        std::string out = "{\"phases\": {";
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            append(out, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i != 0 ? ", " : "", PHASE_NAMES[i],
+                   wall_ms[i], cpu_ms[i]);
+        }
+        append(out, "}, \"tokens\": %zu, \"lex_mb_per_s\": %.3f, \"ast_nodes\": %zu, \"ast_bytes\": %zu, "
+               "\"calls\": %llu, \"max_depth\": %d, \"objects\": {", tokens, lexMBs(), ast_nodes, ast_bytes,
+               (unsigned long long)calls, max_depth);
+        for (int i = 0; i < TYPE_KINDS; i++) {
+            append(out, "%s\"%s\": %zu", i != 0 ? ", " : "", TYPE_NAMES[i], objects[i]);
+        }
+        append(out, "}, \"object_bytes\": %zu, \"peak_rss_kb\": %ld}\n", object_bytes, peakRss());
+        return out;
+    }
+};
@@ -0,0 +1,43 @@
+# --alloc-profile charges each object to the expression and the function
+# that created it and ranks the sites by bytes; =N samples and scales up.
+MYPYTHON=$1
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat >"$TMP/allocs.py" <<'PY'
+def pairs(n):
+    out = []
+    for k in range(n):
+        out = [k, "x"]
+    return out
+
+def strings(n):
+    d = {}
+    for k in range(n):
+        d[k] = str(k)
+    return len(d)
+
+print(pairs(3000))
+print(strings(2000))
+PY
+expected="[2999, 'x']
+2000"
+
+fail() {
+    echo "$1:"
+    cat "$TMP/err"
+    exit 1
+}
+
+actual=$("$MYPYTHON" --alloc-profile "$TMP/allocs.py" 2>"$TMP/err")
+[ "$actual" = "$expected" ] || fail "output '$actual'"
+grep -q '^allocations: [0-9]* objects, [0-9]* bytes at [0-9]* sites$' "$TMP/err" || fail "no summary"
+awk 'NR == 3' "$TMP/err" | grep -q "^ *3000 .* str  *pairs .* 'x'$" || fail "'x' is not the top site"
+grep -q "^ *3000 .* list  *pairs .* \[k, 'x'\]$" "$TMP/err" || fail "no list site"
+grep -q '^ *2000 .* str  *strings .* str(k)$' "$TMP/err" || fail "no str() site"
+grep -q '^ *1 .* dict  *strings .* {}$' "$TMP/err" || fail "no dict site"
+
+actual=$("$MYPYTHON" --alloc-profile=10 "$TMP/allocs.py" 2>"$TMP/err")
+[ "$actual" = "$expected" ] || fail "output '$actual'"
+grep -q '^allocations: [0-9]* objects, [0-9]* bytes at [0-9]* sites (estimated from [0-9]* samples, 1 in 10)$' "$TMP/err" \
+    || fail "no sampled summary"
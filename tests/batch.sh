@@ -0,0 +1,36 @@
+# One script of a batch that recurses forever, or fails, does not take the
+# others down, and --stats goes to stderr as for a single script.
+MYPYTHON=$1
+DIR=$(dirname "$0")
+OUT=$(mktemp)
+ERR=$(mktemp)
+trap 'rm -f "$OUT" "$ERR"' EXIT
+
+"$MYPYTHON" --batch "$DIR/batch" -j 4 --stats >"$OUT" 2>"$ERR"
+status=$?
+if [ $status -ne 1 ]; then
+    echo "exit status $status, expected 1"
+    exit 1
+fi
+expected="==> $DIR/batch/1_first.py <==
+first
+==> $DIR/batch/2_recurse.py <==
+call depth limit exceeded: out of stack
+==> $DIR/batch/3_error.py <==
+third
+name 'missing' is not defined
+==> $DIR/batch/4_last.py <==
+610"
+actual=$(awk '/^recent events, oldest first:$/ { skip = 1; next }
+              skip && /^  / { next }
+              { skip = 0; print }' "$OUT")
+if [ "$actual" != "$expected" ]; then
+    echo "output:"
+    echo "$actual"
+    exit 1
+fi
+if [ "$(grep -c '^calls:' "$ERR")" -ne 4 ]; then
+    echo "expected the stats of 4 scripts on stderr:"
+    cat "$ERR"
+    exit 1
+fi
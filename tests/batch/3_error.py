@@ -0,0 +1,2 @@
+print("third")
+print(missing)
@@ -0,0 +1,39 @@
+# Scripts named in a list file run in that order, each in an interpreter of
+# its own: globals, and the state of a module they both import, are not
+# shared, though the module is compiled once.
+MYPYTHON=$1
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+cat >"$DIR/counter.py" <<'PY'
+count = 0
+
+def tick():
+    global count
+    count = count + 1
+    return count
+PY
+for name in a b c; do
+    cat >"$DIR/$name.py" <<'PY'
+import counter
+for i in range(1000):
+    counter.tick()
+shared = counter.tick()
+print(shared)
+PY
+done
+printf '%s\n' "$DIR/c.py" "$DIR/a.py" "$DIR/b.py" >"$DIR/list"
+
+actual=$("$MYPYTHON" --batch "$DIR/list" -j 3 2>&1)
+status=$?
+expected="==> $DIR/c.py <==
+1001
+==> $DIR/a.py <==
+1001
+==> $DIR/b.py <==
+1001"
+if [ $status -ne 0 ] || [ "$actual" != "$expected" ]; then
+    echo "exit status $status, output:"
+    echo "$actual"
+    exit 1
+fi
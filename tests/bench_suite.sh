@@ -0,0 +1,30 @@
+# The benchmark suite builds as the README says, runs every benchmark, and
+# --compare reads back what --json writes.
+DIR=$(dirname "$0")/..
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+if ! g++ -std=c++17 -O2 -pthread "$DIR/bench/bench.cpp" -o "$TMP/bench_suite"; then
+    echo "bench/bench.cpp does not build"
+    exit 1
+fi
+if ! "$TMP/bench_suite" --reps 1 --json >"$TMP/base.json"; then
+    echo "bench_suite failed"
+    exit 1
+fi
+for name in scan parse fib mutual print deep_expr large_script; do
+    if ! grep -q "\"name\": \"$name\", \"median_ms\": [0-9.e+-]*, \"p95_ms\"" "$TMP/base.json"; then
+        echo "no result for $name:"
+        cat "$TMP/base.json"
+        exit 1
+    fi
+done
+"$TMP/bench_suite" --reps 1 --json fib >"$TMP/new.json"
+actual=$("$TMP/bench_suite" --compare "$TMP/base.json" "$TMP/new.json" | awk '{ print $1 }')
+expected="benchmark
+fib"
+if [ "$actual" != "$expected" ]; then
+    echo "compare output:"
+    "$TMP/bench_suite" --compare "$TMP/base.json" "$TMP/new.json"
+    exit 1
+fi
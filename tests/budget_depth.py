@@ -0,0 +1,17 @@
+# args: --max-depth=100
+# Calls may nest up to --max-depth deep, generators resuming included.
+
+def down(n):
+    if n == 0:
+        return 0
+    return down(n - 1) + 1
+
+def nested(n):
+    if n > 0:
+        for x in nested(n - 1):
+            yield x
+    yield n
+
+print(down(99))
+print(sum(nested(20)))
+print(down(100))
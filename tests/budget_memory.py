@@ -0,0 +1,8 @@
+# args: --max-memory=1M
+# Objects the script allocates count against --max-memory, even inside a
+# single builtin call; a script past it stops with exit status 5.
+
+small = range(1000)
+print(len(small))
+big = range(50000000)
+print("not reached")
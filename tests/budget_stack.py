@@ -0,0 +1,8 @@
+# Runaway recursion stops with an error instead of overflowing the stack,
+# here in JIT-compiled code calling itself.
+
+def down(n):
+    return down(n + 1) + 1
+
+print("before")
+print(down(0))
@@ -0,0 +1,9 @@
+# args: --no-jit --max-steps=100000000
+# Runaway recursion in the tree walker stops with an error too, also when
+# other limits are set.
+
+def down(n):
+    return [down(n + 1)]
+
+print("before")
+print(down(0))
@@ -0,0 +1,19 @@
+# args: --max-steps=20000
+# Calls and loop iterations count as steps; a script past the limit stops
+# with exit status 3.
+
+def inc(k):
+    return k + 1
+
+def spin(n):
+    s = 0
+    for i in range(n):
+        s = inc(s)
+    return s
+
+print(spin(5000))
+rows = range(1000)
+for i in rows:
+    for j in rows:
+        s = j
+print("not reached")
@@ -0,0 +1,15 @@
+# args: --max-ms=100
+# A script that runs past --max-ms stops with exit status 4.
+
+def spin(n):
+    s = 0
+    for i in range(n):
+        s = s + i
+    return s
+
+print(spin(1000))
+rows = range(10000)
+for i in rows:
+    for j in rows:
+        s = spin(10)
+print("not reached")
@@ -0,0 +1,21 @@
+# The native builtins, with their one-, two- and many-argument entry points.
+
+print(len("hello"), len([1, 2, 3]), len({"a": 1, "b": 2}), len(""))
+print(abs(-4), abs(4), abs(0))
+print(int("42") + 1, int(-7), str(12), len(str(-300)))
+print(min(3, 1, 2), max(3, 1, 2), min([5, 4, 6]), max([5, 4, 6]), min("b", "a"))
+print(sum([1, 2, 3, 4]), sum([]), sum(range(10)))
+
+words = ["x", "yy", "zzz"]
+total = 0
+for w in words:
+    total = total + len(w)
+print(total)
+
+def count(n):
+    if n == 0:
+        return 0
+    return abs(-1) + count(n - 1)
+
+print(count(300))
+print(len(5))
@@ -0,0 +1,59 @@
+# Nested functions capture variables of the functions around them; nonlocal
+# and global rebind the outer binding.
+
+def adder(n):
+    def add(x):
+        return x + n
+    return add
+
+add2 = adder(2)
+add10 = adder(10)
+print(add2(1), add10(1), add2(add10(0)))
+
+def counter():
+    count = 0
+    def step():
+        nonlocal count
+        count = count + 1
+        return count
+    return step
+
+a = counter()
+b = counter()
+a()
+a()
+print(a(), b())
+
+def outer():
+    x = 1
+    def middle():
+        def inner():
+            return x * 100
+        return inner
+    x = 2
+    return middle()
+
+inner = outer()
+print(inner())
+
+total = 0
+def accumulate(v):
+    global total
+    total = total + v
+
+accumulate(5)
+accumulate(7)
+print(total)
+
+def makers(n):
+    fs = {}
+    for i in range(n):
+        def f():
+            return i
+        fs[i] = f
+    return fs
+
+fs = makers(3)
+first = fs[0]
+last = fs[2]
+print(first(), last())
@@ -0,0 +1,39 @@
+# Dicts: literals, lookups, updates, growth and insertion order.
+
+d = {"a": 1, 2: "two", "c": {"nested": 3}}
+print(d)
+print(d["a"], d[2], d["c"]["nested"])
+
+d["a"] = 10
+d["new"] = None
+print(d)
+
+def fill(table, i, n):
+    if i == n:
+        return table
+    table[i] = i * i
+    return fill(table, i + 1, n)
+
+squares = fill({}, 0, 500)
+print(squares[0], squares[31], squares[499])
+
+def bump(table, i, n):
+    if i == n:
+        return table
+    table[i] = table[i] + 1
+    return bump(table, i + 1, n)
+
+bump(squares, 0, 500)
+print(squares[0], squares[31], squares[499])
+
+small = fill({}, 0, 5)
+small[2] = "two"
+small["end"] = 5
+print(small)
+
+empty = {}
+print(empty)
+
+loop = {}
+loop["self"] = loop
+print(loop)
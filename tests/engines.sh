@@ -0,0 +1,26 @@
+# Every NAME.py test prints the same under --engine=closure as its NAME.out
+# expects from the tree walker.
+MYPYTHON=$1
+DIR=$(dirname "$0")
+OUT=$(mktemp)
+trap 'rm -f "$OUT"' EXIT
+failed=0
+
+for script in "$DIR"/*.py; do
+    name=${script%.py}
+    [ -f "$name.out" ] || continue
+    args=$(sed -n '1s/^# args://p' "$script")
+    # shellcheck disable=SC2086
+    "$MYPYTHON" $args --engine=closure "$script" >"$OUT" 2>&1
+    status=$?
+    [ $status -eq 0 ] || echo "exit status $status" >>"$OUT"
+    actual=$(awk '/^recent events, oldest first:$/ { skip = 1; next }
+                  skip && /^  / { next }
+                  { skip = 0; print }' "$OUT")
+    if [ "$actual" != "$(cat "$name.out")" ]; then
+        echo "${name##*/} differs:"
+        echo "$actual" | diff "$name.out" - | sed 's/^/  /'
+        failed=1
+    fi
+done
+exit $failed
@@ -0,0 +1,8 @@
+# Recursive fib, small enough that --no-jit is quick.
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+print(fib(20))
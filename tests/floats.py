@@ -0,0 +1,27 @@
+# Float literals, true and floor division, mixed arithmetic and
+# comparisons, printed with the shortest digits that read back.
+print(1.5, .5, 1e3, 2.5e-3, 1.0, 3.0e20)
+print(0.1 + 0.2, 1 / 3, 2 / 3)
+print(7 / 2, 6 / 3, 7 // 2, -7 // 2, 7.5 // 2, -7.5 // 2)
+print(1 + 2.5, 3 * 0.5, 10 - 0.25, -1.5)
+print(1 < 1.5, 2 == 2.0, 3.0 > 3, 2.5 >= 2.5)
+print(float(3), int(2.9), int(-2.9), abs(-0.5), str(0.25))
+print(min(2, 1.5), max(2, 1.5), sum([0.5, 1, 1.5]))
+print([1.5, 2], {1.5: "a"})
+print(1e16, 1e-5, 123456789.0, 1e22)
+
+def mean(xs):
+    s = 0
+    for x in xs:
+        s = s + x
+    return s / len(xs)
+
+def norm(x, y):
+    return x * x + y * y
+
+print(mean([1, 2, 3, 4]), mean([0.5, 0.25]))
+t = 0.0
+for i in range(1000):
+    t = t + norm(i * 0.5, 1)
+print(t)
+print(1 / 0)
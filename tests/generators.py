@@ -0,0 +1,61 @@
+# A generator runs its body only as far as the next value asked for, keeps
+# its locals between resumes, and can be nested in loops and ifs.
+
+def count(n):
+    print("start")
+    for k in range(n):
+        yield k
+    print("done")
+
+g = count(3)
+print("made")
+for x in g:
+    print("got", x)
+for x in g:
+    print("again", x)
+
+def above_two(items):
+    for x in items:
+        if x > 2:
+            yield x
+        else:
+            print("skip", x)
+
+for x in above_two([1, 2, 3, 4]):
+    print(x)
+
+def fib():
+    a = 0
+    b = 1
+    for i in range(10):
+        yield a
+        t = a + b
+        a = b
+        b = t
+
+def chained(gen):
+    for x in gen:
+        yield x * 10
+
+s = 0
+for x in chained(fib()):
+    s = s + x
+print(s)
+
+def early(n):
+    yield 1
+    if n > 0:
+        return 0
+    yield 2
+
+for x in early(1):
+    print("early", x)
+for x in early(0):
+    print("late", x)
+
+def bare():
+    yield
+
+for x in bare():
+    print(x)
+print(count(1))
@@ -0,0 +1,38 @@
+# args: --no-jit
+# Cached global reads and calls see redefinitions, new names and writes
+# made through the cache, in the module and in functions.
+
+def helper(n):
+    return n * 2
+
+def use(n):
+    return helper(n) + offset
+
+offset = 1
+total = 0
+for i in range(100):
+    total = total + use(i)
+print(total)
+
+def helper(n):
+    return n * 3
+
+print(use(10))
+
+def bump():
+    global offset
+    offset = offset + 10
+
+for i in range(5):
+    bump()
+print(offset, use(1))
+
+def late(n):
+    return later(n)
+
+def later(n):
+    return n - 1
+
+print(late(5))
+added = 7
+print(added + offset)
@@ -0,0 +1,125 @@
+# Hooks set on an embedded Interpreter see every call, return, statement
+# and the error that stops the script, in both engines; -DMYPYTHON_HOOKS=0
+# compiles them out.
+DIR=$(dirname "$0")/..
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat >"$TMP/hooks.cpp" <<'CPP'
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "scanner.h"
+#include "parser.h"
+#include "resolver.h"
+#include "interpreter.h"
+
+class Counts : public Hooks {
+public:
+    std::map<std::string, int> calls;
+    std::map<std::string, int> returns;
+    std::map<int, int> lines;
+    std::string error;
+
+    void onCall(Function* f, Object** args) override {
+        calls[f->name.value]++;
+    }
+
+    void onReturn(Function* f, Object* result) override {
+        returns[f->name.value + (result == nullptr ? " (none)" : "")]++;
+    }
+
+    void onStatement(Statement* stmt) override {
+        lines[stmt->line]++;
+    }
+
+    void onError(const std::exception& e) override {
+        error = e.what();
+    }
+};
+
+const char* SCRIPT =
+    "def inc(x):\n"
+    "    return x + 1\n"
+    "def count(n):\n"
+    "    for k in range(n):\n"
+    "        yield k\n"
+    "s = 0\n"
+    "for k in count(3):\n"
+    "    s = inc(s)\n"
+    "print(s)\n"
+    "print(missing)\n";
+
+int main(int argc, char* argv[]) {
+    Scanner scan(SCRIPT);
+    Parser parser(scan.getTokens());
+    std::vector<Statement*> stmts = parser.parse();
+    Resolver resolver;
+    resolver.resolve(stmts);
+    std::string output;
+    Interpreter in(&output);
+    in.engine = argc > 1 ? ENGINE_CLOSURE : ENGINE_WALK;
+    Counts counts;
+    in.setHooks(&counts);
+    try {
+        in.run(stmts);
+    }
+    catch (std::exception& e) {
+    }
+    in.out.flush();
+    std::printf("%s", output.c_str());
+    for (auto& c : counts.calls) {
+        std::printf("call %s %d\n", c.first.c_str(), c.second);
+    }
+    for (auto& r : counts.returns) {
+        std::printf("return %s %d\n", r.first.c_str(), r.second);
+    }
+    for (auto& l : counts.lines) {
+        std::printf("line %d %d\n", l.first, l.second);
+    }
+    std::printf("error %s\n", counts.error.c_str());
+}
+CPP
+
+expected="3
+call count 4
+call inc 3
+return count 3
+return count (none) 1
+return inc 3
+line 1 1
+line 2 3
+line 3 1
+line 4 1
+line 5 3
+line 6 1
+line 7 1
+line 8 3
+line 9 1
+line 10 1
+error name 'missing' is not defined"
+if ! g++ -std=c++17 -O2 -pthread -I"$DIR" "$TMP/hooks.cpp" -o "$TMP/hooks"; then
+    echo "hooks.cpp does not build"
+    exit 1
+fi
+for engine in "" closure; do
+    actual=$("$TMP/hooks" $engine)
+    if [ "$actual" != "$expected" ]; then
+        echo "hooks ${engine:-walk}:"
+        echo "$actual"
+        exit 1
+    fi
+done
+
+if ! g++ -std=c++17 -O2 -pthread -DMYPYTHON_HOOKS=0 -I"$DIR" "$TMP/hooks.cpp" -o "$TMP/nohooks"; then
+    echo "hooks.cpp does not build with -DMYPYTHON_HOOKS=0"
+    exit 1
+fi
+actual=$("$TMP/nohooks")
+if [ "$actual" != "3
+error " ]; then
+    echo "hooks compiled out:"
+    echo "$actual"
+    exit 1
+fi
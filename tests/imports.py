@@ -0,0 +1,12 @@
+# import and from-import of a module next to the script. The module runs
+# once, and its functions keep using its own globals.
+
+import imports_lib
+from imports_lib import scaled, set_scale
+import imports_lib
+
+scale = 100
+print(imports_lib.scale, scaled(2), imports_lib.scaled(5))
+set_scale(4)
+print(imports_lib.scale, scaled(2), scale)
+import missing_module
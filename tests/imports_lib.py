@@ -0,0 +1,12 @@
+# Imported by imports.py; runs once however often it is imported.
+
+print("loading imports_lib")
+
+scale = 3
+
+def scaled(x):
+    return x * scale
+
+def set_scale(s):
+    global scale
+    scale = s
@@ -0,0 +1,21 @@
+# Modules not next to the script are looked for in each directory of
+# $MYPYTHONPATH, in order.
+MYPYTHON=$1
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+mkdir "$DIR/main" "$DIR/first" "$DIR/second"
+echo 'where = "first"' >"$DIR/first/place.py"
+echo 'where = "second"' >"$DIR/second/place.py"
+echo 'other = 2' >"$DIR/second/other.py"
+cat >"$DIR/main/script.py" <<'PY'
+from place import where
+from other import other
+print(where, other)
+PY
+actual=$(MYPYTHONPATH="$DIR/first:$DIR/second" "$MYPYTHON" "$DIR/main/script.py" 2>&1)
+if [ "$actual" != "first 2" ]; then
+    echo "output:"
+    echo "$actual"
+    exit 1
+fi
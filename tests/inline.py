@@ -0,0 +1,24 @@
+# args: --no-jit --inline-report
+# An inlined call evaluates each argument once and in order, even when the
+# parameter is used twice or not at all.
+
+def sq(x):
+    return x * x
+
+def first(a, b):
+    return a
+
+def noisy(k):
+    print("arg", k)
+    return k
+
+def twice(v):
+    return sq(v) + sq(v)
+
+print(sq(noisy(3)))
+print(first(noisy(1), noisy(2)))
+print(twice(2))
+total = 0
+for i in range(5):
+    total = total + sq(i)
+print(total)
@@ -0,0 +1,19 @@
+# args: --inline-report
+# A recursive function is never inlined, into itself or anywhere else.
+
+def loop(n):
+    return loop(n - 1)
+
+def ping(n):
+    return pong(n + 1)
+
+def pong(n):
+    return ping(n - 1)
+
+def double(n):
+    return 2 * n
+
+def quadruple(n):
+    return double(double(n))
+
+print(double(5), quadruple(3))
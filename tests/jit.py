@@ -0,0 +1,33 @@
+# Hot integer functions are compiled; results must match the interpreter,
+# and calls the compiled code cannot take still run interpreted.
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+def is_even(n):
+    if n == 0:
+        return True
+    return is_odd(n - 1)
+
+def is_odd(n):
+    if n == 0:
+        return False
+    return is_even(n - 1)
+
+def mix(a, b, c, d, e, f):
+    if a * b - c > d:
+        return a - b * c + d - e * f
+    return -(a + b + c + d + e + f)
+
+def loop(i, acc):
+    if i == 0:
+        return acc
+    return loop(i - 1, acc + mix(i, 3, 7, 20, i - 700, 2))
+
+print(fib(22))
+print(is_even(300), is_odd(301), is_even(7))
+print(loop(1500, 0))
+print(mix(-5, 4, 3, -100, 2, 9), mix(1, 1, 1, 1, 1, 1))
+print(mix(2, 3, 4, 5, 6, "x"))
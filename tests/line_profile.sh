@@ -0,0 +1,40 @@
+# --line-profile counts how many times each line runs and lists the lines
+# with their source, most expensive first.
+MYPYTHON=$1
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat >"$TMP/lines.py" <<'PY'
+def leaf(n):
+    s = 0
+    for k in range(n):
+        s = s + 1
+    return s
+
+total = 0
+for i in range(30):
+    total = total + leaf(2000)
+print(total)
+PY
+actual=$("$MYPYTHON" --line-profile "$TMP/lines.py" 2>"$TMP/err")
+if [ "$actual" != "60000" ] || ! grep -q '^line profile: [0-9.]* ms in 9 lines$' "$TMP/err"; then
+    echo "output '$actual', report:"
+    cat "$TMP/err"
+    exit 1
+fi
+# line, hits and source, by line
+hits=$(awk 'NR > 2 { line = $1; hits = $2; $1 = $2 = $3 = $4 = ""; sub(/^ */, ""); print line, hits, $0 }' "$TMP/err" | sort -n)
+expected="1 1 def leaf(n):
+2 30 s = 0
+3 30 for k in range(n):
+4 60000 s = s + 1
+5 30 return s
+7 1 total = 0
+8 1 for i in range(30):
+9 30 total = total + leaf(2000)
+10 1 print(total)"
+if [ "$hits" != "$expected" ]; then
+    echo "hits:"
+    echo "$hits"
+    exit 1
+fi
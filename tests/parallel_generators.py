@@ -0,0 +1,39 @@
+# args: -j 4
+# Generators are resumed on the interpreter that created them, so a
+# parallel_map that would hand them to workers runs serially instead.
+
+def next_of(k):
+    r = k + 1
+    return r
+
+def count(n):
+    for k in range(n):
+        yield next_of(k) - 1
+
+def total(g):
+    s = 0
+    for x in g:
+        s = s + x
+    return s
+
+print(parallel_map(total, [count(20000), count(20001), count(20002), count(20003), count(20004), count(20005)]))
+
+def boxed(box):
+    s = 0
+    for x in box["g"]:
+        s = s + x
+    return s
+
+print(parallel_map(boxed, [{"g": count(10)}, {"g": count(20)}, {"g": count(30)}, {"g": count(40)}]))
+
+shared = count(20000)
+
+def take(n):
+    s = 0
+    for x in shared:
+        s = s + x
+        if x == n:
+            return s
+    return s
+
+print(parallel_map(take, [10, 20, 30, 40]))
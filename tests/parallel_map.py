@@ -0,0 +1,37 @@
+# args: -j 4
+# Results come back in input order; a function that prints or writes a
+# global runs serially, so its effects happen in order too.
+
+def square(x):
+    return x * x
+
+def slow(n):
+    s = 0
+    for k in range(n):
+        s = s + k
+    return s
+
+print(parallel_map(square, [3, 1, 4, 1, 5, 9, 2, 6]))
+print(parallel_map(slow, [4000, 10, 3000, 20, 2000, 30]))
+print(parallel_map(square, []))
+
+def noisy(x):
+    print("item", x)
+    return -x
+
+print(parallel_map(noisy, [1, 2, 3, 4]))
+
+total = 0
+
+def add(x):
+    global total
+    total = total + x
+    return total
+
+print(parallel_map(add, [1, 2, 3, 4]))
+print(total)
+
+def fails(x):
+    return x + missing
+
+print(parallel_map(fails, [1, 2]))
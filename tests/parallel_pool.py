@@ -0,0 +1,26 @@
+# args: -j 4
+# The workers and their copies of the functions are kept from one
+# parallel_map to the next; what changed in between is still seen.
+
+def step(k):
+    return k + 1
+
+def walk(n):
+    s = 0
+    for k in range(n):
+        s = step(s)
+    return s * scale
+
+items = [1500, 1501, 1502, 1503, 1504, 1505, 1506, 1507]
+scale = 1
+print(parallel_map(walk, items))
+print(parallel_map(walk, items))
+
+scale = 2
+print(parallel_map(walk, items))
+
+def step(k):
+    return k + 2
+
+print(parallel_map(walk, items))
+print(parallel_map(step, [1, 2]))
@@ -0,0 +1,20 @@
+# args: -j 4
+# A parallel_map item that runs out of a worker thread's stack stops the
+# script as it would on the main thread, with exit status 6.
+
+def down(n):
+    if n == 0:
+        return 0
+    return down(n - 1) + 1
+
+def walk(n):
+    s = 0
+    for k in range(n):
+        s = s + 1
+    return s
+
+def deep(n):
+    return walk(5000) + down(n * 1000000)
+
+print(parallel_map(deep, [0, 0, 0, 0]))
+print(parallel_map(deep, [0, 0, 1, 1, 1, 1]))
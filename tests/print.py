@@ -0,0 +1,16 @@
+# print: numbers formatted in place, several arguments, and more output
+# than the 64 KiB buffer holds.
+
+print(0, 7, -7, 2147483647, -2147483647 - 1)
+print("text", 12, None, 3 > 2, 2 > 3)
+print()
+print({"k": -1, 10: "v"})
+
+def lines(i, n):
+    if i == n:
+        return 0
+    print("line", i, -i * 1003)
+    return lines(i + 1, n)
+
+lines(0, 4000)
+print("done")
@@ -0,0 +1,25 @@
+# What was printed before the process dies, even of a fatal signal such as
+# a stack overflow from runaway recursion, still reaches a redirected stdout.
+MYPYTHON=$1
+SCRIPT=$(mktemp)
+OUT=$(mktemp)
+trap 'rm -f "$SCRIPT" "$OUT"' EXIT
+
+cat >"$SCRIPT" <<'PY'
+def down(n):
+    return down(n + 1) + 1
+
+print("before")
+print(down(0))
+PY
+"$MYPYTHON" "$SCRIPT" >"$OUT" 2>/dev/null
+status=$?
+if [ $status -eq 0 ]; then
+    echo "exit status 0, expected a failure"
+    exit 1
+fi
+if [ "$(cat "$OUT")" != "before" ]; then
+    echo "output:"
+    cat "$OUT"
+    exit 1
+fi
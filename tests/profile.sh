@@ -0,0 +1,46 @@
+# --profile writes collapsed stacks of the user functions running, which
+# flamegraph tools read, and a self/total table to stderr; the script's own
+# output is unchanged.
+MYPYTHON=$1
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat >"$TMP/hot.py" <<'PY'
+def leaf(n):
+    s = 0
+    for k in range(n):
+        s = s + 1
+    return s
+
+def middle(n):
+    return leaf(n)
+
+def top(n):
+    t = 0
+    for i in range(100):
+        t = t + middle(n)
+    return t
+
+print(top(20000))
+PY
+actual=$("$MYPYTHON" --profile="$TMP/hot.folded" "$TMP/hot.py" 2>"$TMP/err")
+status=$?
+if [ $status -ne 0 ] || [ "$actual" != "2000000" ]; then
+    echo "exit status $status, output:"
+    echo "$actual"
+    exit 1
+fi
+if ! grep -q '^<module>;top;middle;leaf [0-9][0-9]*$' "$TMP/hot.folded" \
+   || grep -v '^<module>[;a-z]* [0-9][0-9]*$' "$TMP/hot.folded"; then
+    echo "collapsed stacks:"
+    cat "$TMP/hot.folded"
+    exit 1
+fi
+samples=$(awk '{ n += $NF } END { print n }' "$TMP/hot.folded")
+if ! grep -q "^profile: $samples samples" "$TMP/err" \
+   || ! grep -q '^ *[0-9.]*% *100.0% .* top$' "$TMP/err" \
+   || [ "$(awk 'NR == 3 { print $NF }' "$TMP/err")" != "leaf" ]; then
+    echo "report:"
+    cat "$TMP/err"
+    exit 1
+fi
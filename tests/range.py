@@ -0,0 +1,7 @@
+# range() near the ends of the int range, where stepping past stop overflows.
+
+print(range(2147483640, 2147483647, 5))
+print(range(-2147483640, -2147483647, -5))
+print(range(2147483646, 2147483647))
+print(range(5), range(2, 5), range(10, 0, -3), range(0, 10, 4), range(3, 3), range(5, 0))
+print(len(range(0, 100, 7)), sum(range(101)))
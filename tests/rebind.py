@@ -0,0 +1,30 @@
+# A name is bound to a def or to a value, never both: binding one kind
+# replaces the other, also in the call and global caches already filled.
+
+x = 1
+def show():
+    return x
+
+print(show())
+def x():
+    return "def x"
+
+print(x, show(), x())
+x = 2
+print(x, show())
+
+def f(n):
+    return n + 1
+
+# hot enough to be compiled, with f called from the compiled code
+def call(n):
+    m = f(n)
+    return m
+
+t = 0
+for i in range(2000):
+    t = t + call(i)
+print(t)
+f = 3
+print(f)
+print(call(1))
@@ -0,0 +1,67 @@
+# A runtime error is followed by the last events the flight recorder saw,
+# and a fatal signal dumps the whole ring after flushing the output.
+MYPYTHON=$1
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat >"$TMP/error.py" <<'PY'
+def inner(x):
+    y = x + 1
+    return y + missing
+
+def outer(x):
+    y = x
+    return inner(y)
+
+print("before")
+outer(1)
+PY
+actual=$("$MYPYTHON" "$TMP/error.py" 2>&1)
+status=$?
+expected="before
+name 'missing' is not defined
+recent events, oldest first:
+  line 1
+  line 5
+  line 9
+  line 10
+  call outer
+  line 6
+  line 7
+  call inner
+  line 2
+  line 3
+  error out of inner
+  error out of outer"
+if [ $status -ne 1 ] || [ "$actual" != "$expected" ]; then
+    echo "exit status $status, output:"
+    echo "$actual"
+    exit 1
+fi
+
+cat >"$TMP/spin.py" <<'PY'
+def spin(n):
+    s = 0
+    for j in range(n):
+        s = j
+    return s
+
+print("started")
+for i in range(1000000):
+    spin(1000)
+PY
+"$MYPYTHON" --no-jit "$TMP/spin.py" >"$TMP/out" 2>"$TMP/err" &
+pid=$!
+sleep 1
+kill -SEGV $pid
+wait $pid
+status=$?
+if [ $status -ne 139 ] || [ "$(cat "$TMP/out")" != "started" ] \
+   || [ "$(head -n 2 "$TMP/err")" != "fatal signal: segmentation fault
+recent events, oldest first:" ] \
+   || [ "$(grep -c '^  line [2-4]$\|^  call spin$\|^  return spin$' "$TMP/err")" -lt 200 ]; then
+    echo "exit status $status, output:"
+    cat "$TMP/out"
+    head "$TMP/err"
+    exit 1
+fi
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Regression tests for the interpreter.
+#
+#   g++ -std=c++17 -O2 -pthread *.cpp -o mypython && tests/run.sh [./mypython]
+#
+# Run from the repository root. Every tests/NAME.py that has a NAME.out is
+# run, and what it writes to stdout and stderr must match NAME.out, followed
+# by "exit status N" if it exits with N other than 0. A first line
+# "# args: ..." gives the options to run it with. Every tests/NAME.sh is run
+# with the interpreter's path and must exit with 0; what it prints tells
+# why it failed. Prints one line per test and exits with 1 if any failed.
+
+MYPYTHON=${1:-./mypython}
+DIR=$(dirname "$0")
+OUT=$(mktemp)
+trap 'rm -f "$OUT"' EXIT
+failed=0
+
+# the flight recorder's events after an error depend on the engine and on
+# what was compiled or inlined; the error itself is kept
+events() {
+    awk '/^recent events, oldest first:$/ { skip = 1; next }
+         skip && /^  / { next }
+         { skip = 0; print }'
+}
+
+for script in "$DIR"/*.py; do
+    name=${script%.py}
+    [ -f "$name.out" ] || continue
+    args=$(sed -n '1s/^# args://p' "$script")
+    # shellcheck disable=SC2086
+    "$MYPYTHON" $args "$script" >"$OUT" 2>&1
+    status=$?
+    [ $status -eq 0 ] || echo "exit status $status" >>"$OUT"
+    actual=$(events <"$OUT")
+    if [ "$actual" = "$(cat "$name.out")" ]; then
+        echo "ok   ${name##*/}"
+    else
+        echo "FAIL ${name##*/}"
+        echo "$actual" | diff "$name.out" - | sed 's/^/     /'
+        failed=1
+    fi
+done
+
+for test in "$DIR"/*.sh; do
+    [ "${test##*/}" = run.sh ] && continue
+    name=${test%.sh}
+    if message=$(sh "$test" "$MYPYTHON" 2>&1); then
+        echo "ok   ${name##*/}"
+    else
+        echo "FAIL ${name##*/}"
+        echo "$message" | sed 's/^/     /'
+        failed=1
+    fi
+done
+
+exit $failed
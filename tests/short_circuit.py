@@ -0,0 +1,34 @@
+# and/or evaluate left to right, stop at the operand that decides and
+# return it; a conditional expression evaluates only the branch taken.
+
+def noisy(tag, v):
+    print("eval", tag)
+    return v
+
+def expensive(n):
+    return 100 // n > 1
+
+print(noisy("a", 0) and noisy("b", 1))
+print(noisy("c", 2) and noisy("d", 3))
+print(noisy("e", 0) or noisy("f", ""))
+print(noisy("g", "x") or noisy("h", 1))
+print(noisy("i", 1) + noisy("j", 2))
+print([] or {} or 0 or None, [1] and "s", not [], not "")
+print(1 and 2.5, 0.0 or "zero", None or False)
+
+n = 0
+print(n > 0 and expensive(n))
+n = 10
+print(n > 0 and expensive(n))
+
+print(noisy("k", 1) if noisy("l", True) else noisy("m", 2))
+print(noisy("n", 1) if noisy("o", []) else noisy("p", 2))
+print("a" if 0 else "b" if 1 else "c")
+big = [1 if n > 2 else -1, 2] if False else 7
+print(big)
+
+def sign(x):
+    return 1 if x > 0 else -1 if x < 0 else 0
+
+print(sign(5), sign(-3), sign(0))
+print(1 // 0 if False else "safe")
@@ -0,0 +1,62 @@
+# --snapshot-out runs a script up to "# snapshot" and saves its state;
+# --snapshot-in resumes from there without the script or its modules,
+# with shared objects and closures as they were, and refuses a damaged
+# image.
+MYPYTHON=$1
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat >"$TMP/setup.py" <<'PY'
+import setup_lib
+table = {}
+for i in range(100):
+    table[i] = i * i
+shared = [1, 2]
+pair = [shared, shared]
+
+def make(k):
+    def add(x):
+        return x + k
+    return add
+
+add5 = make(5)
+print("setup done")
+# snapshot
+print(table[9], len(table))
+shared[0] = 99
+print(pair)
+print(add5(1), setup_lib.base)
+PY
+printf 'print("loading setup_lib")\nbase = 7\n' >"$TMP/setup_lib.py"
+
+actual=$("$MYPYTHON" --snapshot-out="$TMP/image" "$TMP/setup.py" 2>&1)
+status=$?
+if [ $status -ne 0 ] || [ "$actual" != "loading setup_lib
+setup done" ]; then
+    echo "--snapshot-out: exit status $status, output:"
+    echo "$actual"
+    exit 1
+fi
+rm "$TMP/setup.py" "$TMP/setup_lib.py"
+expected="81 100
+[[99, 2], [99, 2]]
+6 7"
+for run in 1 2; do
+    actual=$("$MYPYTHON" --snapshot-in="$TMP/image" 2>&1)
+    status=$?
+    if [ $status -ne 0 ] || [ "$actual" != "$expected" ]; then
+        echo "--snapshot-in, run $run: exit status $status, output:"
+        echo "$actual"
+        exit 1
+    fi
+done
+
+size=$(wc -c <"$TMP/image")
+printf 'x' | dd of="$TMP/image" bs=1 seek=$((size / 2)) conv=notrunc 2>/dev/null
+actual=$("$MYPYTHON" --snapshot-in="$TMP/image" 2>&1)
+status=$?
+if [ $status -ne 1 ] || [ "$actual" != "corrupt snapshot" ]; then
+    echo "damaged image: exit status $status, output:"
+    echo "$actual"
+    exit 1
+fi
@@ -0,0 +1,33 @@
+# args: --no-jit
+# A function called often enough with one signature runs a specialized
+# body; other signatures, and call results of a new type, still behave.
+
+def pick(k):
+    if k > 150:
+        return "big"
+    return k
+
+def f(a, b):
+    if a < b and not (a == b):
+        return a + b
+    return a - b
+
+def same(a, b):
+    return a == b
+
+def g(n):
+    r = pick(n)
+    return r
+
+total = 0
+for i in range(200):
+    total = total + f(i, 100)
+print(total)
+for i in range(200):
+    r = same(i, 7)
+print(r, same(7, 7), same(True, True), same(False, True))
+print(f(-3, 2), f(5, 5))
+print(g(3), g(151))
+for i in range(200):
+    r = g(i)
+print(r)
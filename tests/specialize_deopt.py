@@ -0,0 +1,23 @@
+# A call whose guard fails inside a typed operation of a specialized body:
+# the operation must see the float, not take its int path.
+
+def g(k):
+    if k > 150:
+        return 1.5
+    return 1
+
+def f(n):
+    s = n + g(n)
+    return s
+
+def more(n):
+    c = g(n) > 1
+    return c
+
+r = 0
+for i in range(152):
+    r = f(i)
+print(r)
+for i in range(152):
+    r = more(i)
+print(r)
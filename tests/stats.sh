@@ -0,0 +1,31 @@
+# --stats and --stats=json report the same counts on stderr, every phase
+# is timed, and the script's output is unchanged.
+MYPYTHON=$1
+DIR=$(dirname "$0")
+ERR=$(mktemp)
+trap 'rm -f "$ERR"' EXIT
+
+fail() {
+    echo "$1:"
+    cat "$ERR"
+    exit 1
+}
+
+out=$("$MYPYTHON" --stats "$DIR/fib.py" 2>"$ERR")
+[ "$out" = "6765" ] || fail "output '$out'"
+for phase in read scan parse resolve run total; do
+    grep -q "^$phase  *[0-9.]*  *[0-9.]*$" "$ERR" || fail "no $phase time"
+done
+grep -q '^tokens: 47 (' "$ERR" || fail "tokens"
+grep -q '^ast: 21 nodes, [0-9]* bytes$' "$ERR" || fail "ast"
+grep -q '^calls: 21891, max depth 20$' "$ERR" || fail "calls"
+grep -q '^objects: .* bool 21891 .* function 1 ' "$ERR" || fail "objects"
+grep -q '^peak rss: [1-9][0-9]* KB$' "$ERR" || fail "peak rss"
+
+out=$("$MYPYTHON" --stats=json "$DIR/fib.py" 2>"$ERR")
+[ "$out" = "6765" ] || fail "output '$out'"
+for field in '"tokens": 47' '"ast_nodes": 21' '"calls": 21891' '"max_depth": 20' \
+             '"bool": 21891' '"function": 1' '"run": {"wall_ms": '; do
+    grep -q "$field" "$ERR" || fail "no $field"
+done
+[ "$(wc -l <"$ERR")" -eq 1 ] || fail "more than one line of JSON"
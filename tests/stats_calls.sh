@@ -0,0 +1,9 @@
+# --stats counts every call, including those the JIT would have compiled
+MYPYTHON=$1
+DIR=$(dirname "$0")
+jit=$("$MYPYTHON" --stats --jit "$DIR/fib.py" 2>&1 >/dev/null | grep '^calls:')
+walk=$("$MYPYTHON" --stats --no-jit "$DIR/fib.py" 2>&1 >/dev/null | grep '^calls:')
+if [ -z "$jit" ] || [ "$jit" != "$walk" ]; then
+    echo "'$jit' with the JIT, '$walk' without"
+    exit 1
+fi
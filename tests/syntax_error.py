@@ -0,0 +1,5 @@
+# A syntax error names the line and column of the token it stopped at,
+# counting the lines of a parenthesized expression.
+x = 1
+y = (2 +
+     * 3)
@@ -0,0 +1,58 @@
+# Operations that fail whatever reaches them are reported before the run,
+# even in code that never runs; --check stops there, with status 1 if any.
+MYPYTHON=$1
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat >"$TMP/bad.py" <<'PY'
+def neg(s):
+    return -s
+
+def add(a, b):
+    return a + b
+
+def count(n):
+    t = 0
+    for k in range(n):
+        t = t + k
+    return t
+
+print(count(10))
+if count(3) > 100:
+    print(add(1, "a"))
+    print(neg("x"))
+    print(add(1))
+print("end")
+PY
+cat >"$TMP/good.py" <<'PY'
+def add(a, b):
+    return a + b
+
+print(add(1, 2), add(2.5, 1))
+PY
+errors="$TMP/bad.py:2: TypeError: bad operand type for unary -: 'str'
+$TMP/bad.py:5: TypeError: unsupported operand type(s) for +: 'int' and 'str'
+$TMP/bad.py:17: TypeError: add() takes 2 arguments but 1 were given"
+
+check() {
+    actual=$("$MYPYTHON" "$@" 2>&1)
+    status=$?
+    if [ $status -ne "$expected_status" ] || [ "$actual" != "$expected" ]; then
+        echo "$*: exit status $status, output:"
+        echo "$actual"
+        exit 1
+    fi
+}
+
+expected_status=0 expected="$errors
+45
+end"
+check "$TMP/bad.py"
+expected_status=1 expected="$errors
+3 type error(s) in $TMP/bad.py"
+check --check "$TMP/bad.py"
+expected_status=0 expected="45
+end"
+check --no-typecheck "$TMP/bad.py"
+expected_status=0 expected=""
+check --check "$TMP/good.py"
@@ -1,47 +1,52 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 
-enum TokenType {
+enum TokenType : uint8_t {
     // ids
     IDENTIFIER,
 
     // keywords
     IF, ELSE, DEF, RETURN, NOT, AND, OR, TRUE, FALSE, NONE, PRINT,
+    FOR, IN, GLOBAL, NONLOCAL, IMPORT, FROM, YIELD,
 
     // operators
-    PLUS, MINUS, DIVIDE, MULTIPLY, EQUAL,
+    PLUS, MINUS, DIVIDE, FLOOR_DIVIDE, MULTIPLY, EQUAL,
     EQUAL_TO, GREATER_THAN, LESS_THAN, NOT_EQUAL_TO,
     GREATER_THAN_EQUAL_TO, LESS_THAN_EQUAL_TO,
 
     // values
-    NUMBER, STRING, LPARAN, RPARAN,
+    NUMBER, FLOAT, STRING, LPARAN, RPARAN,
+    LBRACE, RBRACE, LBRACKET, RBRACKET,
 
     // syntax
-    NEWLINE, INDENT, DEDENT, COLON, END, COMMA,
+    NEWLINE, INDENT, DEDENT, COLON, END, COMMA, DOT,
 
     // invalid token
     INVALID,
 };
 
-std::vector<std::string> tokenNames = {
+inline const std::vector<std::string> tokenNames = {
     // ids
     "IDENTIFIER",
 
     // keywords
     "IF", "ELSE", "DEF", "RETURN", "NOT", "AND", "OR", "TRUE", "FALSE", "NONE", "PRINT",
+    "FOR", "IN", "GLOBAL", "NONLOCAL", "IMPORT", "FROM", "YIELD",
 
     // operators
-    "PLUS", "MINUS", "DIVIDE", "MULTIPLY", "EQUAL",
+    "PLUS", "MINUS", "DIVIDE", "FLOOR_DIVIDE", "MULTIPLY", "EQUAL",
     "EQUAL_TO", "GREATER_THAN", "LESS_THAN", "NOT_EQUAL_TO",
     "GREATER_THAN_EQUAL_TO", "LESS_THAN_EQUAL_TO",
 
     // values
-    "NUMBER", "STRING", "LPARAN", "RPARAN",
+    "NUMBER", "FLOAT", "STRING", "LPARAN", "RPARAN",
+    "LBRACE", "RBRACE", "LBRACKET", "RBRACKET",
 
     // syntax
-    "NEWLINE", "INDENT", "DEDENT", "COLON", "END", "COMMA",
+    "NEWLINE", "INDENT", "DEDENT", "COLON", "END", "COMMA", "DOT",
 
     // invalid token
     "INVALID",
@@ -50,6 +55,10 @@ std::vector<std::string> tokenNames = {
 
 struct Token {
     TokenType type;
+    // where the token starts, from 1; 0 for a token the scanner did not
+    // read. Both fit in the padding before value.
+    uint16_t column = 0;
+    uint32_t line = 0;
     std::string value;
 
     Token() {}
@@ -0,0 +1,561 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hashmap.h"
+#include "visitor.h"
+#include "statement.h"
+#include "expression.h"
+#include "object.h"
+#include "builtins.h"
+
+// Static type inference over the whole script, run once after the Resolver.
+//
+// Every variable gets the set of types (a TypeBits mask) of everything that
+// can be stored in it, and every function the types of what it can return:
+//
+//   - a local is what its assignments and for loops store; a parameter is
+//     what the calls to its function pass. Only calls by name to a global
+//     def are followed: a function whose name is also read as a value (so
+//     it can be called from anywhere), nested defs, and a name bound more
+//     than once or shadowing a builtin are assumed to take and return
+//     anything;
+//   - a global is what every assignment to that name in the script stores;
+//   - captured variables, subscripts, module attributes and imports can be
+//     anything. Iterating over a call to range gives ints.
+//
+// Types only ever widen, so iterating over the program to a fixpoint
+// terminates. The sets cover every value that can occur at run time (as
+// long as nothing outside the script calls into it), so an operator,
+// condition or not/and/or whose operands can only be ints, or only
+// booleans, is marked typed on the original AST, and the tree walker runs
+// it without type checks, as it does in specialized bodies (specialize.h).
+// The marks are proven, so unlike the specializer's they are never undone.
+// Imported modules are not analyzed.
+//
+// An operation none of whose possible operand types it accepts fails every
+// time it runs; these are the errors, reported before the script runs.
+
+class TypeChecker : Visitor<void> {
+public:
+    enum : uint16_t { ANY = 0xFFFF };
+
+    // an operation that fails whenever it runs
+    struct Error {
+        uint32_t line;
+        std::string message;
+    };
+
+    std::vector<Error> errors;
+
+    void check(const std::vector<Statement*>& program) {
+        bind(program);
+        // only calls to a top-level def bound once are followed
+        for (Function* f : order) {
+            if (f->binding.kind != VAR_GLOBAL || target(f->name.value) != f) {
+                functions.find(f)->escapes = true;
+            }
+        }
+        do {
+            changed = false;
+            run(program);
+        } while (changed);
+
+        annotate = true;
+        run(program);
+        std::stable_sort(errors.begin(), errors.end(), [](const Error& a, const Error& b) { return a.line < b.line; });
+    }
+
+private:
+    static const uint16_t NUMBER_TYPES = TYPE_INT | TYPE_FLOAT;
+
+    struct FunctionTypes {
+        // of each frame slot, params first
+        std::vector<uint16_t> slots;
+        uint16_t returns = 0;
+        // called from places the checker does not see: the params can be
+        // anything
+        bool escapes = false;
+    };
+
+    struct GlobalTypes {
+        uint16_t type = 0;
+        int bindings = 0;
+        // the def, when that is the only binding of the name
+        Function* def = nullptr;
+    };
+
+    HashMap<Function*, FunctionTypes> functions;
+    HashMap<std::string, GlobalTypes> globals;
+    std::vector<Function*> order;
+    // the function being visited; null at top level
+    Function* function = nullptr;
+    FunctionTypes* frame = nullptr;
+    bool changed = false;
+    bool annotate = false;
+    // type of the last expression visited
+    uint16_t type = ANY;
+
+    // --- binding: every function and every name a global can be stored
+    // under, so the tables do not grow while their entries are in use ---
+
+    void bind(const std::vector<Statement*>& stmts) {
+        for (Statement* s : stmts) {
+            bind(s);
+        }
+    }
+
+    void bind(Statement* stmt) {
+        if (stmt == nullptr) {
+            return;
+        }
+        if (Var* v = dynamic_cast<Var*>(stmt)) {
+            bindGlobal(v->ref, v->name.value, nullptr);
+        }
+        else if (For* f = dynamic_cast<For*>(stmt)) {
+            bindGlobal(f->ref, f->name.value, nullptr);
+            bind(f->body);
+        }
+        else if (Import* i = dynamic_cast<Import*>(stmt)) {
+            if (i->names.empty()) {
+                bindGlobal(i->refs[0], i->module.value, nullptr);
+            }
+            for (size_t n = 0; n < i->names.size(); n++) {
+                bindGlobal(i->refs[n], i->names[n].value, nullptr);
+            }
+        }
+        else if (Function* f = dynamic_cast<Function*>(stmt)) {
+            bindGlobal(f->binding, f->name.value, f);
+            FunctionTypes types;
+            types.slots.assign(f->num_slots, 0);
+            functions.set(f, types);
+            order.push_back(f);
+            bind(f->body);
+        }
+        else if (Block* b = dynamic_cast<Block*>(stmt)) {
+            bind(b->statements);
+        }
+        else if (If* i = dynamic_cast<If*>(stmt)) {
+            bind(i->thenBranch);
+            bind(i->elseBranch);
+        }
+    }
+
+    void bindGlobal(const VarRef& ref, const std::string& name, Function* def) {
+        if (ref.kind != VAR_GLOBAL) {
+            return;
+        }
+        GlobalTypes& g = globals[name];
+        g.bindings++;
+        g.def = g.bindings == 1 ? def : nullptr;
+    }
+
+    // the def a call by name runs, if there is only one it can be
+    Function* target(const std::string& name) {
+        GlobalTypes* g = globals.find(name);
+        if (g == nullptr || g->def == nullptr || Builtins::find(name) != nullptr) {
+            return nullptr;
+        }
+        return g->def;
+    }
+
+    // --- inference ---
+
+    void run(const std::vector<Statement*>& program) {
+        function = nullptr;
+        frame = nullptr;
+        visit(program);
+        for (Function* f : order) {
+            function = f;
+            frame = functions.find(f);
+            if (frame->escapes) {
+                for (size_t i = 0; i < f->params.size(); i++) {
+                    widen(frame->slots[i], ANY);
+                }
+            }
+            visit(f->body);
+            if (f->generator) {
+                widen(frame->returns, TYPE_OTHER);
+            }
+            else if (!returns(f->body)) {
+                widen(frame->returns, TYPE_NONE);
+            }
+        }
+    }
+
+    void visit(const std::vector<Statement*>& stmts) {
+        for (Statement* s : stmts) {
+            s->accept(this);
+        }
+    }
+
+    uint16_t typeOf(Expr* expr) {
+        expr->accept(this);
+        return type;
+    }
+
+    void widen(uint16_t& field, uint16_t t) {
+        if ((field | t) != field) {
+            field |= t;
+            changed = true;
+        }
+    }
+
+    void store(const VarRef& ref, const std::string& name, uint16_t t) {
+        if (ref.kind == VAR_LOCAL && frame != nullptr) {
+            widen(frame->slots[ref.slot], t);
+        }
+        else if (ref.kind == VAR_GLOBAL) {
+            widen(globals[name].type, t);
+        }
+    }
+
+    uint16_t load(const VarRef& ref, const std::string& name) {
+        if (ref.kind == VAR_LOCAL && frame != nullptr) {
+            return frame->slots[ref.slot];
+        }
+        if (ref.kind == VAR_GLOBAL) {
+            if (GlobalTypes* g = globals.find(name)) {
+                // a def read as a value can be called from anywhere
+                if (g->def != nullptr) {
+                    functions.find(g->def)->escapes = true;
+                }
+                return g->type;
+            }
+        }
+        return ANY;
+    }
+
+    // every path through stmts ends in a return
+    static bool returns(const std::vector<Statement*>& stmts) {
+        return !stmts.empty() && returns(stmts.back());
+    }
+
+    static bool returns(Statement* stmt) {
+        if (dynamic_cast<Return*>(stmt) != nullptr) {
+            return true;
+        }
+        if (Block* b = dynamic_cast<Block*>(stmt)) {
+            return returns(b->statements);
+        }
+        if (If* i = dynamic_cast<If*>(stmt)) {
+            return i->elseBranch != nullptr && returns(i->thenBranch) && returns(i->elseBranch);
+        }
+        return false;
+    }
+
+    static bool isRange(Expr* expr) {
+        Call* c = dynamic_cast<Call*>(expr);
+        return c != nullptr && c->object == nullptr && c->ref.kind == VAR_GLOBAL && c->callee.value == "range";
+    }
+
+    uint16_t builtinResult(const std::string& name, const std::vector<uint16_t>& args) {
+        if (name == "len" || name == "int") {
+            return TYPE_INT;
+        }
+        if (name == "float") {
+            return TYPE_FLOAT;
+        }
+        if (name == "str") {
+            return TYPE_STRING;
+        }
+        if (name == "range" || name == "parallel_map") {
+            return TYPE_LIST;
+        }
+        if (name == "abs" && args.size() == 1) {
+            return (args[0] & (TYPE_INT | TYPE_BOOL) ? TYPE_INT : 0) | (args[0] & TYPE_FLOAT);
+        }
+        if (name == "sum") {
+            return NUMBER_TYPES;
+        }
+        return ANY;
+    }
+
+    // --- errors, reported on the last pass ---
+
+    static std::string names(uint16_t mask) {
+        std::string s;
+        for (int i = 0; i < TYPE_KINDS; i++) {
+            if (mask & (1 << i)) {
+                s += s.empty() ? "'" : " or '";
+                s += TYPE_NAMES[i];
+                s += "'";
+            }
+        }
+        return s;
+    }
+
+    void report(uint32_t line, const std::string& message) {
+        if (annotate) {
+            errors.push_back(Error{ line, message });
+        }
+    }
+
+    static const char* symbol(TokenType op) {
+        switch (op) {
+        case PLUS: return "+";
+        case MINUS: return "-";
+        case MULTIPLY: return "*";
+        case DIVIDE: return "/";
+        case FLOOR_DIVIDE: return "//";
+        case EQUAL_TO: return "==";
+        case NOT_EQUAL_TO: return "!=";
+        case GREATER_THAN: return ">";
+        case LESS_THAN: return "<";
+        case GREATER_THAN_EQUAL_TO: return ">=";
+        case LESS_THAN_EQUAL_TO: return "<=";
+        default: return "?";
+        }
+    }
+
+    void mark(uint16_t& field, uint16_t t) {
+        if (annotate && field == 0) {
+            field = t;
+        }
+    }
+
+    // --- statements ---
+
+    void visitVarStatement(Var* stmt) override {
+        store(stmt->ref, stmt->name.value, typeOf(stmt->initial));
+    };
+
+    void visitBlockStmt(Block* stmt) override {
+        visit(stmt->statements);
+    };
+
+    void visitExpressionStmt(Expression* stmt) override {
+        typeOf(stmt->expr);
+    };
+
+    void visitForStmt(For* stmt) override {
+        bool range = isRange(stmt->iterable) && target("range") == nullptr && !globals.contains("range");
+        typeOf(stmt->iterable);
+        store(stmt->ref, stmt->name.value, range ? (uint16_t)TYPE_INT : (uint16_t)ANY);
+        stmt->body->accept(this);
+    };
+
+    // bodies are visited on their own, from run()
+    void visitFunctionStmt(Function* stmt) override {
+        store(stmt->binding, stmt->name.value, TYPE_FUNCTION);
+    };
+
+    void visitGlobalStmt(Global* stmt) override {};
+
+    void visitIfStmt(If* stmt) override {
+        uint16_t condition = typeOf(stmt->condition);
+        if (condition == TYPE_BOOL) {
+            mark(stmt->typed, TYPE_BOOL);
+        }
+        stmt->thenBranch->accept(this);
+        if (stmt->elseBranch != nullptr) {
+            stmt->elseBranch->accept(this);
+        }
+    };
+
+    void visitImportStmt(Import* stmt) override {
+        if (stmt->names.empty()) {
+            store(stmt->refs[0], stmt->module.value, TYPE_OTHER);
+        }
+        for (size_t i = 0; i < stmt->names.size(); i++) {
+            store(stmt->refs[i], stmt->names[i].value, ANY);
+        }
+    };
+
+    void visitNonlocalStmt(Nonlocal* stmt) override {};
+
+    void visitPrintStatement(Print* stmt) override {
+        for (Expr* e : stmt->exprs) {
+            typeOf(e);
+        }
+    };
+
+    void visitReturnStmt(Return* stmt) override {
+        uint16_t t = stmt->value != nullptr ? typeOf(stmt->value) : TYPE_NONE;
+        if (frame != nullptr) {
+            widen(frame->returns, t);
+        }
+    };
+
+    void visitYieldStmt(Yield* stmt) override {
+        if (stmt->value != nullptr) {
+            typeOf(stmt->value);
+        }
+    };
+
+    // --- expressions ---
+
+    void visitAssignExpr(Assign* expr) override {
+        typeOf(expr->value);
+        type = ANY;
+    };
+
+    void visitBinaryExpr(Binary* expr) override {
+        uint16_t lhs = typeOf(expr->left);
+        uint16_t rhs = typeOf(expr->right);
+        TokenType op = expr->op.type;
+        bool numbers = (lhs & NUMBER_TYPES) && (rhs & NUMBER_TYPES);
+        if (lhs != 0 && rhs != 0 && !numbers
+            && !((op == EQUAL_TO || op == NOT_EQUAL_TO) && (lhs & TYPE_BOOL) && (rhs & TYPE_BOOL))) {
+            report(expr->line, std::string("unsupported operand type(s) for ") + symbol(op) + ": " + names(lhs)
+                   + " and " + names(rhs));
+        }
+        if (!isArithmetic(op)) {
+            if (lhs == TYPE_INT && rhs == TYPE_INT) {
+                mark(expr->typed, TYPE_INT);
+            }
+            else if (lhs == TYPE_BOOL && rhs == TYPE_BOOL && (op == EQUAL_TO || op == NOT_EQUAL_TO)) {
+                mark(expr->typed, TYPE_BOOL);
+            }
+            type = TYPE_BOOL;
+            return;
+        }
+        if (lhs == TYPE_INT && rhs == TYPE_INT && op != DIVIDE) {
+            mark(expr->typed, TYPE_INT);
+        }
+        // an int only from two ints, a float if either can be one
+        type = 0;
+        if (!numbers) {
+            return;
+        }
+        if (op == DIVIDE || (lhs & TYPE_FLOAT) || (rhs & TYPE_FLOAT)) {
+            type |= TYPE_FLOAT;
+        }
+        if (op != DIVIDE && (lhs & TYPE_INT) && (rhs & TYPE_INT)) {
+            type |= TYPE_INT;
+        }
+    };
+
+    void visitCallExpr(Call* expr) override {
+        if (expr->object != nullptr) {
+            typeOf(expr->object);
+        }
+        std::vector<uint16_t> args;
+        for (Expr* a : expr->args) {
+            args.push_back(typeOf(a));
+        }
+        const std::string& name = expr->callee.value;
+        type = ANY;
+        if (expr->object != nullptr || expr->ref.kind != VAR_GLOBAL) {
+            return;
+        }
+        if (Function* f = target(name)) {
+            if (args.size() != f->params.size()) {
+                report(expr->line, name + "() takes " + std::to_string(f->params.size()) + " arguments but "
+                       + std::to_string(args.size()) + " were given");
+                type = 0;
+                return;
+            }
+            FunctionTypes* callee = functions.find(f);
+            for (size_t i = 0; i < args.size(); i++) {
+                widen(callee->slots[i], args[i]);
+            }
+            type = callee->returns;
+            return;
+        }
+        Builtin* b = Builtins::find(name);
+        if (b != nullptr && !globals.contains(name)) {
+            if (args.size() < b->min_args || args.size() > b->max_args) {
+                report(expr->line, name + "() called with wrong number of arguments");
+                type = 0;
+                return;
+            }
+            type = builtinResult(name, args);
+        }
+    };
+
+    void visitConditionalExpr(Conditional* expr) override {
+        if (typeOf(expr->condition) == TYPE_BOOL) {
+            mark(expr->typed, TYPE_BOOL);
+        }
+        type = typeOf(expr->thenBranch) | typeOf(expr->elseBranch);
+    };
+
+    void visitDictLiteralExpr(DictLiteral* expr) override {
+        for (size_t i = 0; i < expr->keys.size(); i++) {
+            typeOf(expr->keys[i]);
+            typeOf(expr->values[i]);
+        }
+        type = TYPE_DICT;
+    };
+
+    void visitGetExpr(Get* expr) override {
+        typeOf(expr->object);
+        type = ANY;
+    };
+
+    void visitGroupingExpr(Grouping* expr) override {
+        type = typeOf(expr->expression);
+    };
+
+    void visitInlineExpr(Inline* expr) override {
+        visitCallExpr(expr->call);
+    };
+
+    void visitListLiteralExpr(ListLiteral* expr) override {
+        for (Expr* e : expr->items) {
+            typeOf(e);
+        }
+        type = TYPE_LIST;
+    };
+
+    void visitLiteralExpr(Literal* expr) override {
+        switch (expr->token.type) {
+        case NUMBER: type = TYPE_INT; return;
+        case FLOAT: type = TYPE_FLOAT; return;
+        case TRUE:
+        case FALSE: type = TYPE_BOOL; return;
+        case STRING: type = TYPE_STRING; return;
+        case NONE: type = TYPE_NONE; return;
+        case IDENTIFIER: type = load(expr->ref, expr->token.value); return;
+        default: type = ANY;
+        }
+    };
+
+    void visitLogicalExpr(Logical* expr) override {
+        uint16_t lhs = typeOf(expr->left);
+        uint16_t rhs = typeOf(expr->right);
+        if (lhs == TYPE_BOOL) {
+            mark(expr->typed, TYPE_BOOL);
+        }
+        // the operand that decides
+        type = lhs | rhs;
+    };
+
+    void visitSetItemExpr(SetItem* expr) override {
+        typeOf(expr->object);
+        typeOf(expr->index);
+        type = typeOf(expr->value);
+    };
+
+    void visitSubscriptExpr(Subscript* expr) override {
+        typeOf(expr->object);
+        typeOf(expr->index);
+        type = ANY;
+    };
+
+    void visitUnaryExpr(Unary* expr) override {
+        uint16_t operand = typeOf(expr->right);
+        if (expr->op.type == MINUS) {
+            if (operand != 0 && !(operand & NUMBER_TYPES)) {
+                report(expr->line, "bad operand type for unary -: " + names(operand));
+            }
+            if (operand == TYPE_INT) {
+                mark(expr->typed, TYPE_INT);
+            }
+            type = operand & NUMBER_TYPES;
+            return;
+        }
+        if (operand == TYPE_BOOL) {
+            mark(expr->typed, TYPE_BOOL);
+        }
+        type = TYPE_BOOL;
+    };
+
+    void visitVariableExpr(Variable* expr) override {
+        type = ANY;
+    };
+};
@@ -6,21 +6,32 @@ class Expr;
 // statements
 class Block;
 class Expression;
+class For;
 class Function;
+class Global;
 class If;
+class Import;
+class Nonlocal;
 class Print;
 class Return;
 class Var;
+class Yield;
 
 // expressions
 class Assign;
 class Binary;
 class Call;
+class Conditional;
+class DictLiteral;
 class Get;
 class Grouping;
+class Inline;
+class ListLiteral;
 class Literal;
 class Logical;
 class Set;
+class SetItem;
+class Subscript;
 class Super;
 class This;
 class Unary;
@@ -32,17 +43,29 @@ public:
     virtual T visitVarStatement(Var* stmt) = 0;
     virtual T visitBlockStmt(Block* stmt) = 0;
     virtual T visitExpressionStmt(Expression* stmt) = 0;
+    virtual T visitForStmt(For* stmt) = 0;
     virtual T visitFunctionStmt(Function* stmt) = 0;
+    virtual T visitGlobalStmt(Global* stmt) = 0;
     virtual T visitIfStmt(If* stmt) = 0;
+    virtual T visitImportStmt(Import* stmt) = 0;
+    virtual T visitNonlocalStmt(Nonlocal* stmt) = 0;
     virtual T visitPrintStatement(Print* stmt) = 0;
     virtual T visitReturnStmt(Return* stmt) = 0;
+    virtual T visitYieldStmt(Yield* stmt) = 0;
 
     virtual T visitAssignExpr(Assign* expr) = 0;
     virtual T visitBinaryExpr(Binary* expr) = 0;
     virtual T visitCallExpr(Call* expr) = 0;
+    virtual T visitConditionalExpr(Conditional* expr) = 0;
+    virtual T visitDictLiteralExpr(DictLiteral* expr) = 0;
+    virtual T visitGetExpr(Get* expr) = 0;
     virtual T visitGroupingExpr(Grouping* expr) = 0;
+    virtual T visitInlineExpr(Inline* expr) = 0;
+    virtual T visitListLiteralExpr(ListLiteral* expr) = 0;
     virtual T visitLiteralExpr(Literal* expr) = 0;
     virtual T visitLogicalExpr(Logical* expr) = 0;
+    virtual T visitSetItemExpr(SetItem* expr) = 0;
+    virtual T visitSubscriptExpr(Subscript* expr) = 0;
     virtual T visitUnaryExpr(Unary* expr) = 0;
     virtual T visitVariableExpr(Variable* expr) = 0;
 };